@@ -0,0 +1,454 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/clock_cache.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/flat_lru_cache.h>
+#include <sw/frequency_sketch.h>
+#include <sw/lru_cache.h>
+#include <sw/miss_ratio_curve.h>
+#include <sw/snapshot_io.h>
+#include <sw/strings.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// One access of a cache trace, for the key and the size of its value in bytes
+struct TraceRecord {
+  u64 key;
+  u32 size;
+};
+
+namespace sim_detail {
+
+////////////////////////////////////////////////////////////////////////////////
+/// SplitMix64, so generated traces are the same on every platform
+class Random {
+public:
+  explicit Random(u64 seed) noexcept : state_(seed) {}
+
+  u64 next() noexcept {
+    auto z = (state_ += 0x9e3779b97f4a7c15_u64);
+    z = (z ^ (z >> 30u)) * 0xbf58476d1ce4e5b9_u64;
+    z = (z ^ (z >> 27u)) * 0x94d049bb133111eb_u64;
+    return z ^ (z >> 31u);
+  }
+
+  /// Uniform in [0, 1)
+  double uniform() noexcept { return static_cast<double>(next() >> 11u) * (1.0 / 9007199254740992.0); }
+
+private:
+  u64 state_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Generated values are 64 bytes to 4KB, fixed per key, so byte hit ratios differ from
+/// hit ratios
+inline u32 sizeOfKey(u64 key) noexcept { return 64u << (FrequencySketch::spread(key) % 7); }
+
+////////////////////////////////////////////////////////////////////////////////
+/// Starts a binary trace file
+constexpr sizex kTraceMagicSize = 8;
+inline const char* traceMagic() noexcept {
+  static constexpr char kMagic[kTraceMagicSize] = {'S', 'W', 'T', 'R', 'A', 'C', 'E', 1};
+  return kMagic;
+}
+
+}  // namespace sim_detail
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A recorded or generated sequence of cache accesses, to replay through caches with
+/// `CacheSimulator`.
+///
+/// # Files
+/// `load()` reads either form:
+/// - Binary, as written by `save()`: an 8 byte magic, then per access a u64 key and a
+///   u32 size in host byte order. It's memory-mapped, so large traces load quickly.
+/// - Text: one access per line, a key and an optional size in bytes (default 1). Keys
+///   that aren't decimal numbers are hashed, so string keys work too. Blank lines and
+///   lines starting with '#' are skipped.
+///
+/// # Generators
+/// - `zipf()`: keys drawn with popularity falling off as 1 / rank^skew, the usual model
+///   of web and storage traffic.
+/// - `scan()`: Zipf traffic interrupted by scans of keys used only once, which flush a
+///   plain LRU cache.
+/// - `loop()`: keys used in a repeating cycle, the worst case for LRU once the cycle is
+///   longer than the cache.
+////////////////////////////////////////////////////////////////////////////////
+class CacheTrace {
+public:
+  CacheTrace() = default;
+  explicit CacheTrace(std::vector<TraceRecord> records) : records_(std::move(records)) {}
+
+  const std::vector<TraceRecord>& records() const noexcept { return records_; }
+  std::vector<TraceRecord>& records() noexcept { return records_; }
+  sizex size() const noexcept { return records_.size(); }
+  bool empty() const noexcept { return records_.empty(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of distinct keys
+  sizex distinctKeys() const {
+    std::vector<u64> keys;
+    keys.reserve(records_.size());
+    for (const auto& record : records_) {
+      keys.push_back(record.key);
+    }
+    std::sort(keys.begin(), keys.end());
+    return static_cast<sizex>(std::unique(keys.begin(), keys.end()) - keys.begin());
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the sum of the accessed sizes
+  u64 totalBytes() const noexcept {
+    u64 bytes = 0;
+    for (const auto& record : records_) {
+      bytes += record.size;
+    }
+    return bytes;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// `count` accesses to keys `[0, keys)`, key `k` having popularity 1 / (k + 1)^skew
+  static CacheTrace zipf(sizex count, sizex keys, double skew, u64 seed = 1) {
+    const auto cdf = zipfCdf(keys, skew);
+    sim_detail::Random random(seed);
+    CacheTrace trace;
+    trace.records_.reserve(count);
+    for (sizex i = 0; i < count; ++i) {
+      trace.push(drawZipf(cdf, random));
+    }
+    return trace;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Zipf traffic as `zipf()`, with a scan of `scanLength` never repeated keys every
+  /// `scanPeriod` accesses. Scans count towards `count`.
+  static CacheTrace scan(sizex count, sizex keys, double skew, sizex scanLength, sizex scanPeriod, u64 seed = 1) {
+    const auto cdf = zipfCdf(keys, skew);
+    sim_detail::Random random(seed);
+    CacheTrace trace;
+    trace.records_.reserve(count);
+    u64 scanKey = keys;
+    sizex sinceScan = 0;
+    while (trace.size() < count) {
+      if (scanPeriod != 0 && ++sinceScan >= scanPeriod) {
+        sinceScan = 0;
+        for (sizex i = 0; i < scanLength && trace.size() < count; ++i) {
+          trace.push(scanKey++);
+        }
+        continue;
+      }
+      trace.push(drawZipf(cdf, random));
+    }
+    return trace;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// `count` accesses cycling through keys `[0, keys)` in order
+  static CacheTrace loop(sizex count, sizex keys) {
+    CacheTrace trace;
+    trace.records_.reserve(count);
+    for (sizex i = 0; i < count; ++i) {
+      trace.push(i % std::max(keys, 1_z));
+    }
+    return trace;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Write the binary form
+  bool save(const std::string& path) const {
+    SnapshotWriter out(path);
+    out.write(sim_detail::traceMagic(), sim_detail::kTraceMagicSize);
+    for (const auto& record : records_) {
+      out.write(&record.key, sizeof(record.key));
+      out.write(&record.size, sizeof(record.size));
+    }
+    return out.finish();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Read either the binary or the text form, replacing the current records
+  bool load(const std::string& path) {
+    records_.clear();
+    {
+      SnapshotReader in(path);
+      if (!in.ok()) {
+        return false;
+      }
+      const auto magic = in.view(sim_detail::kTraceMagicSize);
+      if (magic != nullptr && std::memcmp(magic, sim_detail::traceMagic(), sim_detail::kTraceMagicSize) == 0) {
+        while (in.ok() && !in.atEnd()) {
+          TraceRecord record;
+          in.read(&record.key, sizeof(record.key));
+          in.read(&record.size, sizeof(record.size));
+          records_.push_back(record);
+        }
+        if (!in.ok()) {
+          records_.pop_back();
+        }
+        return in.ok();
+      }
+    }
+    return loadText(path);
+  }
+
+private:
+  void push(u64 key) { records_.push_back(TraceRecord{key, sim_detail::sizeOfKey(key)}); }
+
+  static std::vector<double> zipfCdf(sizex keys, double skew) {
+    std::vector<double> cdf(std::max(keys, 1_z));
+    double sum = 0;
+    for (sizex i = 0; i < cdf.size(); ++i) {
+      sum += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+      cdf[i] = sum;
+    }
+    for (auto& value : cdf) {
+      value /= sum;
+    }
+    return cdf;
+  }
+
+  static u64 drawZipf(const std::vector<double>& cdf, sim_detail::Random& random) {
+    const auto iter = std::upper_bound(cdf.begin(), cdf.end(), random.uniform());
+    return static_cast<u64>(std::min(static_cast<sizex>(iter - cdf.begin()), cdf.size() - 1));
+  }
+
+  bool loadText(const std::string& path) {
+    auto file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+      return false;
+    }
+
+    char line[4096];
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+      const char* pos = line;
+      while (*pos == ' ' || *pos == '\t') {
+        ++pos;
+      }
+      if (*pos == '#' || *pos == '\n' || *pos == '\r' || *pos == '\0') {
+        continue;
+      }
+
+      const auto keyStart = pos;
+      bool isNumber = true;
+      u64 key = 0;
+      while (*pos != '\0' && *pos != ' ' && *pos != '\t' && *pos != '\n' && *pos != '\r') {
+        isNumber = isNumber && *pos >= '0' && *pos <= '9';
+        key = key * 10 + static_cast<u64>(*pos - '0');
+        ++pos;
+      }
+      if (!isNumber) {
+        key = hashBytes(keyStart, static_cast<sizex>(pos - keyStart));
+      }
+
+      u64 size = 0;
+      while (*pos == ' ' || *pos == '\t') {
+        ++pos;
+      }
+      while (*pos >= '0' && *pos <= '9') {
+        size = size * 10 + static_cast<u64>(*pos - '0');
+        ++pos;
+      }
+      records_.push_back(TraceRecord{key, size != 0 ? static_cast<u32>(size) : 1u});
+    }
+
+    const auto ok = std::ferror(file) == 0;
+    std::fclose(file);
+    return ok;
+  }
+
+private:
+  std::vector<TraceRecord> records_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// The outcome of replaying a trace through one cache
+struct SimulationResult {
+  std::string policy;
+  sizex cacheSize = 0;
+  u64 requests = 0;
+  u64 hits = 0;
+  u64 requestBytes = 0;
+  u64 hitBytes = 0;
+  double seconds = 0;
+
+  double hitRatio() const noexcept { return requests != 0 ? static_cast<double>(hits) / static_cast<double>(requests) : 0; }
+
+  double byteHitRatio() const noexcept {
+    return requestBytes != 0 ? static_cast<double>(hitBytes) / static_cast<double>(requestBytes) : 0;
+  }
+
+  double opsPerSecond() const noexcept { return seconds > 0 ? static_cast<double>(requests) / seconds : 0; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Replay the trace through a cache of u64 keys to u32 sizes, with any `get(key, T&)`
+/// and `put(key, value)` API. A miss puts the key, as a read-through cache would.
+template <typename Cache>
+SimulationResult replayTrace(Cache& cache, const CacheTrace& trace) {
+  SimulationResult result;
+  u32 value = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& record : trace.records()) {
+    if (cache.get(record.key, value)) {
+      ++result.hits;
+      result.hitBytes += record.size;
+    } else {
+      cache.put(record.key, record.size);
+    }
+  }
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  result.requests = trace.size();
+  result.requestBytes = trace.totalBytes();
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// Replays a `CacheTrace` through several eviction policies at several sizes, to choose
+/// a policy and size offline from real traffic. The built in policies are the `LruCache`
+/// policies, plus W-TinyLFU admission, `ClockCache` and `FlatLruCache`. `addPolicy()`
+/// registers others.
+///
+/// Each policy and size is a separate replay, so its ops/sec is its own. `lruCurve()`
+/// instead gives the exact LRU miss ratio at every size from a single pass.
+////////////////////////////////////////////////////////////////////////////////
+class CacheSimulator {
+public:
+  /// Replays the trace through a new cache of the given size
+  using Runner = std::function<SimulationResult(const CacheTrace&, sizex)>;
+
+  CacheSimulator() {
+    addLruPolicy<LruPolicy>("lru");
+    addLruPolicy<SlruPolicy>("slru");
+    addLruPolicy<TwoQPolicy>("2q");
+    addLruPolicy<ArcPolicy>("arc");
+    addLruPolicy<LfuPolicy>("lfu");
+    addLruPolicy<LruPolicy, TinyLfuAdmission>("tinylfu");
+    addCache<ClockCache<u64, u32>>("clock");
+    addCache<FlatLruCache<u64, u32>>("flat");
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Register a policy, replacing any of the same name
+  void addPolicy(std::string name, Runner runner) {
+    for (auto& policy : policies_) {
+      if (policy.first == name) {
+        policy.second = std::move(runner);
+        return;
+      }
+    }
+    policies_.emplace_back(std::move(name), std::move(runner));
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the registered policy names, in registration order
+  std::vector<std::string> policies() const {
+    std::vector<std::string> names;
+    for (const auto& policy : policies_) {
+      names.push_back(policy.first);
+    }
+    return names;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  bool hasPolicy(const std::string& name) const { return findRunner(name) != nullptr; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Replay the trace for every policy at every size, policy major. Unknown policies are
+  /// skipped.
+  std::vector<SimulationResult> run(const CacheTrace& trace, const std::vector<sizex>& sizes,
+                                    const std::vector<std::string>& names) const {
+    std::vector<SimulationResult> results;
+    for (const auto& name : names) {
+      const auto runner = findRunner(name);
+      if (runner == nullptr) {
+        continue;
+      }
+      for (const auto cacheSize : sizes) {
+        auto result = (*runner)(trace, cacheSize);
+        result.policy = name;
+        result.cacheSize = cacheSize;
+        results.push_back(std::move(result));
+      }
+    }
+    return results;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the exact LRU miss ratio curve for sizes up to `maxCacheSize`, in `buckets`
+  /// steps, from one pass over the trace (see `MissRatioEstimator`)
+  static MissRatioEstimator lruCurve(const CacheTrace& trace, sizex maxCacheSize, sizex buckets = 64) {
+    MissRatioEstimator estimator(maxCacheSize, buckets, 1.0, std::max(trace.distinctKeys(), 1_z));
+    for (const auto& record : trace.records()) {
+      estimator.access(FrequencySketch::spread(record.key));
+    }
+    return estimator;
+  }
+
+private:
+  template <typename PolicyType, typename AdmissionType>
+  struct PolicyTraits : LruCacheTraits<u64, u32> {
+    using Policy = PolicyType;
+    using Admission = AdmissionType;
+  };
+
+  template <typename Cache>
+  void addCache(std::string name) {
+    addPolicy(std::move(name), [](const CacheTrace& trace, sizex cacheSize) {
+      Cache cache(cacheSize);
+      return replayTrace(cache, trace);
+    });
+  }
+
+  template <typename Policy, typename Admission = NoAdmission>
+  void addLruPolicy(std::string name) {
+    addCache<LruCache<u64, u32, true, PolicyTraits<Policy, Admission>>>(std::move(name));
+  }
+
+  const Runner* findRunner(const std::string& name) const {
+    for (const auto& policy : policies_) {
+      if (policy.first == name) {
+        return &policy.second;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+  std::vector<std::pair<std::string, Runner>> policies_;
+};
+
+SW_NAMESPACE_END
@@ -0,0 +1,280 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/lru_cache.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A thread-safe cache using CLOCK (aka second-chance) eviction, a close approximation of
+/// LRU that is much friendlier to concurrent readers.
+///
+/// With `LruCache`, every hit splices the entry to the front of the list, so even reads
+/// need exclusive access. Here, a hit only sets the entry's atomic reference bit. Readers
+/// (`get()`, `contains()`, `find()`) therefore all share a shared lock and never block
+/// each other. Only writers take the lock exclusively.
+///
+/// Entries sit in a dense array with a "clock hand" sweeping over it. When a new key is
+/// inserted into a full cache, the hand advances, clearing reference bits as it goes, and
+/// evicts the first entry whose bit was already clear. So an entry used since the hand
+/// last passed it gets a second chance. Only inserts and evictions move the hand.
+///
+/// The `SharedMutex` must be usable with `std::shared_lock` and `std::unique_lock`.
+////////////////////////////////////////////////////////////////////////////////
+template <typename Key, typename T, typename SharedMutex = std::shared_timed_mutex>
+class ClockCache {
+  using ReadLock = std::shared_lock<SharedMutex>;
+  using WriteLock = std::unique_lock<SharedMutex>;
+  using RefBit = std::atomic<u8>;
+
+  struct Entry {
+    Entry(const Key& k, const T& v) : key(k), value(v) {}
+    Entry(const Key& k, T&& v) : key(k), value(std::move(v)) {}
+    Key key;
+    T value;
+  };
+
+public:
+  using KeyType = Key;
+  using ValueType = T;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache and sets the maximum size before items get evicted.
+  explicit ClockCache(sizex maxSizeValue = 10) :
+      maxSize_(std::max(maxSizeValue, 1_z)), refBits_(new RefBit[maxSize_]) {
+    entries_.reserve(maxSize_);
+  }
+
+  // Holds a mutex, so no move/copy
+  ClockCache(const ClockCache&) = delete;
+  ClockCache& operator=(const ClockCache&) = delete;
+  ClockCache(ClockCache&&) = delete;
+  ClockCache& operator=(ClockCache&&) = delete;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of items in the cache
+  sizex size() const {
+    ReadLock lock(mutex_);
+    return entries_.size();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the cache empty?
+  bool empty() const { return size() == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the maximum number of items allowed in the cache
+  sizex maxSize() const {
+    ReadLock lock(mutex_);
+    return maxSize_;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Sets the maximum size of the cache. Shrinking evicts entries using the clock.
+  void setMaxSize(sizex maxSizeValue) {
+    WriteLock lock(mutex_);
+    const auto newMaxSize = std::max(maxSizeValue, 1_z);
+    while (entries_.size() > newMaxSize) {
+      removeAt(advanceHand());
+    }
+
+    std::unique_ptr<RefBit[]> refBits(new RefBit[newMaxSize]);
+    for (sizex i = 0; i < entries_.size(); ++i) {
+      refBits[i].store(refBits_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    refBits_ = std::move(refBits);
+    maxSize_ = newMaxSize;
+    entries_.reserve(maxSize_);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Check if the given key is mapped to a value in the cache. Does *not* count as a use.
+  bool contains(const KeyType& key) const {
+    ReadLock lock(mutex_);
+    return map_.find(key) != map_.end();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Clear the cache completely
+  void clear() {
+    WriteLock lock(mutex_);
+    map_.clear();
+    entries_.clear();
+    hand_ = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a cached value
+  sizex erase(const KeyType& key) {
+    WriteLock lock(mutex_);
+    auto iter = map_.find(key);
+    if (iter == map_.end()) {
+      return 0;
+    }
+
+    removeAt(iter->second);
+    return 1;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key
+  void put(const KeyType& key, const T& value) { doPut(key, value); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key
+  void put(const KeyType& key, T&& value) { doPut(key, std::move(value)); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Only takes the shared lock.
+  /// @value Will be a copy of the value if it exists, otherwise it is unchanged
+  /// @return true if the value was found
+  bool get(const KeyType& key, T& value) const {
+    ReadLock lock(mutex_);
+    auto iter = map_.find(key);
+    if (iter == map_.end()) {
+      return false;
+    }
+
+    onValueUsed(iter->second);
+    value = entries_[iter->second].value;
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the cache element with the specified key. If it exists, `func(const T&)` is
+  /// called with the shared lock held. Other readers may be looking at the same value.
+  /// @return true if the value was found
+  template <typename Func>
+  bool find(const KeyType& key, Func&& func) const {
+    ReadLock lock(mutex_);
+    auto iter = map_.find(key);
+    if (iter == map_.end()) {
+      return false;
+    }
+
+    onValueUsed(iter->second);
+    func(static_cast<const T&>(entries_[iter->second].value));
+    return true;
+  }
+
+private:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// A hit only sets the reference bit, which is safe under the shared lock. It's only
+  /// written when clear, so hot entries' cache lines stay shared between the readers.
+  void onValueUsed(sizex index) const noexcept {
+    if (refBits_[index].load(std::memory_order_relaxed) == 0) {
+      refBits_[index].store(1, std::memory_order_relaxed);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  template <typename Value>
+  void doPut(const KeyType& key, Value&& value) {
+    WriteLock lock(mutex_);
+    auto iter = map_.find(key);
+    if (iter != map_.end()) {
+      entries_[iter->second].value = std::forward<Value>(value);
+      onValueUsed(iter->second);
+      return;
+    }
+
+    // Still filling up. New entries start unreferenced so that they need a hit before
+    // they earn a second chance.
+    if (entries_.size() < maxSize_) {
+      entries_.emplace_back(key, std::forward<Value>(value));
+      refBits_[entries_.size() - 1].store(0, std::memory_order_relaxed);
+      map_.emplace(key, entries_.size() - 1);
+      return;
+    }
+
+    // Full, so recycle the victim's slot
+    const auto victim = advanceHand();
+    auto& entry = entries_[victim];
+    map_.erase(entry.key);
+    entry.key = key;
+    entry.value = std::forward<Value>(value);
+    refBits_[victim].store(0, std::memory_order_relaxed);
+    map_.emplace(key, victim);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Sweep the hand until an unreferenced entry is found, giving referenced entries a
+  /// second chance along the way. Terminates within one revolution plus one step.
+  /// @return The index of the victim. The hand is left just past it.
+  sizex advanceHand() noexcept {
+    SW_ASSERT(!entries_.empty());
+    while (true) {
+      if (hand_ >= entries_.size()) {
+        hand_ = 0;
+      }
+      const auto index = hand_++;
+      if (refBits_[index].exchange(0, std::memory_order_relaxed) == 0) {
+        return index;
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove the entry at the given index by moving the last entry into its place
+  void removeAt(sizex index) {
+    map_.erase(entries_[index].key);
+    const auto last = entries_.size() - 1;
+    if (index != last) {
+      entries_[index] = std::move(entries_[last]);
+      refBits_[index].store(refBits_[last].load(std::memory_order_relaxed), std::memory_order_relaxed);
+      map_[entries_[index].key] = index;
+    }
+    entries_.pop_back();
+  }
+
+private:
+  /// Guards everything but the reference bits
+  mutable SharedMutex mutex_;
+
+  /// Maps keys to indices into `entries_`
+  SysHashMap<Key, sizex> map_;
+
+  /// Dense array of entries, never larger than maxSize_
+  std::vector<Entry> entries_;
+
+  /// Maximum size for the cache (aka max num entries)
+  sizex maxSize_ = 10;
+
+  /// One reference bit per entry. Set by readers, cleared by the clock hand
+  std::unique_ptr<RefBit[]> refBits_;
+
+  /// The clock hand. Index of the next entry to consider for eviction
+  sizex hand_ = 0;
+};
+
+SW_NAMESPACE_END
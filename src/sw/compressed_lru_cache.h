@@ -0,0 +1,275 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/lru_cache.h>
+#include <sw/lz_codec.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// A value as kept in the compressed segment of a `CompressedLruCache`
+struct CompressedValue {
+  /// The value, compressed by `lzCompress()` if `rawSize` is non-zero
+  std::string bytes;
+
+  /// Size of the value before compression, or zero if it's stored as is
+  sizex rawSize = 0;
+
+  bool isCompressed() const noexcept { return rawSize != 0; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Weighs string values, raw or compressed, by their bytes
+struct StringBytesWeigher {
+  template <typename Key>
+  sizex operator()(const Key&, const std::string& value) const noexcept {
+    return value.size();
+  }
+  template <typename Key>
+  sizex operator()(const Key&, const CompressedValue& value) const noexcept {
+    return value.bytes.size();
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// An LRU cache of string values, such as text or JSON, that keeps most of them
+/// compressed so the same memory holds several times as many.
+///
+/// There are two segments, each an `LruCache` limited by bytes. New and recently used
+/// entries sit uncompressed in the small front segment, where hits cost no more than in
+/// a plain `LruCache`. Entries the front purges for size are compressed with the
+/// built-in LZ codec (see `lzCompress()`) and moved to the back segment, which has the
+/// rest of the budget. A hit there decompresses the value and moves it back to the
+/// front. A key lives in one segment at most.
+///
+/// Values under `compressMinBytes`, or that compression doesn't shrink by at least an
+/// eighth, go to the back as they are rather than paying to decompress for little gain.
+///
+/// The byte budgets are the segments' max weights. Their max sizes, which also size a
+/// policy's segments and an admission sketch, are the budgets divided by
+/// `averageValueBytes`, so the entry count only binds if the values stored average less.
+///
+/// This wraps `LruCache` rather than being a mode of it, since `LruCache` hands out
+/// references to its values, which can't point into compressed bytes.
+///
+/// # Traits
+/// The front segment uses the `Traits`, except for its weigher and eviction listener,
+/// which are how demotion works. The back segment uses the `Traits` hashing.
+///
+/// Like `LruCache`, this is not thread-safe.
+////////////////////////////////////////////////////////////////////////////////
+template <typename Key, typename Traits = LruCacheTraits<Key, std::string>>
+class CompressedLruCache {
+  struct FrontTraits : Traits {
+    using Weigher = StringBytesWeigher;
+
+    /// Gathers the front segment's evictions to be compressed once its operation is over
+    using EvictionListener = LruEvictionCollector<Key, std::string>;
+  };
+
+  struct BackTraits : LruCacheTraits<Key, CompressedValue> {
+    using Weigher = StringBytesWeigher;
+    using Hash = typename Traits::Hash;
+    using KeyEqual = typename Traits::KeyEqual;
+  };
+
+public:
+  using KeyType = Key;
+  using ValueType = std::string;
+  using FrontCache = LruCache<Key, std::string, true, FrontTraits>;
+  using BackCache = LruCache<Key, CompressedValue, true, BackTraits>;
+
+  /// Values smaller than this are stored uncompressed by default
+  static constexpr sizex kDefaultCompressMinBytes = 128;
+
+  /// Stored bytes per value the entry counts are sized for by default
+  static constexpr sizex kDefaultAverageValueBytes = 64;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache holding up to `maxBytes` of values, of which `frontBytes` are
+  /// kept uncompressed. The default front is an eighth of the budget. Each segment holds
+  /// at most its bytes over `averageValueBytes` entries.
+  explicit CompressedLruCache(sizex maxBytes, sizex frontBytes = ~0_z,
+                              sizex compressMinBytes = kDefaultCompressMinBytes,
+                              sizex averageValueBytes = kDefaultAverageValueBytes) :
+      compressMinBytes_(compressMinBytes) {
+    const auto frontLimit = std::min(frontBytes == ~0_z ? maxBytes / 8 : frontBytes, maxBytes);
+    const auto backLimit = maxBytes - frontLimit;
+    const auto average = std::max(averageValueBytes, 1_z);
+    front_.setMaxSize(std::max(frontLimit / average, 1_z));
+    front_.setMaxWeight(frontLimit);
+    back_.setMaxSize(std::max(backLimit / average, 1_z));
+    back_.setMaxWeight(backLimit);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of entries in both segments
+  sizex size() const noexcept { return front_.size() + back_.size(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the cache empty?
+  bool empty() const noexcept { return size() == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the bytes the values take as stored, compressed or not
+  sizex storedBytes() const noexcept { return front_.totalWeight() + back_.totalWeight(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the most bytes the values may take as stored
+  sizex maxBytes() const noexcept { return front_.maxWeight() + back_.maxWeight(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The uncompressed front segment, such as for its `snapshot()`
+  const FrontCache& front() const noexcept { return front_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The compressed back segment
+  const BackCache& back() const noexcept { return back_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Check if the key is in either segment. Does *not* count as a use.
+  bool contains(const KeyType& key) const { return front_.contains(key) || back_.contains(key); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Clear both segments
+  void clear() {
+    front_.clear();
+    front_.evictionListener().collected.clear();
+    back_.clear();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove the key from whichever segment has it
+  sizex erase(const KeyType& key) {
+    const auto erased = front_.erase(key) + back_.erase(key);
+    demote();
+    return erased;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates the value in the front, compressing whatever that purges
+  void put(const KeyType& key, const std::string& value) { doPut(key, value); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates the value in the front, compressing whatever that purges
+  void put(const KeyType& key, std::string&& value) { doPut(key, std::move(value)); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Look in the front, then the back, decompressing a value found there and moving it
+  /// to the front.
+  /// @value Will be a copy of the value if it exists, otherwise it is unchanged
+  /// @return true if the value was found
+  bool get(const KeyType& key, std::string& value) {
+    if (front_.get(key, value)) {
+      demote();
+      return true;
+    }
+
+    auto iter = back_.find(key);
+    if (iter == back_.end()) {
+      return false;
+    }
+    auto& stored = iter.value();
+    if (!stored.isCompressed()) {
+      value = std::move(stored.bytes);
+    } else if (!lzDecompress(stored.bytes.data(), stored.bytes.size(), stored.rawSize, scratch_)) {
+      back_.erase(key);
+      return false;
+    } else {
+      value = scratch_;
+    }
+    back_.erase(key);
+
+    front_.put(key, value);
+    demote();
+    return true;
+  }
+
+private:
+  template <typename Value>
+  void doPut(const KeyType& key, Value&& value) {
+    // Any compressed copy is now stale
+    back_.erase(key);
+    front_.put(key, std::forward<Value>(value));
+    demote();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Compress what the front purged into the back
+  void demote() {
+    auto& collected = front_.evictionListener().collected;
+    if (collected.empty()) {
+      return;
+    }
+
+    auto evictions = std::move(collected);
+    collected.clear();
+    for (auto& eviction : evictions) {
+      if (eviction.reason != LruEvictionReason::Size) {
+        continue;
+      }
+
+      CompressedValue stored;
+      const auto rawSize = eviction.value.size();
+      if (rawSize >= compressMinBytes_) {
+        lzCompress(eviction.value.data(), rawSize, scratch_);
+        if (scratch_.size() <= rawSize - rawSize / 8) {
+          stored.bytes = scratch_;
+          stored.rawSize = rawSize;
+        }
+      }
+      if (!stored.isCompressed()) {
+        stored.bytes = std::move(eviction.value);
+      }
+      back_.put(eviction.key, std::move(stored));
+    }
+  }
+
+private:
+  /// Recently used entries, uncompressed
+  FrontCache front_;
+
+  /// Entries demoted from the front, mostly compressed
+  BackCache back_;
+
+  /// Values smaller than this aren't compressed
+  sizex compressMinBytes_;
+
+  /// Scratch space for compressing and decompressing
+  std::string scratch_;
+};
+
+template <typename Key, typename Traits>
+constexpr sizex CompressedLruCache<Key, Traits>::kDefaultCompressMinBytes;
+template <typename Key, typename Traits>
+constexpr sizex CompressedLruCache<Key, Traits>::kDefaultAverageValueBytes;
+
+SW_NAMESPACE_END
@@ -0,0 +1,566 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/lru_cache.h>
+#include <sw/types.h>
+
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A thread-safe LRU cache built from `kShards` independent `LruCache` shards. Each key
+/// is hashed to exactly one shard, and each shard has its own mutex. Threads working on
+/// different shards never contend, so throughput scales with the core count rather than
+/// queueing on one global lock.
+///
+/// The trade-off is that LRU ordering is per-shard rather than global. With a reasonable
+/// hash the shards see near identical traffic, so in practice the hit ratio is very close
+/// to that of a single cache of the same total size.
+///
+/// # Capacity
+/// Each shard has its own maximum size. The constructor and `setMaxSize()` spread a total
+/// capacity evenly across the shards (rounding up), and `maxSize()` reports the sum of the
+/// shard capacities. Use `setShardMaxSize()` to size an individual shard.
+///
+/// # Access
+/// `put()`, `get()`, `contains()` and `erase()` behave as they do for `LruCache`. Since an
+/// iterator can't outlive the shard lock, `find()` takes a function that is called with a
+/// reference to the cached value while the shard is locked:
+///    cache.find(1, [](std::string& value) { value += "!"; });
+/// Keep those functions short, they block every other thread using the same shard.
+///
+/// # Loading
+/// `getOrCompute()` returns the cached value, or loads it on a miss. Only one thread
+/// loads a given key at a time: others asking for it while it's loading wait for that
+/// result instead of loading it again, so a cold key doesn't cause a thundering herd.
+/// The loader runs with the shard unlocked.
+///
+/// # Eviction Listener
+/// The `Listener` takes the same per value or batched forms as an `LruCache` eviction
+/// listener (see `LruCacheTraits`). Values removed by an operation are gathered while
+/// the shard is locked, but the listener is only called after it's unlocked, so a slow
+/// listener, such as one writing values back to disk, doesn't stall other threads using
+/// the shard. The listener may be called from several threads at once.
+///
+/// # Statistics
+/// With `kRecordStats`, each shard counts as an `LruCache` with `SharedStats` would, in
+/// relaxed atomics written under the shard's lock. `snapshot()` sums them without taking
+/// any lock, so it never slows the cache down, at the cost of the shards being read at
+/// slightly different moments.
+////////////////////////////////////////////////////////////////////////////////
+template <typename Key, typename T, sizex kShards = 16, typename Mutex = std::mutex,
+          typename Listener = NullEvictionListener, bool kRecordStats = false>
+class ConcurrentLruCache {
+  static_assert(kShards > 0 && (kShards & (kShards - 1)) == 0, "Shard count must be a power of two");
+
+  using LockGuard = std::lock_guard<Mutex>;
+  using Evictions = std::vector<LruEviction<Key, T>>;
+
+  /// Shard caches collect their evictions for the listener to be called once unlocked
+  using Collector = LruEvictionCollector<Key, T>;
+
+public:
+  /// Is there a listener to hand removed values to?
+  static constexpr bool kHasEvictionListener = !std::is_same<Listener, NullEvictionListener>::value;
+
+private:
+  struct ShardTraits : LruCacheTraits<Key, T> {
+    using EvictionListener = typename std::conditional<kHasEvictionListener, Collector, NullEvictionListener>::type;
+    using Stats = typename std::conditional<kRecordStats, SharedStats, NoStats>::type;
+  };
+
+public:
+  using CacheType = LruCache<Key, T, true, ShardTraits>;
+  using KeyType = Key;
+  using ValueType = T;
+  static constexpr sizex kShardCount = kShards;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache, spreading the given maximum size across the shards
+  explicit ConcurrentLruCache(sizex maxSizeValue = kShards * 10) { setMaxSize(maxSizeValue); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache with the listener for removed values, spreading the given maximum
+  /// size across the shards
+  ConcurrentLruCache(sizex maxSizeValue, Listener listener) : listener_(std::move(listener)) {
+    setMaxSize(maxSizeValue);
+  }
+
+  // Shards hold mutexes, so no move/copy
+  ConcurrentLruCache(const ConcurrentLruCache&) = delete;
+  ConcurrentLruCache& operator=(const ConcurrentLruCache&) = delete;
+  ConcurrentLruCache(ConcurrentLruCache&&) = delete;
+  ConcurrentLruCache& operator=(ConcurrentLruCache&&) = delete;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of items in the cache. Each shard is locked in turn, so the
+  /// result is only a snapshot when other threads are modifying the cache.
+  sizex size() const {
+    sizex result = 0;
+    for (auto& shard : shards_) {
+      LockGuard lock(shard.mutex);
+      result += shard.cache.size();
+    }
+    return result;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the cache empty?
+  bool empty() const { return size() == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the sum of the maximum sizes of all shards
+  sizex maxSize() const {
+    sizex result = 0;
+    for (auto& shard : shards_) {
+      LockGuard lock(shard.mutex);
+      result += shard.cache.maxSize();
+    }
+    return result;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Spread the given total maximum size across the shards. Each shard gets at least one
+  /// entry, so the effective maximum size is rounded up to a multiple of the shard count.
+  void setMaxSize(sizex maxSizeValue) {
+    const auto shardMaxSize = std::max((maxSizeValue + kShards - 1) / kShards, 1_z);
+    for (auto& shard : shards_) {
+      Evictions evictions;
+      {
+        LockGuard lock(shard.mutex);
+        shard.cache.setMaxSize(shardMaxSize);
+        takeEvictions(shard, evictions);
+      }
+      notify(std::move(evictions));
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the maximum size of a single shard
+  sizex shardMaxSize(sizex shardIndex) const {
+    SW_ASSERT(shardIndex < kShards);
+    auto& shard = shards_[shardIndex];
+    LockGuard lock(shard.mutex);
+    return shard.cache.maxSize();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Sets the maximum size of a single shard
+  void setShardMaxSize(sizex shardIndex, sizex maxSizeValue) {
+    SW_ASSERT(shardIndex < kShards);
+    auto& shard = shards_[shardIndex];
+    Evictions evictions;
+    {
+      LockGuard lock(shard.mutex);
+      shard.cache.setMaxSize(maxSizeValue);
+      takeEvictions(shard, evictions);
+    }
+    notify(std::move(evictions));
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the index of the shard the given key lives in
+  static sizex shardIndex(const KeyType& key) noexcept {
+    // The shard's hash-map uses the low bits of the same hash (the traits' `Hash`), so
+    // select the shard with a multiplicative mix of the high bits to keep the two from
+    // correlating.
+    const auto hash = static_cast<u64>(typename ShardTraits::Hash{}(key));
+    return static_cast<sizex>((hash * 0x9e3779b97f4a7c15_u64) >> 32u) & (kShards - 1);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Check if the given key is mapped to a value in the cache. Does *not* change
+  /// cache ordering.
+  bool contains(const KeyType& key) const {
+    auto& shard = shardFor(key);
+    LockGuard lock(shard.mutex);
+    return shard.cache.contains(key);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key
+  void put(const KeyType& key, const T& value) {
+    auto& shard = shardFor(key);
+    Evictions evictions;
+    {
+      LockGuard lock(shard.mutex);
+      shard.cache.put(key, value);
+      shard.flights.erase(key);
+      takeEvictions(shard, evictions);
+    }
+    notify(std::move(evictions));
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key
+  void put(const KeyType& key, T&& value) {
+    auto& shard = shardFor(key);
+    Evictions evictions;
+    {
+      LockGuard lock(shard.mutex);
+      shard.cache.put(key, std::move(value));
+      shard.flights.erase(key);
+      takeEvictions(shard, evictions);
+    }
+    notify(std::move(evictions));
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// @value Will be a copy of the value if it exists, otherwise it is unchanged
+  /// @return true if the value was found
+  bool get(const KeyType& key, T& value) {
+    auto& shard = shardFor(key);
+    Evictions evictions;
+    bool found = false;
+    {
+      LockGuard lock(shard.mutex);
+      found = shard.cache.get(key, value);
+      takeEvictions(shard, evictions);
+    }
+    notify(std::move(evictions));
+    return found;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return a copy of the cached value for the key, calling `loader(key)` on a miss and
+  /// caching its value. Concurrent callers for the same missing key share one call of
+  /// the loader. If it throws, every one of them gets the exception, and nothing is
+  /// cached. A `put()`, `erase()` or `clear()` of the key while it's loading wins, so the
+  /// loaded value is returned but not cached.
+  template <typename Loader>
+  T getOrCompute(const KeyType& key, Loader&& loader) {
+    auto& shard = shardFor(key);
+    std::shared_ptr<Flight> flight;
+    bool isLeader = false;
+    {
+      // A lookup may purge, when the shard has a purge budget
+      Evictions purged;
+      std::unique_lock<Mutex> lock(shard.mutex);
+      auto cached = shard.cache.find(key);
+      if (cached != shard.cache.end()) {
+        T value = cached.value();
+        takeEvictions(shard, purged);
+        lock.unlock();
+        notify(std::move(purged));
+        return value;
+      }
+
+      auto loading = shard.flights.find(key);
+      if (loading != shard.flights.end()) {
+        flight = loading->second;
+      } else {
+        flight = std::make_shared<Flight>();
+        shard.flights.emplace(key, flight);
+        isLeader = true;
+      }
+      takeEvictions(shard, purged);
+      lock.unlock();
+      notify(std::move(purged));
+    }
+
+    if (!isLeader) {
+      return flight->wait();
+    }
+
+    // This caller is the leader, so load and publish. The waiters and the listener are
+    // only told once the flight is settled, so a throwing listener can't fail it.
+    Evictions evictions;
+    T value = loadAndPublish(shard, key, flight, loader, evictions);
+    flight->complete(value);
+    notify(std::move(evictions));
+    return value;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the cache element with the specified key. If it exists, it is refreshed to
+  /// the front of its shard and `func(T&)` is called with the shard locked.
+  /// @return true if the value was found
+  template <typename Func>
+  bool find(const KeyType& key, Func&& func) {
+    auto& shard = shardFor(key);
+    Evictions evictions;
+    bool found = false;
+    {
+      LockGuard lock(shard.mutex);
+      auto iter = shard.cache.find(key);
+      if (iter != shard.cache.end()) {
+        func(iter.value());
+        found = true;
+      }
+      takeEvictions(shard, evictions);
+    }
+    notify(std::move(evictions));
+    return found;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a cached value
+  sizex erase(const KeyType& key) {
+    auto& shard = shardFor(key);
+    Evictions evictions;
+    sizex erased = 0;
+    {
+      LockGuard lock(shard.mutex);
+      erased = shard.cache.erase(key);
+      shard.flights.erase(key);
+      takeEvictions(shard, evictions);
+    }
+    notify(std::move(evictions));
+    return erased;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a cached value if `pred(const T&)`, called with the shard locked, returns
+  /// true. Meant for dropping a value only if it's still the one the caller saw.
+  /// @return The number of values removed
+  template <typename Pred>
+  sizex eraseIf(const KeyType& key, Pred&& pred) {
+    auto& shard = shardFor(key);
+    Evictions evictions;
+    sizex erased = 0;
+    {
+      LockGuard lock(shard.mutex);
+      auto iter = shard.cache.find(key);
+      if (iter != shard.cache.end() && pred(static_cast<const T&>(iter.value()))) {
+        shard.cache.erase(iter);
+        shard.flights.erase(key);
+        erased = 1;
+      }
+      takeEvictions(shard, evictions);
+    }
+    notify(std::move(evictions));
+    return erased;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Purge every shard down to its max-size
+  void purge() {
+    for (auto& shard : shards_) {
+      Evictions evictions;
+      {
+        LockGuard lock(shard.mutex);
+        shard.cache.purge();
+        takeEvictions(shard, evictions);
+      }
+      notify(std::move(evictions));
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Limits how many entries any one operation purges from its shard. See
+  /// `LruCache::setPurgeBudget()`.
+  void setPurgeBudget(sizex budget) {
+    for (auto& shard : shards_) {
+      LockGuard lock(shard.mutex);
+      shard.cache.setPurgeBudget(budget);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Purge at most `budget` entries from each shard, holding each shard's lock only for
+  /// its share. Meant to be called from a background thread after shrinking.
+  /// @return The number of entries purged
+  sizex purgeSome(sizex budget) {
+    sizex purged = 0;
+    for (auto& shard : shards_) {
+      Evictions evictions;
+      {
+        LockGuard lock(shard.mutex);
+        purged += shard.cache.purgeSome(budget);
+        takeEvictions(shard, evictions);
+      }
+      notify(std::move(evictions));
+    }
+    return purged;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Clear the cache completely. Any listener is handed every value.
+  void clear() {
+    for (auto& shard : shards_) {
+      Evictions evictions;
+      {
+        LockGuard lock(shard.mutex);
+        shard.cache.clear();
+        shard.flights.clear();
+        takeEvictions(shard, evictions);
+      }
+      notify(std::move(evictions));
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the sum of every shard's counters. Takes no locks. Needs `kRecordStats`.
+  LruCacheStats snapshot() const noexcept {
+    static_assert(kRecordStats, "Statistics need kRecordStats");
+    LruCacheStats result;
+    for (auto& shard : shards_) {
+      result += shard.cache.snapshot();
+      result += shard.loadStats.snapshot();
+    }
+    return result;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the listener that removed values are handed to
+  Listener& evictionListener() noexcept { return listener_; }
+
+private:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// A load in progress, which callers for the same key wait on
+  struct Flight {
+    void complete(const T& loaded) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        value.reset(new T(loaded));
+        done = true;
+      }
+      cv.notify_all();
+    }
+
+    void fail(std::exception_ptr exception) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = exception;
+        done = true;
+      }
+      cv.notify_all();
+    }
+
+    T wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this]() { return done; });
+      if (error) {
+        std::rethrow_exception(error);
+      }
+      return *value;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::unique_ptr<T> value;
+    std::exception_ptr error;
+  };
+
+  /// Keep each shard on its own cache line(s) so that locking one shard doesn't bounce
+  /// the line holding its neighbour's mutex between cores.
+  struct alignas(64) Shard {
+    mutable Mutex mutex;
+    CacheType cache;
+
+    /// Keys being loaded by getOrCompute()
+    SysHashMap<Key, std::shared_ptr<Flight>, typename ShardTraits::Hash, typename ShardTraits::KeyEqual> flights;
+
+    /// Loads by getOrCompute(), which the shard's cache doesn't see
+    lru_detail::LruStatsRecorder<typename ShardTraits::Stats> loadStats;
+  };
+
+  Shard& shardFor(const KeyType& key) noexcept { return shards_[shardIndex(key)]; }
+  const Shard& shardFor(const KeyType& key) const noexcept { return shards_[shardIndex(key)]; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Run the loader and put its value in the shard, removing the leader's flight. Writes
+  /// to the key remove its flight, so the value is only cached while the flight is still
+  /// the key's. If either throws, the flight is failed and removed, unless it was already.
+  template <typename Loader>
+  T loadAndPublish(Shard& shard, const KeyType& key, const std::shared_ptr<Flight>& flight, Loader& loader,
+                   Evictions& evictions) {
+    const auto loadStart = shard.loadStats.loadStarted();
+    bool loaded = false;
+    try {
+      T value = loader(key);
+      LockGuard lock(shard.mutex);
+      shard.loadStats.loadFinished(loadStart);
+      loaded = true;
+      auto loading = shard.flights.find(key);
+      if (loading != shard.flights.end() && loading->second == flight) {
+        shard.flights.erase(loading);
+        if (!shard.cache.contains(key)) {
+          shard.cache.put(key, value);
+          takeEvictions(shard, evictions);
+        }
+      }
+      return value;
+    } catch (...) {
+      {
+        LockGuard lock(shard.mutex);
+        if (!loaded) {
+          // A failed load still took its time
+          shard.loadStats.loadFinished(loadStart);
+        }
+        auto loading = shard.flights.find(key);
+        if (loading != shard.flights.end() && loading->second == flight) {
+          shard.flights.erase(loading);
+        }
+      }
+      flight->fail(std::current_exception());
+      throw;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Take what the shard's cache removed. Call with the shard locked.
+  void takeEvictions(Shard& shard, Evictions& evictions) {
+    takeEvictions(shard, evictions, std::integral_constant<bool, kHasEvictionListener>{});
+  }
+  void takeEvictions(Shard& shard, Evictions& evictions, std::true_type) {
+    evictions.swap(shard.cache.evictionListener().collected);
+  }
+  void takeEvictions(Shard&, Evictions&, std::false_type) noexcept {}
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Hand removed values to the listener. Call with no shard locked.
+  void notify(Evictions&& evictions) {
+    if (!evictions.empty()) {
+      notify(std::move(evictions), lru_detail::IsBatchEvictionListener<Listener, Key, T>{});
+    }
+  }
+  void notify(Evictions&& evictions, std::true_type) { listener_(std::move(evictions)); }
+  void notify(Evictions&& evictions, std::false_type) {
+    for (auto& eviction : evictions) {
+      listener_(static_cast<const Key&>(eviction.key), std::move(eviction.value), eviction.reason);
+    }
+  }
+
+  std::array<Shard, kShards> shards_;
+  Listener listener_;
+};
+
+template <typename Key, typename T, sizex kShards, typename Mutex, typename Listener, bool kRecordStats>
+constexpr bool ConcurrentLruCache<Key, T, kShards, Mutex, Listener, kRecordStats>::kHasEvictionListener;
+template <typename Key, typename T, sizex kShards, typename Mutex, typename Listener, bool kRecordStats>
+constexpr sizex ConcurrentLruCache<Key, T, kShards, Mutex, Listener, kRecordStats>::kShardCount;
+
+SW_NAMESPACE_END
@@ -0,0 +1,357 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/types.h>
+#include <sw/vector.h>
+
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A fixed capacity LRU-cache for small trivially copyable keys and values, such as
+/// `u64 -> POD`. It has the same eviction behaviour as `LruCache`, but a very different
+/// layout:
+///
+/// * All entries live in one contiguous slab (`sw::Vector`) sized at construction. The
+///   recency list is threaded through the slab with 32-bit slot indices rather than
+///   pointers, and each key is stored exactly once.
+/// * Keys are found through an open-addressed (linear probing) index of slot numbers.
+///   Each index cell also keeps the 32-bit hash of its key, so a probe only touches the
+///   slab when the hashes match. Erasing uses backward-shift deletion, so there are no
+///   tombstones to clean up.
+///
+/// Nothing is allocated after construction. When the cache is full, inserting a new key
+/// recycles the slot of the least recently used entry.
+///
+/// There are no iterators. `find()` returns a pointer to the cached value (or nullptr),
+/// which stays valid until the entry is erased or evicted.
+////////////////////////////////////////////////////////////////////////////////
+template <typename Key, typename T, typename Hash = std::hash<Key>>
+class FlatLruCache {
+  static_assert(std::is_trivially_copyable<Key>::value, "FlatLruCache keys must be trivially copyable");
+  static_assert(std::is_trivially_copyable<T>::value, "FlatLruCache values must be trivially copyable");
+
+  static constexpr u32 kNil = ~0_u32;
+
+  /// An entry in the slab. prev/next link the recency list, the list head being the most
+  /// recently used. Unused slots are chained through `next`.
+  struct Slot {
+    Key key;
+    T value;
+    u32 prev;
+    u32 next;
+  };
+
+  /// A cell in the index. `slot` is kNil when the cell is empty.
+  struct Cell {
+    u32 slot;
+    u32 hash;
+  };
+
+public:
+  using KeyType = Key;
+  using ValueType = T;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache with a fixed maximum size. This is the only allocation the cache
+  /// makes. The index is kept at most half full.
+  explicit FlatLruCache(sizex maxSizeValue = 10) :
+      slots_(std::max(maxSizeValue, 1_z)),
+      cells_(indexSizeFor(std::max(maxSizeValue, 1_z)), Cell{kNil, 0}),
+      mask_(static_cast<u32>(cells_.size() - 1)) {
+    SW_ASSERT(maxSizeValue < kNil / 2);
+    clear();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of items in the cache
+  sizex size() const noexcept { return size_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the fixed maximum number of items in the cache
+  sizex maxSize() const noexcept { return slots_.size(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the cache empty?
+  bool empty() const noexcept { return size_ == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Clear the cache completely. No memory is released.
+  void clear() noexcept {
+    std::fill(cells_.begin(), cells_.end(), Cell{kNil, 0});
+    const auto slotCount = static_cast<u32>(slots_.size());
+    for (u32 i = 0; i < slotCount; ++i) {
+      slots_[i].next = (i + 1 < slotCount) ? i + 1 : kNil;
+    }
+    free_ = 0;
+    head_ = kNil;
+    tail_ = kNil;
+    size_ = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Check if the given key is mapped to a value in the cache. Does *not* change
+  /// cache ordering. Use `refresh()` for that case.
+  bool contains(const KeyType& key) const { return findCell(key, hashOf(key)) != kNil; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Refreshes a cache item if it exists, causing it to move to the front
+  void refresh(const KeyType& key) {
+    const auto cell = findCell(key, hashOf(key));
+    if (cell != kNil) {
+      onValueUsed(cells_[cell].slot);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key. When the cache is
+  /// full, inserting a new key evicts the least recently used entry.
+  void put(const KeyType& key, const T& value) {
+    const auto hash = hashOf(key);
+    const auto cell = findCell(key, hash);
+    if (cell != kNil) {
+      const auto slot = cells_[cell].slot;
+      slots_[slot].value = value;
+      onValueUsed(slot);
+      return;
+    }
+
+    const auto slot = acquireSlot();
+    slots_[slot].key = key;
+    slots_[slot].value = value;
+    linkFront(slot);
+    insertCell(slot, hash);
+    ++size_;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// @value Will be a copy of the value if it exists, otherwise it is unchanged
+  /// @return true if the value was found
+  bool get(const KeyType& key, T& value) {
+    const auto cell = findCell(key, hashOf(key));
+    if (cell == kNil) {
+      return false;
+    }
+
+    const auto slot = cells_[cell].slot;
+    onValueUsed(slot);
+    value = slots_[slot].value;
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the cached value for the given key, refreshing it to the front of the cache.
+  /// @return Pointer to the value, or nullptr if the key isn't cached
+  T* find(const KeyType& key) {
+    const auto cell = findCell(key, hashOf(key));
+    if (cell == kNil) {
+      return nullptr;
+    }
+
+    const auto slot = cells_[cell].slot;
+    onValueUsed(slot);
+    return &slots_[slot].value;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a cached value
+  sizex erase(const KeyType& key) {
+    const auto cell = findCell(key, hashOf(key));
+    if (cell == kNil) {
+      return 0;
+    }
+
+    const auto slot = cells_[cell].slot;
+    eraseCell(cell);
+    unlink(slot);
+    slots_[slot].next = free_;
+    free_ = slot;
+    --size_;
+    return 1;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Calls `func(const Key&, const T&)` for each entry from most to least recently used.
+  /// Primarily for debugging and testing.
+  template <typename Func>
+  void forEachOrdered(Func&& func) const {
+    for (auto slot = head_; slot != kNil; slot = slots_[slot].next) {
+      func(slots_[slot].key, slots_[slot].value);
+    }
+  }
+
+private:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Index size is the power of two that keeps the load factor at or below 0.5
+  static sizex indexSizeFor(sizex maxSizeValue) noexcept {
+    sizex result = 2;
+    while (result < maxSizeValue * 2) {
+      result *= 2;
+    }
+    return result;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// std::hash is commonly the identity for integers, which clusters badly with linear
+  /// probing, so run it through a 64-bit finalizer first
+  static u32 hashOf(const KeyType& key) noexcept {
+    auto hash = static_cast<u64>(Hash{}(key));
+    hash ^= hash >> 33u;
+    hash *= 0xff51afd7ed558ccd_u64;
+    hash ^= hash >> 33u;
+    hash *= 0xc4ceb9fe1a85ec53_u64;
+    hash ^= hash >> 33u;
+    return static_cast<u32>(hash);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// @return The index cell holding the key or kNil
+  u32 findCell(const KeyType& key, u32 hash) const noexcept {
+    for (auto cell = hash & mask_;; cell = (cell + 1) & mask_) {
+      const auto& c = cells_[cell];
+      if (c.slot == kNil) {
+        return kNil;
+      }
+      if (c.hash == hash && slots_[c.slot].key == key) {
+        return cell;
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void insertCell(u32 slot, u32 hash) noexcept {
+    auto cell = hash & mask_;
+    while (cells_[cell].slot != kNil) {
+      cell = (cell + 1) & mask_;
+    }
+    cells_[cell] = Cell{slot, hash};
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Backward-shift deletion. Pull later cells of the probe run back into the hole
+  /// whenever the hole lies between their home cell and where they currently sit.
+  void eraseCell(u32 hole) noexcept {
+    auto cell = hole;
+    while (true) {
+      cell = (cell + 1) & mask_;
+      if (cells_[cell].slot == kNil) {
+        break;
+      }
+      const auto home = cells_[cell].hash & mask_;
+      const bool homeInRange = (hole <= cell) ? (hole < home && home <= cell) : (hole < home || home <= cell);
+      if (!homeInRange) {
+        cells_[hole] = cells_[cell];
+        hole = cell;
+      }
+    }
+    cells_[hole].slot = kNil;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Take a slot from the free list, or recycle the least recently used entry
+  u32 acquireSlot() noexcept {
+    if (free_ != kNil) {
+      const auto slot = free_;
+      free_ = slots_[slot].next;
+      return slot;
+    }
+
+    const auto slot = tail_;
+    SW_ASSERT(slot != kNil);
+    const auto cell = findCell(slots_[slot].key, hashOf(slots_[slot].key));
+    SW_ASSERT(cell != kNil);
+    eraseCell(cell);
+    unlink(slot);
+    --size_;
+    return slot;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void linkFront(u32 slot) noexcept {
+    auto& s = slots_[slot];
+    s.prev = kNil;
+    s.next = head_;
+    if (head_ != kNil) {
+      slots_[head_].prev = slot;
+    } else {
+      tail_ = slot;
+    }
+    head_ = slot;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void unlink(u32 slot) noexcept {
+    auto& s = slots_[slot];
+    if (s.prev != kNil) {
+      slots_[s.prev].next = s.next;
+    } else {
+      head_ = s.next;
+    }
+    if (s.next != kNil) {
+      slots_[s.next].prev = s.prev;
+    } else {
+      tail_ = s.prev;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Call this when a cached value is used, thus pushing it to the front of the list.
+  void onValueUsed(u32 slot) noexcept {
+    if (slot != head_) {
+      unlink(slot);
+      linkFront(slot);
+    }
+  }
+
+private:
+  /// The entries. Sized once to the max size
+  Vector<Slot> slots_;
+
+  /// Open-addressed index into the slots
+  Vector<Cell> cells_;
+
+  /// Index size minus one. The index size is a power of two
+  u32 mask_ = 0;
+
+  /// Head of the free slot chain
+  u32 free_ = kNil;
+
+  /// Most recently used
+  u32 head_ = kNil;
+
+  /// Least recently used
+  u32 tail_ = kNil;
+
+  /// Number of entries in use
+  u32 size_ = 0;
+};
+
+template <typename Key, typename T, typename Hash>
+constexpr u32 FlatLruCache<Key, T, Hash>::kNil;
+
+SW_NAMESPACE_END
@@ -0,0 +1,160 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A count-min sketch of 4-bit counters, estimating how often each hash has been seen
+/// recently. It's the frequency filter used by TinyLFU admission.
+///
+/// Sixteen counters are packed into each u64 word. A hash increments one counter in each
+/// of four rows, and the estimate is the smallest of the four, so collisions can only
+/// over-estimate. Counters saturate at 15, which is plenty to tell hot from cold.
+///
+/// The sketch ages. Once the number of increments reaches the sample size (ten times the
+/// capacity), every counter is halved. Old popularity thus decays and the sketch follows
+/// a changing workload rather than remembering forever.
+///
+/// Hashes should already be well mixed, such as from `FrequencySketch::spread()`.
+////////////////////////////////////////////////////////////////////////////////
+class FrequencySketch {
+public:
+  static constexpr u32 kMaxCount = 15;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the sketch sized for about `capacity` distinct hashes
+  explicit FrequencySketch(sizex capacity = 16) { ensureCapacity(capacity); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Grows the sketch, if needed, for about `capacity` distinct hashes. Growing forgets
+  /// all counts.
+  void ensureCapacity(sizex capacity) {
+    sizex words = 8;
+    while (words < capacity) {
+      words <<= 1u;
+    }
+    if (words <= table_.size()) {
+      return;
+    }
+
+    table_.assign(words, 0);
+    mask_ = words - 1;
+    sampleSize_ = 10 * std::max(capacity, words / 2);
+    additions_ = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Forget all counts
+  void clear() {
+    std::fill(table_.begin(), table_.end(), 0_u64);
+    additions_ = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the estimated count of the hash, up to `kMaxCount`
+  u32 frequency(u64 hash) const noexcept {
+    u32 result = kMaxCount;
+    for (u32 row = 0; row < kRows; ++row) {
+      sizex word = 0;
+      u32 shift = 0;
+      locate(hash, row, word, shift);
+      result = std::min(result, static_cast<u32>(table_[word] >> shift) & kMaxCount);
+    }
+    return result;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Count the hash once more, aging every count when the sample is complete
+  void increment(u64 hash) noexcept {
+    bool added = false;
+    for (u32 row = 0; row < kRows; ++row) {
+      sizex word = 0;
+      u32 shift = 0;
+      locate(hash, row, word, shift);
+      if (((table_[word] >> shift) & kMaxCount) != kMaxCount) {
+        table_[word] += 1_u64 << shift;
+        added = true;
+      }
+    }
+
+    if (added && ++additions_ >= sampleSize_) {
+      age();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Mix a hash such as from std::hash, which is often the identity for integers
+  static u64 spread(u64 hash) noexcept {
+    hash ^= hash >> 33u;
+    hash *= 0xff51afd7ed558ccd_u64;
+    hash ^= hash >> 33u;
+    hash *= 0xc4ceb9fe1a85ec53_u64;
+    hash ^= hash >> 33u;
+    return hash;
+  }
+
+private:
+  static constexpr u32 kRows = 4;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the word and bit offset of the hash's counter in the given row
+  void locate(u64 hash, u32 row, sizex& word, u32& shift) const noexcept {
+    static constexpr u64 kSeeds[kRows] = {0xc3a5c85c97cb3127_u64, 0xb492b66fbe98f273_u64, 0x9ae16a3b2f90404f_u64,
+                                          0xcbf29ce484222325_u64};
+    auto h = (hash + kSeeds[row]) * kSeeds[row];
+    h += h >> 32u;
+    word = static_cast<sizex>(h) & mask_;
+    shift = static_cast<u32>(h >> 60u) << 2u;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Halve every counter
+  void age() noexcept {
+    for (auto& word : table_) {
+      word = (word >> 1u) & 0x7777777777777777_u64;
+    }
+    additions_ /= 2;
+  }
+
+private:
+  /// Sixteen 4-bit counters per word
+  std::vector<u64> table_;
+
+  /// Word count minus one, the word count being a power of two
+  sizex mask_ = 0;
+
+  /// Increments before every counter is halved
+  sizex sampleSize_ = 0;
+
+  /// Increments since the counters were last halved
+  sizex additions_ = 0;
+};
+
+SW_NAMESPACE_END
@@ -25,7 +25,9 @@
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <functional>
 #include <iomanip>
@@ -33,6 +35,8 @@
 #include <mutex>
 #include <queue>
 #include <sstream>
+#include <thread>
+#include <utility>
 
 SW_NAMESPACE_BEGIN
 
@@ -92,9 +96,28 @@ SW_DEFINE_ENUM_BITFIELD_OPERATORS(LoggerCategory);
 /// This is the "backend" for the logger. Implement to do as needed.
 ///
 /// The virtual approach seems old school, but will outperform using std::function.
+///
+/// A handler publishes the categories it might log with `setEnabledCategories()`, so
+/// the logger can drop the others before formatting them. It's only a pre-filter: the
+/// handler still gets forced messages, and should still check its own masks.
 struct LogHandler {
   virtual ~LogHandler() = default;
   virtual void onLog(SystemTimepoint logTime, LoggerCategory cat, const StringWrapper& msg, bool force) = 0;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The categories published by the handler, which the logger checks before formatting
+  const std::atomic<uint8>& enabledCategories() const noexcept { return _enabledCategories; }
+
+protected:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Publish the categories the handler might log. May be called while logging.
+  void setEnabledCategories(LoggerCategory mask) noexcept {
+    _enabledCategories.store(asPod(mask), std::memory_order_relaxed);
+  }
+
+private:
+  /// Everything by default, so handlers that don't publish a mask see every message
+  std::atomic<uint8> _enabledCategories{asPod(LoggerCategory::All)};
 };
 using LogHandlerRef = std::shared_ptr<LogHandler>;
 
@@ -146,7 +169,8 @@ public:
   LoggerType() = default;
 
   ////////////////////////////////////////////////////////////////////////////////
-  LoggerType(const LogHandlerRef& handler) noexcept : _logHandler(handler) {}
+  LoggerType(const LogHandlerRef& handler) noexcept :
+      _logHandler(handler), _enabledCategories(handler ? &handler->enabledCategories() : &noCategories()) {}
 
   ////////////////////////////////////////////////////////////////////////////////
   ~LoggerType() = default;
@@ -154,13 +178,32 @@ public:
   // No move/copy
   LoggerType(LoggerType const&) = delete;
   LoggerType& operator=(LoggerType const&) = delete;
-  LoggerType(LoggerType&&) = default;
-  LoggerType& operator=(LoggerType&&) = default;
+  // A moved-from logger has no handler, so it mustn't keep pointing into one
+  LoggerType(LoggerType&& that) noexcept :
+      _startTime(that._startTime),
+      _logHandler(std::move(that._logHandler)),
+      _enabledCategories(std::exchange(that._enabledCategories, &noCategories())) {}
+
+  LoggerType& operator=(LoggerType&& that) noexcept {
+    if (this != &that) {
+      _startTime = that._startTime;
+      _logHandler = std::move(that._logHandler);
+      _enabledCategories = std::exchange(that._enabledCategories, &noCategories());
+    }
+    return *this;
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
   /// Get the starting timepoint
   SystemTimepoint getStartTimepoint() const { return _startTime; }
 
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Could a message of the category be logged? Checks the handler's published mask,
+  /// which costs one relaxed load.
+  bool isEnabled(Category category) const noexcept {
+    return (Category(_enabledCategories->load(std::memory_order_relaxed)) & category) == category;
+  }
+
   ////////////////////////////////////////////////////////////////////////////////
   /// Log a message at the specified category
   void log(SystemTimepoint logTime, Category category, StringWrapper const& msg, bool force = false) {
@@ -177,15 +220,22 @@ public:
   /// Force a log entry using {fmt} style formatted message at the specified category
   /// This overrides any category mask disables.
   template <typename... Ts>
-  void logForcef(Category cat, StringWrapper const& format, Ts... ts) {
+  void logForcef(Category cat, StringWrapper const& format, Ts&&... ts) {
+    if (!canLogCategory(cat, Category(_enabledCategories->load(std::memory_order_relaxed)), true)) {
+      return;
+    }
     std::string logString = fmt::format(format.c_str(), std::forward<Ts>(ts)...);
     log(cat, logString, true);
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Log an {fmt} style formatted message at the specified category
+  /// Log an {fmt} style formatted message at the specified category. Nothing is
+  /// formatted if the handler hasn't enabled the category.
   template <typename... Ts>
-  void logf(Category cat, StringWrapper const& format, Ts... ts) {
+  void logf(Category cat, StringWrapper const& format, Ts&&... ts) {
+    if (!isEnabled(cat)) {
+      return;
+    }
     std::string logString = fmt::format(format.c_str(), std::forward<Ts>(ts)...);
     log(cat, logString);
   }
@@ -197,7 +247,7 @@ public:
   ////////////////////////////////////////////////////////////////////////////////
   /// Log an sprintf style formatted message with the Trace category
   template <typename... Ts>
-  void verbosef(StringWrapper const& format, Ts... ts) {
+  void verbosef(StringWrapper const& format, Ts&&... ts) {
     logf(Category::Verbose, format, std::forward<Ts>(ts)...);
   }
 
@@ -208,7 +258,7 @@ public:
   ////////////////////////////////////////////////////////////////////////////////
   /// Log an sprintf style formatted message with the Debug category
   template <typename... Ts>
-  void debugf(StringWrapper const& format, Ts... ts) {
+  void debugf(StringWrapper const& format, Ts&&... ts) {
     logf(Category::Debug, format, std::forward<Ts>(ts)...);
   }
 
@@ -219,7 +269,7 @@ public:
   ////////////////////////////////////////////////////////////////////////////////
   /// Log an sprintf style formatted message with the Info category
   template <typename... Ts>
-  void infof(StringWrapper const& format, Ts... ts) {
+  void infof(StringWrapper const& format, Ts&&... ts) {
     logf(Category::Info, format, std::forward<Ts>(ts)...);
   }
 
@@ -234,7 +284,7 @@ public:
   ////////////////////////////////////////////////////////////////////////////////
   /// Log an sprintf style formatted message with the WARN category
   template <typename... Ts>
-  void warnf(StringWrapper const& format, Ts... ts) {
+  void warnf(StringWrapper const& format, Ts&&... ts) {
     logf(Category::Warn, format, std::forward<Ts>(ts)...);
   }
 
@@ -249,7 +299,7 @@ public:
   ////////////////////////////////////////////////////////////////////////////////
   /// Log an sprintf style formatted message with the Error category
   template <typename... Ts>
-  void errorf(StringWrapper const& format, Ts... ts) {
+  void errorf(StringWrapper const& format, Ts&&... ts) {
     logf(Category::Error, format, std::forward<Ts>(ts)...);
   }
 
@@ -263,6 +313,14 @@ private:
   SystemTimepoint _startTime;
 
   LogHandlerRef _logHandler;
+
+  /// The handler's published categories, or none without a handler
+  const std::atomic<uint8>* _enabledCategories = &noCategories();
+
+  static const std::atomic<uint8>& noCategories() noexcept {
+    static const std::atomic<uint8> none{asPod(Category::None)};
+    return none;
+  }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -284,6 +342,8 @@ struct NullLogHandler : public LogHandler {
 struct SimpleConsoleLogHandler : public LogHandler {
   using Category = Logger::Category;
 
+  SimpleConsoleLogHandler() { setEnabledCategories(_categoryMask); }
+
   ////////////////////////////////////////////////////////////////////////////////
   void onLog(SystemTimepoint logTime, Logger::Category cat, const StringWrapper& msg, bool force) {
     // Ignore item if category if it's disabled
@@ -326,7 +386,13 @@ struct ConsoleFileLogHandler : public LogHandler {
     ConsoleDestination console_destination = ConsoleDestination::Stdout;
   };
 
-  ConsoleFileLogHandler(Config config) : _config(config) {}
+  ConsoleFileLogHandler(Config config) : _config(config) {
+    auto enabled = _config.logFile.empty() ? Category::None : _config.fileCategoryMask;
+    if (_config.console_destination != ConsoleDestination::None) {
+      enabled |= _config.consoleCategoryMask;
+    }
+    setEnabledCategories(enabled);
+  }
 
   void onLog(SystemTimepoint logTime, Logger::Category cat, const StringWrapper& msg, bool force) override;
 
@@ -374,9 +440,12 @@ struct AsyncLogHandler : public LogHandler {
   }
 
   ////////////////////////////////////////////////////////////////////////////////
+  /// Publishes the target's categories as they are now
   AsyncLogHandler(LogHandlerRef forwardLogger) :
       _targetLogger(std::move(forwardLogger)),
-      _thread([this]() { this->threadExec(); }) {}
+      _thread([this]() { this->threadExec(); }) {
+    setEnabledCategories(LoggerCategory(_targetLogger->enabledCategories().load(std::memory_order_relaxed)));
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
   void onLog(SystemTimepoint logTime, Logger::Category cat, const StringWrapper& msg, bool force) {
@@ -20,6 +20,12 @@
 
 #include <sw/assert.h>
 #include <sw/fixed_width_int_literals.h>
+#include <sw/frequency_sketch.h>
+#include <sw/miss_ratio_curve.h>
+#include <sw/node_pool.h>
+#include <sw/snapshot_io.h>
+#include <sw/strings.h>
+#include <sw/timing_wheel.h>
 #include <sw/types.h>
 
 #if SW_USE_ROBIN_HASH_MAP
@@ -30,9 +36,17 @@
 #endif
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iterator>
 #include <list>
 #include <memory>
+#include <string>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 SW_NAMESPACE_BEGIN
 
@@ -50,11 +64,1424 @@ template <class Key, class T, class Hash = std::hash<Key>, class KeyEqual = std:
 using SysHashMap = std::unordered_map<Key, T, Hash, KeyEqual, Allocator>;
 #endif
 
+////////////////////////////////////////////////////////////////////////////////
+/// Default weigher. Every entry weighs one, so the total weight is the entry count.
+struct UnitWeigher {
+  template <typename Key, typename T>
+  constexpr sizex operator()(const Key&, const T&) const noexcept {
+    return 1;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Why an entry left the cache
+enum class LruEvictionReason : u8 {
+  Size,     ///< Purged to meet the size or weight limit
+  Erase,    ///< Removed by `erase()` or `clear()`
+  Replace,  ///< The value was overwritten by a `put()`
+  Expired   ///< The entry's time-to-live ran out
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// An entry that left the cache, as handed to a batched eviction listener
+template <typename Key, typename T>
+struct LruEviction {
+  Key key;
+  T value;
+  LruEvictionReason reason;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Batched eviction listener that gathers the evictions into `collected`. A cache wrapping
+/// another uses it to handle the inner cache's evictions once its operation is over.
+template <typename Key, typename T>
+struct LruEvictionCollector {
+  using Evictions = std::vector<LruEviction<Key, T>>;
+
+  void operator()(Evictions&& evictions) {
+    if (collected.empty()) {
+      collected = std::move(evictions);
+    } else {
+      std::move(evictions.begin(), evictions.end(), std::back_inserter(collected));
+    }
+  }
+
+  Evictions collected;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Default eviction listener, which ignores everything
+struct NullEvictionListener {
+  template <typename Key, typename T>
+  void operator()(const Key&, T&&, LruEvictionReason) const noexcept {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Default admission, every new entry is admitted and the least recently used is purged
+struct NoAdmission {};
+
+////////////////////////////////////////////////////////////////////////////////
+/// W-TinyLFU admission. New entries go to a small LRU window. An entry pushed out of
+/// the window only replaces the main region's LRU victim if it has been seen more often
+/// recently, as estimated by a `FrequencySketch`. One-shot scans are thus stuck churning
+/// through the window, rather than flushing out the frequently used entries.
+struct TinyLfuAdmission {
+  /// Percentage of the maximum size given to the window (at least one entry)
+  static constexpr sizex kWindowPercent = 1;
+};
+
+namespace lru_detail {
+
+template <typename... Ts>
+struct LruMakeVoid {
+  using type = void;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Can `K` look up keys without being converted to `Key`? It needs the hash and equality
+/// to be transparent and to take it.
+template <typename Key, typename Hash, typename Equal, typename K, typename = void>
+struct LruIsLookupKey : std::false_type {};
+
+template <typename Key, typename Hash, typename Equal, typename K>
+struct LruIsLookupKey<
+    Key, Hash, Equal, K,
+    typename LruMakeVoid<typename Hash::is_transparent, typename Equal::is_transparent,
+                         decltype(std::declval<const Hash&>()(std::declval<const K&>())),
+                         decltype(std::declval<const Equal&>()(std::declval<const K&>(), std::declval<const Key&>()))>::type>
+    : std::integral_constant<bool, !std::is_same<typename std::decay<K>::type, Key>::value> {};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Tell an allocator with `reserveNodes(sizex)`, such as `NodePoolAllocator`, how many
+/// nodes to expect. Other allocators are left alone.
+template <typename Allocator>
+auto reserveNodes(Allocator& allocator, sizex nodes, int) -> decltype(allocator.reserveNodes(nodes)) {
+  allocator.reserveNodes(nodes);
+}
+
+template <typename Allocator>
+void reserveNodes(Allocator&, sizex, long) {}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hint that the memory at the address will soon be read
+inline void prefetch(const void* addr) noexcept {
+#if SW_GCC_CXX || SW_CLANG_CXX
+  __builtin_prefetch(addr);
+#else
+  (void)addr;
+#endif
+}
+
+struct LruNoPolicyData;
+struct LruSegmentData;
+struct LruFrequencyData;
+template <typename Policy, typename Key, typename ListType>
+class LruRecencyPolicy;
+template <typename Policy, typename Key, typename ListType>
+class LruSegmentedPolicy;
+template <typename Policy, typename Key, typename ListType>
+class LruTwoQueuePolicy;
+template <typename Policy, typename Key, typename ListType>
+class LruAdaptivePolicy;
+template <typename Policy, typename Key, typename ListType>
+class LruFrequencyPolicy;
+
+}  // namespace lru_detail
+
+////////////////////////////////////////////////////////////////////////////////
+/// Eviction policies. Each names the per-entry data it needs and its implementation,
+/// which keeps the cache's list in its own order. To tune one, derive from it and
+/// override its constants. ie.
+///    struct MySlru : SlruPolicy {
+///      static constexpr sizex kProtectedPercent = 50;
+///    };
+
+////////////////////////////////////////////////////////////////////////////////
+/// Least recently used, the default. A hit moves the entry to the front, and the back
+/// is purged.
+struct LruPolicy {
+  using EntryData = lru_detail::LruNoPolicyData;
+  template <typename Policy, typename Key, typename ListType>
+  using Impl = lru_detail::LruRecencyPolicy<Policy, Key, ListType>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Segmented LRU. New entries go to the front of the probationary segment, and a hit
+/// promotes an entry to the front of the protected segment. Entries pushed out of the
+/// protected segment drop back to probation. Entries used only once are purged before
+/// any that were used twice.
+struct SlruPolicy {
+  /// Percentage of the maximum size that's protected
+  static constexpr sizex kProtectedPercent = 80;
+
+  using EntryData = lru_detail::LruSegmentData;
+  template <typename Policy, typename Key, typename ListType>
+  using Impl = lru_detail::LruSegmentedPolicy<Policy, Key, ListType>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// 2Q (the full version). New entries go into a FIFO, A1in. Once it's larger than its
+/// share, its oldest entries are purged and their keys remembered in a ghost list,
+/// A1out. Only a key coming back while in A1out is put in the main LRU, Am.
+struct TwoQPolicy {
+  /// Percentage of the maximum size for A1in (Kin)
+  static constexpr sizex kInPercent = 25;
+
+  /// Number of A1out ghost keys as a percentage of the maximum size (Kout)
+  static constexpr sizex kOutPercent = 50;
+
+  using EntryData = lru_detail::LruSegmentData;
+  template <typename Policy, typename Key, typename ListType>
+  using Impl = lru_detail::LruTwoQueuePolicy<Policy, Key, ListType>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Adaptive Replacement Cache. Balances a recency list, T1, against a frequency list,
+/// T2, using ghost lists of recently purged keys to learn which of the two to favour.
+struct ArcPolicy {
+  using EntryData = lru_detail::LruSegmentData;
+  template <typename Policy, typename Key, typename ListType>
+  using Impl = lru_detail::LruAdaptivePolicy<Policy, Key, ListType>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Least frequently used, in O(1) using frequency buckets. The least often used entry is
+/// purged, the least recently used of those on a tie.
+struct LfuPolicy {
+  using EntryData = lru_detail::LruFrequencyData;
+  template <typename Policy, typename Key, typename ListType>
+  using Impl = lru_detail::LruFrequencyPolicy<Policy, Key, ListType>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Counters of what a cache has done, as returned by `snapshot()`
+struct LruCacheStats {
+  /// Lookups by `get()`, `find()`, `cfind()`, `operator[]` and `getOrCompute()`
+  u64 hits = 0;
+  u64 misses = 0;
+
+  /// Puts of new keys and of existing keys
+  u64 inserts = 0;
+  u64 updates = 0;
+
+  /// Values removed, indexed by `LruEvictionReason`
+  std::array<u64, 4> evictions = {{0, 0, 0, 0}};
+
+  /// Calls of `getOrCompute()` loaders, including those that threw, and their total time
+  u64 loads = 0;
+  u64 loadNanos = 0;
+
+  u64 evicted(LruEvictionReason reason) const noexcept { return evictions[static_cast<sizex>(reason)]; }
+
+  double hitRatio() const noexcept {
+    const auto lookups = hits + misses;
+    return (lookups == 0) ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+  }
+
+  LruCacheStats& operator+=(const LruCacheStats& that) noexcept {
+    hits += that.hits;
+    misses += that.misses;
+    inserts += that.inserts;
+    updates += that.updates;
+    for (sizex i = 0; i < evictions.size(); ++i) {
+      evictions[i] += that.evictions[i];
+    }
+    loads += that.loads;
+    loadNanos += that.loadNanos;
+    return *this;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Statistics options. With `NoStats` nothing is counted and the cache is unchanged.
+/// `LocalStats` are plain counters. `SharedStats` are relaxed atomics, so a snapshot can
+/// be taken by a thread other than the one updating the cache (which must still be one
+/// at a time, such as under a lock).
+struct NoStats {};
+struct LocalStats {};
+struct SharedStats {};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Miss ratio curve options. `NoMissRatio` tracks nothing. `ShardsMissRatio` feeds every
+/// lookup to a `MissRatioEstimator`, for sizes up to `kSizeFactor` times the
+/// cache's maximum size at construction. Derive from it to change the settings.
+struct NoMissRatio {};
+
+struct ShardsMissRatio {
+  static constexpr double kSamplingRate = 0.01;
+  static constexpr sizex kMaxSamples = 16384;
+  static constexpr sizex kSizeFactor = 4;
+  static constexpr sizex kBuckets = 64;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Default key index, which indexes nothing. A `KeyIndex` is told of every key as it's
+/// added to and removed from the cache, and maps a query to the keys `invalidate()`
+/// erases, such as `PathPrefixIndex` for everything under a directory:
+///    template <typename Key> void insert(const Key&);
+///    template <typename Key> void erase(const Key&);
+///    void clear();
+///    template <typename Key> void collect(const Query&, std::vector<Key>& keys) const;
+struct NoKeyIndex {
+  template <typename Key>
+  void insert(const Key&) noexcept {}
+  template <typename Key>
+  void erase(const Key&) noexcept {}
+  void clear() noexcept {}
+};
+
+namespace lru_detail {
+
+////////////////////////////////////////////////////////////////////////////////
+/// A counter with a single writer at a time. The atomic version needs no read-modify-
+/// write, as writers are already serialized, it's only atomic so readers don't race.
+template <bool kAtomic>
+class LruStatCounter {
+public:
+  void add(u64 count) noexcept { value_ += count; }
+  u64 load() const noexcept { return value_; }
+
+private:
+  u64 value_ = 0;
+};
+
+template <>
+class LruStatCounter<true> {
+public:
+  LruStatCounter() = default;
+  LruStatCounter(const LruStatCounter& that) noexcept : value_(that.load()) {}
+  LruStatCounter& operator=(const LruStatCounter& that) noexcept {
+    value_.store(that.load(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  void add(u64 count) noexcept { value_.store(load() + count, std::memory_order_relaxed); }
+  u64 load() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<u64> value_{0};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Records the statistics. Everything is a no-op with `NoStats`.
+template <typename Stats>
+class LruStatsRecorder {
+public:
+  struct LoadStart {};
+
+  void hit() noexcept {}
+  void miss() noexcept {}
+  void insert() noexcept {}
+  void update() noexcept {}
+  void evict(LruEvictionReason, sizex = 1) noexcept {}
+  LoadStart loadStarted() const noexcept { return {}; }
+  void loadFinished(LoadStart) noexcept {}
+};
+
+template <bool kAtomic>
+class LruStatsCounters {
+public:
+  using LoadStart = std::chrono::steady_clock::time_point;
+
+  void hit() noexcept { hits_.add(1); }
+  void miss() noexcept { misses_.add(1); }
+  void insert() noexcept { inserts_.add(1); }
+  void update() noexcept { updates_.add(1); }
+  void evict(LruEvictionReason reason, sizex count = 1) noexcept {
+    evictions_[static_cast<sizex>(reason)].add(count);
+  }
+
+  LoadStart loadStarted() const noexcept { return std::chrono::steady_clock::now(); }
+  void loadFinished(LoadStart started) noexcept {
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+    loads_.add(1);
+    loadNanos_.add(static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+  }
+
+  LruCacheStats snapshot() const noexcept {
+    LruCacheStats result;
+    result.hits = hits_.load();
+    result.misses = misses_.load();
+    result.inserts = inserts_.load();
+    result.updates = updates_.load();
+    for (sizex i = 0; i < evictions_.size(); ++i) {
+      result.evictions[i] = evictions_[i].load();
+    }
+    result.loads = loads_.load();
+    result.loadNanos = loadNanos_.load();
+    return result;
+  }
+
+  void reset() noexcept { *this = LruStatsCounters(); }
+
+private:
+  LruStatCounter<kAtomic> hits_;
+  LruStatCounter<kAtomic> misses_;
+  LruStatCounter<kAtomic> inserts_;
+  LruStatCounter<kAtomic> updates_;
+  std::array<LruStatCounter<kAtomic>, 4> evictions_;
+  LruStatCounter<kAtomic> loads_;
+  LruStatCounter<kAtomic> loadNanos_;
+};
+
+template <>
+class LruStatsRecorder<LocalStats> : public LruStatsCounters<false> {};
+
+template <>
+class LruStatsRecorder<SharedStats> : public LruStatsCounters<true> {};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Holds the miss ratio estimator. Empty when there's no `Traits::MissRatio`.
+template <typename MissRatio, bool kEnabled = !std::is_same<MissRatio, NoMissRatio>::value>
+struct LruMissRatioTracker {
+  explicit LruMissRatioTracker(sizex) noexcept {}
+};
+
+template <typename MissRatio>
+struct LruMissRatioTracker<MissRatio, true> {
+  explicit LruMissRatioTracker(sizex maxSize) :
+      estimator(maxSize * MissRatio::kSizeFactor, MissRatio::kBuckets, MissRatio::kSamplingRate,
+                MissRatio::kMaxSamples) {}
+
+  MissRatioEstimator estimator;
+};
+
+}  // namespace lru_detail
+
+////////////////////////////////////////////////////////////////////////////////
+/// Compile-time options for an `LruCache`. To customize, derive from this and override
+/// only the members you need. ie.
+///    struct ByteTraits : LruCacheTraits<int, std::string> {
+///      using Weigher = StringSizeWeigher;
+///    };
+///    LruCache<int, std::string, true, ByteTraits> cache;
+template <typename Key, typename T>
+struct LruCacheTraits {
+  /// Stateless functor returning the weight of an entry: `sizex operator()(const Key&, const T&)`
+  using Weigher = UnitWeigher;
+
+  /// Clock used to expire entries, such as `std::chrono::steady_clock`. The default of
+  /// `void` disables expiry, and entries then store nothing extra.
+  using ExpiryClock = void;
+
+  /// Called with each value that leaves the cache. Either per value,
+  ///    void operator()(const Key&, T&& value, LruEvictionReason)
+  /// or batched, once per cache operation that removed anything,
+  ///    void operator()(std::vector<LruEviction<Key, T>>&& evictions)
+  using EvictionListener = NullEvictionListener;
+
+  /// How new entries earn their place. `NoAdmission` or `TinyLfuAdmission`.
+  using Admission = NoAdmission;
+
+  /// Which entry is purged. `LruPolicy`, `SlruPolicy`, `TwoQPolicy`, `ArcPolicy` or
+  /// `LfuPolicy`.
+  using Policy = LruPolicy;
+
+  /// Hash and equality of keys. When both are transparent, keys can be looked up by
+  /// other types, such as `std::string` and `PosixPath` keys by a `StringView`.
+  using Hash = typename KeyHashing<Key>::Hash;
+  using KeyEqual = typename KeyHashing<Key>::Equal;
+
+  /// What's counted for `snapshot()`. `NoStats`, `LocalStats` or `SharedStats`.
+  using Stats = NoStats;
+
+  /// Estimation of `missRatioCurve()`. `NoMissRatio` or `ShardsMissRatio`.
+  using MissRatio = NoMissRatio;
+
+  /// Secondary index of the keys for `invalidate()`. `NoKeyIndex` or `PathPrefixIndex`.
+  using KeyIndex = NoKeyIndex;
+
+  /// Allocates the list and map nodes, rebound from `T`. `NodePoolAllocator<T>` recycles
+  /// nodes, so a full cache replaces entries without touching the global allocator.
+  using Allocator = std::allocator<T>;
+
+  /// Write and read keys and values for `saveSnapshot()` and `loadSnapshot()`. See
+  /// `SnapshotSerializer`.
+  using KeySerializer = SnapshotSerializer<Key>;
+  using ValueSerializer = SnapshotSerializer<T>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// When does an entry's time-to-live start counting?
+enum class LruExpiryMode : u8 {
+  AfterWrite,  ///< From when the entry was last put
+  AfterAccess  ///< From when the entry was last put or used
+};
+
 namespace lru_detail {
 
 template <typename Cache, typename MemberIter, typename NonConstMemberIter, typename ConstMemberIter>
 class LruIterator;
 
+////////////////////////////////////////////////////////////////////////////////
+/// Holds the weight of an entry. Unit weights are never stored.
+template <typename Weigher>
+struct LruWeight {
+  sizex weight() const noexcept { return weight_; }
+  void setWeight(sizex w) noexcept { weight_ = w; }
+  sizex weight_ = 0;
+};
+
+template <>
+struct LruWeight<UnitWeigher> {
+  constexpr sizex weight() const noexcept { return 1; }
+  void setWeight(sizex) noexcept {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Holds the expiry state of an entry
+template <typename Clock>
+struct LruExpiry {
+  using TimePoint = typename Clock::time_point;
+  using Duration = typename Clock::duration;
+  static constexpr u64 kNotScheduled = ~0_u64;
+
+  /// When the entry expires, or max() for never
+  TimePoint expiresAt = TimePoint::max();
+
+  /// The entry's time-to-live, zero for forever
+  Duration ttl = Duration::zero();
+
+  /// Tick of the entry's live timing wheel item. Wheel items for other ticks are stale.
+  u64 scheduledTick = kNotScheduled;
+};
+
+template <typename Clock>
+constexpr u64 LruExpiry<Clock>::kNotScheduled;
+
+template <>
+struct LruExpiry<void> {};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Expires entries using a timing wheel with millisecond ticks.
+///
+/// Each entry has at most one live item on the wheel, and pushing an entry's deadline
+/// back doesn't touch the wheel. When the item fires, the entry is either expired or
+/// rescheduled for its new deadline. Items left behind by erased entries, or by entries
+/// rescheduled sooner, are simply dropped as they fire.
+template <typename Key, typename Clock>
+class LruExpirer {
+  using Tick = std::chrono::milliseconds;
+
+public:
+  using TimePoint = typename Clock::time_point;
+  using Duration = typename Clock::duration;
+  using Expiry = LruExpiry<Clock>;
+
+  LruExpirer() : epoch_(Clock::now()) {}
+
+  // Copies the settings only, the wheel refers to the other cache's entries
+  LruExpirer(const LruExpirer& that) : epoch_(Clock::now()), mode_(that.mode_), defaultTtl_(that.defaultTtl_) {}
+
+  // Copies the settings only, the wheel refers to the other cache's entries
+  LruExpirer& operator=(const LruExpirer& that) {
+    if (this != &that) {
+      wheel_.clear();
+      mode_ = that.mode_;
+      defaultTtl_ = that.defaultTtl_;
+    }
+    return *this;
+  }
+
+  // A moved from wheel has no slots, so leave the other with a fresh one
+  LruExpirer(LruExpirer&& that) :
+      wheel_(std::exchange(that.wheel_, TimingWheel<Key>())),
+      epoch_(that.epoch_),
+      mode_(that.mode_),
+      defaultTtl_(that.defaultTtl_) {
+    that.epoch_ = Clock::now();
+  }
+
+  LruExpirer& operator=(LruExpirer&& that) {
+    if (this != &that) {
+      wheel_ = std::exchange(that.wheel_, TimingWheel<Key>());
+      epoch_ = std::exchange(that.epoch_, Clock::now());
+      mode_ = that.mode_;
+      defaultTtl_ = that.defaultTtl_;
+    }
+    return *this;
+  }
+
+  LruExpiryMode mode() const noexcept { return mode_; }
+  void setMode(LruExpiryMode mode) noexcept { mode_ = mode; }
+  Duration defaultTtl() const noexcept { return defaultTtl_; }
+  void setDefaultTtl(Duration ttl) noexcept { defaultTtl_ = ttl; }
+  TimePoint now() const { return Clock::now(); }
+  void clear() { wheel_.clear(); }
+
+  bool isExpired(const Expiry& expiry, TimePoint now) const noexcept { return expiry.expiresAt <= now; }
+  bool isLive(const Expiry& expiry, u64 tick) const noexcept { return expiry.scheduledTick == tick; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Starts an entry's time-to-live after a put. A zero ttl never expires.
+  void onWrite(const Key& key, Expiry& expiry, Duration ttl, TimePoint now) {
+    expiry.ttl = ttl;
+    expiry.expiresAt = (ttl == Duration::zero()) ? TimePoint::max() : now + ttl;
+    schedule(key, expiry);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Restarts an entry's time-to-live after a hit, when expiring after access
+  void onAccess(Expiry& expiry, TimePoint now) noexcept {
+    if (mode_ == LruExpiryMode::AfterAccess && expiry.ttl != Duration::zero()) {
+      expiry.expiresAt = now + expiry.ttl;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Gives an entry copied from another cache the same deadline
+  void onCopy(const Key& key, Expiry& expiry, const Expiry& from) {
+    expiry.expiresAt = from.expiresAt;
+    expiry.ttl = from.ttl;
+    schedule(key, expiry);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Schedules a wheel item for a live entry whose item fired before its deadline
+  void reschedule(const Key& key, Expiry& expiry) {
+    expiry.scheduledTick = Expiry::kNotScheduled;
+    schedule(key, expiry);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Fires the due wheel items, doing at most `budget` units of work. Calls
+  /// `func(const Key&, u64 tick)` for each, which should check `isLive()`.
+  template <typename Func>
+  void advance(TimePoint now, sizex budget, Func&& func) {
+    wheel_.advance(toTick(now, false), budget, std::forward<Func>(func));
+  }
+
+private:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Ticks since the epoch. Deadlines round up so an item never fires early.
+  u64 toTick(TimePoint time, bool roundUp) const noexcept {
+    const auto elapsed = time - epoch_;
+    if (elapsed <= Duration::zero()) {
+      return 0;
+    }
+
+    auto ticks = std::chrono::duration_cast<Tick>(elapsed);
+    if (roundUp && ticks < elapsed) {
+      ++ticks;
+    }
+    return static_cast<u64>(ticks.count());
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// An entry already scheduled at or before its deadline is left alone
+  void schedule(const Key& key, Expiry& expiry) {
+    if (expiry.expiresAt == TimePoint::max()) {
+      return;
+    }
+
+    const auto tick = toTick(expiry.expiresAt, true);
+    if (expiry.scheduledTick != Expiry::kNotScheduled && expiry.scheduledTick <= tick) {
+      return;
+    }
+    expiry.scheduledTick = tick;
+    wheel_.schedule(key, tick);
+  }
+
+private:
+  TimingWheel<Key> wheel_;
+  TimePoint epoch_;
+  LruExpiryMode mode_ = LruExpiryMode::AfterWrite;
+  Duration defaultTtl_ = Duration::zero();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Expiry disabled, everything is a no-op
+template <typename Key>
+class LruExpirer<Key, void> {
+public:
+  struct TimePoint {};
+  struct Duration {};
+  using Expiry = LruExpiry<void>;
+
+  LruExpiryMode mode() const noexcept { return LruExpiryMode::AfterWrite; }
+  void setMode(LruExpiryMode) noexcept {}
+  Duration defaultTtl() const noexcept { return {}; }
+  void setDefaultTtl(Duration) noexcept {}
+  TimePoint now() const noexcept { return {}; }
+  void clear() noexcept {}
+
+  constexpr bool isExpired(const Expiry&, TimePoint) const noexcept { return false; }
+  constexpr bool isLive(const Expiry&, u64) const noexcept { return false; }
+  void onWrite(const Key&, Expiry&, Duration, TimePoint) noexcept {}
+  void onAccess(Expiry&, TimePoint) noexcept {}
+  void onCopy(const Key&, Expiry&, const Expiry&) noexcept {}
+  void reschedule(const Key&, Expiry&) noexcept {}
+
+  template <typename Func>
+  void advance(TimePoint, sizex, Func&&) noexcept {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Is the listener the batched kind, taking a vector of evictions?
+template <typename Listener, typename Key, typename T, typename = void>
+struct IsBatchEvictionListener : std::false_type {};
+
+template <typename Listener, typename Key, typename T>
+struct IsBatchEvictionListener<
+    Listener, Key, T,
+    decltype(void(std::declval<Listener&>()(std::declval<std::vector<LruEviction<Key, T>>&&>())))>
+    : std::true_type {};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hands evicted values to a per value listener as they're removed
+template <typename Key, typename T, typename Listener,
+          bool kBatch = IsBatchEvictionListener<Listener, Key, T>::value>
+class LruEvictionSink {
+public:
+  LruEvictionSink() = default;
+  explicit LruEvictionSink(Listener listener) : listener_(std::move(listener)) {}
+
+  Listener& listener() noexcept { return listener_; }
+  const Listener& listener() const noexcept { return listener_; }
+
+  template <typename K>
+  void notify(K&& key, T&& value, LruEvictionReason reason) {
+    listener_(static_cast<const Key&>(key), std::move(value), reason);
+  }
+
+  void flush() noexcept {}
+
+private:
+  Listener listener_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Collects evicted values, handing them to a batched listener on `flush()`
+template <typename Key, typename T, typename Listener>
+class LruEvictionSink<Key, T, Listener, true> {
+public:
+  LruEvictionSink() = default;
+  explicit LruEvictionSink(Listener listener) : listener_(std::move(listener)) {}
+
+  Listener& listener() noexcept { return listener_; }
+  const Listener& listener() const noexcept { return listener_; }
+
+  template <typename K>
+  void notify(K&& key, T&& value, LruEvictionReason reason) {
+    pending_.push_back(LruEviction<Key, T>{std::forward<K>(key), std::move(value), reason});
+  }
+
+  void flush() {
+    if (!pending_.empty()) {
+      auto evictions = std::move(pending_);
+      pending_.clear();
+      listener_(std::move(evictions));
+    }
+  }
+
+private:
+  Listener listener_;
+  std::vector<LruEviction<Key, T>> pending_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Marks entries in the admission window. Nothing is stored without admission.
+template <bool kEnabled>
+struct LruWindowFlag {
+  constexpr bool inWindow() const noexcept { return false; }
+  void setInWindow(bool) noexcept {}
+};
+
+template <>
+struct LruWindowFlag<true> {
+  bool inWindow() const noexcept { return inWindow_; }
+  void setInWindow(bool value) noexcept { inWindow_ = value; }
+  bool inWindow_ = false;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Admission state. The list is split into the window, at the front, followed by the
+/// main region starting at `mainBegin`.
+template <typename Admission, typename ListIter, bool kEnabled = !std::is_same<Admission, NoAdmission>::value>
+struct LruAdmitter {
+  void resize(sizex) noexcept {}
+};
+
+template <typename Admission, typename ListIter>
+struct LruAdmitter<Admission, ListIter, true> {
+  void resize(sizex maxSize) {
+    maxWindowSize = std::max(maxSize * Admission::kWindowPercent / 100, 1_z);
+    sketch.ensureCapacity(maxSize);
+  }
+
+  /// Recent access frequencies of all keys, cached or not
+  FrequencySketch sketch;
+
+  /// First entry of the main region, or the list's end() when it's empty
+  ListIter mainBegin;
+
+  /// Entries in the window
+  sizex windowSize = 0;
+
+  /// Once the window is over this size, its LRU entry moves to the main region
+  sizex maxWindowSize = 1;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Per-entry data of the policies
+struct LruNoPolicyData {};
+
+struct LruSegmentData {
+  u8 segment = 0;
+};
+
+/// An entry that didn't come through `onInsert()`, like one loaded from a snapshot, has
+/// been used once, the same as a new entry, so the two share the lowest bucket
+struct LruFrequencyData {
+  u32 frequency = 1;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Moves an entry to just before `pos`, keeping `begin` on the first entry of the region
+template <typename ListType>
+void moveBefore(ListType& list, typename ListType::iterator& begin, typename ListType::iterator pos,
+                typename ListType::iterator iter) {
+  if (iter == pos) {
+    return;
+  }
+  if (iter == begin) {
+    ++begin;
+  }
+  list.splice(pos, list, iter);
+  if (pos == begin) {
+    begin = iter;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// A bounded LRU list of keys, used to remember recently purged keys
+template <typename Key>
+class LruGhostList {
+  using KeyList = std::list<Key>;
+
+public:
+  LruGhostList() = default;
+  LruGhostList(const LruGhostList& that) : keys_(that.keys_) { index(); }
+  LruGhostList& operator=(const LruGhostList& that) {
+    if (this != &that) {
+      keys_ = that.keys_;
+      index();
+    }
+    return *this;
+  }
+  LruGhostList(LruGhostList&&) = default;
+  LruGhostList& operator=(LruGhostList&&) = default;
+
+  sizex size() const noexcept { return map_.size(); }
+  bool empty() const noexcept { return map_.empty(); }
+  bool contains(const Key& key) const { return map_.find(key) != map_.end(); }
+
+  void push(const Key& key) {
+    erase(key);
+    keys_.push_front(key);
+    map_.emplace(key, keys_.begin());
+  }
+
+  bool erase(const Key& key) {
+    auto iter = map_.find(key);
+    if (iter == map_.end()) {
+      return false;
+    }
+    keys_.erase(iter->second);
+    map_.erase(iter);
+    return true;
+  }
+
+  void trim(sizex maxSize) {
+    while (map_.size() > maxSize) {
+      map_.erase(keys_.back());
+      keys_.pop_back();
+    }
+  }
+
+  void clear() {
+    map_.clear();
+    keys_.clear();
+  }
+
+private:
+  void index() {
+    map_.clear();
+    for (auto iter = keys_.begin(); iter != keys_.end(); ++iter) {
+      map_.emplace(*iter, iter);
+    }
+  }
+
+  KeyList keys_;
+  SysHashMap<Key, typename KeyList::iterator> map_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Policy implementations
+/// A policy orders the region of the cache's list it's given, which is the whole list
+/// or the part after an admission window. The region's end is always the list's end.
+/// The cache calls:
+/// * `onInsert()` for a new entry, which is at the front of the region
+/// * `onAccess()` for a hit
+/// * `onErase()` before any entry is removed
+/// * `victim()` for the entry to purge, from a region that isn't empty
+/// * `onEvict()` before a victim is removed, after which `onErase()` is still called
+/// * `reset()` after the list is emptied, `adopt()` after taking another cache's list,
+///   and `rebuild()` after the entries, and their data, were copied from another cache
+/// The region's `begin` is passed by reference and must be kept on its first entry.
+
+////////////////////////////////////////////////////////////////////////////////
+/// The entry a policy last inserted or accessed. Every policy's victim steers around it
+/// while the region holds others, so an operation never purges the entry it just used.
+template <typename ListType>
+class LruNewestEntry {
+  using ListIter = typename ListType::iterator;
+
+public:
+  void set(ListIter iter) noexcept {
+    iter_ = iter;
+    valid_ = true;
+  }
+
+  void clear() noexcept { valid_ = false; }
+
+  void onErase(ListIter iter) noexcept {
+    if (valid_ && iter == iter_) {
+      valid_ = false;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// @return The policy's choice, unless it's the newest entry. A choice other than the
+  /// list's tail is in the segment ahead of the tail's, so the tail is taken instead.
+  /// Otherwise the entry before the tail is, unless the newest entry is all there is.
+  ListIter avoid(ListType& list, ListIter begin, ListIter victim) const noexcept {
+    if (!valid_ || victim != iter_) {
+      return victim;
+    }
+    const auto last = std::prev(list.end());
+    if (victim != last) {
+      return last;
+    }
+    return (victim != begin) ? std::prev(victim) : victim;
+  }
+
+private:
+  ListIter iter_;
+  bool valid_ = false;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// LRU
+template <typename Policy, typename Key, typename ListType>
+class LruRecencyPolicy {
+  using ListIter = typename ListType::iterator;
+
+public:
+  void resize(sizex) noexcept {}
+  void reset(ListType&) noexcept { newest_.clear(); }
+  void adopt(ListType&) noexcept { newest_.clear(); }
+  void rebuild(ListType&, ListIter) noexcept { newest_.clear(); }
+  void onInsert(ListType&, ListIter&, ListIter iter) noexcept { newest_.set(iter); }
+  void onAccess(ListType& list, ListIter& begin, ListIter iter) {
+    moveBefore(list, begin, begin, iter);
+    newest_.set(iter);
+  }
+  void onErase(ListType&, ListIter& begin, ListIter iter) noexcept {
+    if (iter == begin) {
+      ++begin;
+    }
+    newest_.onErase(iter);
+  }
+  ListIter victim(ListType& list, ListIter begin) noexcept {
+    return newest_.avoid(list, begin, std::prev(list.end()));
+  }
+  template <typename Entry>
+  void onEvict(const Entry&) noexcept {}
+
+private:
+  LruNewestEntry<ListType> newest_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// SLRU. The region is the protected segment followed by the probationary segment.
+template <typename Policy, typename Key, typename ListType>
+class LruSegmentedPolicy {
+  using ListIter = typename ListType::iterator;
+  enum Segment : u8 { kProbation, kProtected };
+
+public:
+  void resize(sizex maxSize) noexcept { maxProtected_ = maxSize * Policy::kProtectedPercent / 100; }
+
+  void reset(ListType& list) noexcept {
+    probationBegin_ = list.end();
+    probationSize_ = 0;
+    protectedSize_ = 0;
+    newest_.clear();
+  }
+
+  void adopt(ListType& list) noexcept {
+    if (probationSize_ == 0) {
+      probationBegin_ = list.end();
+    }
+    newest_.clear();
+  }
+
+  void rebuild(ListType& list, ListIter begin) noexcept {
+    reset(list);
+    for (auto iter = begin; iter != list.end(); ++iter) {
+      if (iter->segment == kProtected) {
+        ++protectedSize_;
+      } else if (probationSize_++ == 0) {
+        probationBegin_ = iter;
+      }
+    }
+  }
+
+  void onInsert(ListType& list, ListIter& begin, ListIter iter) {
+    iter->segment = kProbation;
+    moveBefore(list, begin, probationBegin_, iter);
+    probationBegin_ = iter;
+    ++probationSize_;
+    newest_.set(iter);
+  }
+
+  void onAccess(ListType& list, ListIter& begin, ListIter iter) {
+    if (iter->segment == kProbation) {
+      if (iter == probationBegin_) {
+        ++probationBegin_;
+      }
+      --probationSize_;
+      iter->segment = kProtected;
+      ++protectedSize_;
+    }
+    moveBefore(list, begin, begin, iter);
+    newest_.set(iter);
+
+    // The protected tail is just before the probation front, so demoting it only
+    // moves the boundary
+    while (protectedSize_ > maxProtected_) {
+      --probationBegin_;
+      probationBegin_->segment = kProbation;
+      --protectedSize_;
+      ++probationSize_;
+    }
+  }
+
+  void onErase(ListType&, ListIter& begin, ListIter iter) noexcept {
+    if (iter == begin) {
+      ++begin;
+    }
+    if (iter->segment == kProtected) {
+      --protectedSize_;
+    } else {
+      if (iter == probationBegin_) {
+        ++probationBegin_;
+      }
+      --probationSize_;
+    }
+    newest_.onErase(iter);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The probation tail, or the protected tail when probation is empty or holds only the
+  /// entry just inserted
+  ListIter victim(ListType& list, ListIter begin) noexcept {
+    return newest_.avoid(list, begin, std::prev(list.end()));
+  }
+
+  template <typename Entry>
+  void onEvict(const Entry&) noexcept {}
+
+private:
+  ListIter probationBegin_;
+  sizex probationSize_ = 0;
+  sizex protectedSize_ = 0;
+  sizex maxProtected_ = 0;
+  LruNewestEntry<ListType> newest_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// 2Q. The region is Am followed by A1in.
+template <typename Policy, typename Key, typename ListType>
+class LruTwoQueuePolicy {
+  using ListIter = typename ListType::iterator;
+  enum Segment : u8 { kIn, kMain };
+
+public:
+  void resize(sizex maxSize) {
+    maxIn_ = std::max(maxSize * Policy::kInPercent / 100, 1_z);
+    maxOut_ = std::max(maxSize * Policy::kOutPercent / 100, 1_z);
+    out_.trim(maxOut_);
+  }
+
+  void reset(ListType& list) {
+    inBegin_ = list.end();
+    inSize_ = 0;
+    mainSize_ = 0;
+    out_.clear();
+    newest_.clear();
+  }
+
+  void adopt(ListType& list) noexcept {
+    if (inSize_ == 0) {
+      inBegin_ = list.end();
+    }
+    newest_.clear();
+  }
+
+  void rebuild(ListType& list, ListIter begin) noexcept {
+    inBegin_ = list.end();
+    inSize_ = 0;
+    mainSize_ = 0;
+    newest_.clear();
+    for (auto iter = begin; iter != list.end(); ++iter) {
+      if (iter->segment == kMain) {
+        ++mainSize_;
+      } else if (inSize_++ == 0) {
+        inBegin_ = iter;
+      }
+    }
+  }
+
+  void onInsert(ListType& list, ListIter& begin, ListIter iter) {
+    newest_.set(iter);
+    if (out_.erase(iter->key)) {
+      // Seen recently enough to be remembered, so it's already at the front of Am
+      iter->segment = kMain;
+      ++mainSize_;
+      return;
+    }
+
+    iter->segment = kIn;
+    moveBefore(list, begin, inBegin_, iter);
+    inBegin_ = iter;
+    ++inSize_;
+  }
+
+  void onAccess(ListType& list, ListIter& begin, ListIter iter) {
+    newest_.set(iter);
+    // A1in is a FIFO, hits don't change its order
+    if (iter->segment == kMain) {
+      moveBefore(list, begin, begin, iter);
+    }
+  }
+
+  void onErase(ListType&, ListIter& begin, ListIter iter) noexcept {
+    if (iter == begin) {
+      ++begin;
+    }
+    if (iter->segment == kMain) {
+      --mainSize_;
+    } else {
+      if (iter == inBegin_) {
+        ++inBegin_;
+      }
+      --inSize_;
+    }
+    newest_.onErase(iter);
+  }
+
+  ListIter victim(ListType& list, ListIter begin) noexcept {
+    if (inSize_ > maxIn_ || mainSize_ == 0) {
+      return newest_.avoid(list, begin, std::prev(list.end()));
+    }
+    return newest_.avoid(list, begin, std::prev(inBegin_));
+  }
+
+  template <typename Entry>
+  void onEvict(const Entry& entry) {
+    if (entry.segment == kIn) {
+      out_.push(entry.key);
+      out_.trim(maxOut_);
+    }
+  }
+
+private:
+  ListIter inBegin_;
+  sizex inSize_ = 0;
+  sizex mainSize_ = 0;
+  sizex maxIn_ = 1;
+  sizex maxOut_ = 1;
+  LruGhostList<Key> out_;
+  LruNewestEntry<ListType> newest_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// ARC. The region is T2 followed by T1, with B1 and B2 being the ghosts of each. The
+/// target size of T1, p, grows on a B1 ghost hit and shrinks on a B2 ghost hit.
+template <typename Policy, typename Key, typename ListType>
+class LruAdaptivePolicy {
+  using ListIter = typename ListType::iterator;
+  enum Segment : u8 { kT1, kT2 };
+
+public:
+  void resize(sizex maxSize) {
+    capacity_ = maxSize;
+    target_ = std::min(target_, capacity_);
+    b1_.trim(capacity_);
+    b2_.trim(capacity_);
+  }
+
+  void reset(ListType& list) {
+    t1Begin_ = list.end();
+    t1Size_ = 0;
+    t2Size_ = 0;
+    target_ = 0;
+    fresh_ = false;
+    fromB2_ = false;
+    b1_.clear();
+    b2_.clear();
+    newest_.clear();
+  }
+
+  void adopt(ListType& list) noexcept {
+    if (t1Size_ == 0) {
+      t1Begin_ = list.end();
+    }
+    newest_.clear();
+  }
+
+  void rebuild(ListType& list, ListIter begin) noexcept {
+    t1Begin_ = list.end();
+    t1Size_ = 0;
+    t2Size_ = 0;
+    fresh_ = false;
+    newest_.clear();
+    for (auto iter = begin; iter != list.end(); ++iter) {
+      if (iter->segment == kT2) {
+        ++t2Size_;
+      } else if (t1Size_++ == 0) {
+        t1Begin_ = iter;
+      }
+    }
+  }
+
+  void onInsert(ListType& list, ListIter& begin, ListIter iter) {
+    fresh_ = false;
+    fromB2_ = false;
+    newest_.set(iter);
+    if (b1_.contains(iter->key)) {
+      target_ = std::min(capacity_, target_ + std::max(b2_.size() / b1_.size(), 1_z));
+      b1_.erase(iter->key);
+      iter->segment = kT2;
+      ++t2Size_;
+      return;
+    }
+
+    if (b2_.contains(iter->key)) {
+      const auto delta = std::max(b1_.size() / b2_.size(), 1_z);
+      target_ = (target_ > delta) ? target_ - delta : 0;
+      b2_.erase(iter->key);
+      iter->segment = kT2;
+      ++t2Size_;
+      fromB2_ = true;
+      return;
+    }
+
+    // Keep T1 and B1 within the capacity, and everything within twice that
+    if (t1Size_ + b1_.size() >= capacity_) {
+      b1_.trim(b1_.empty() ? 0 : b1_.size() - 1);
+    }
+    if (t1Size_ + t2Size_ + b1_.size() + b2_.size() >= 2 * capacity_) {
+      b2_.trim(b2_.empty() ? 0 : b2_.size() - 1);
+    }
+
+    iter->segment = kT1;
+    moveBefore(list, begin, t1Begin_, iter);
+    t1Begin_ = iter;
+    ++t1Size_;
+    fresh_ = true;
+  }
+
+  void onAccess(ListType& list, ListIter& begin, ListIter iter) {
+    fresh_ = false;
+    newest_.set(iter);
+    if (iter->segment == kT1) {
+      if (iter == t1Begin_) {
+        ++t1Begin_;
+      }
+      --t1Size_;
+      iter->segment = kT2;
+      ++t2Size_;
+    }
+    moveBefore(list, begin, begin, iter);
+  }
+
+  void onErase(ListType&, ListIter& begin, ListIter iter) noexcept {
+    if (iter == begin) {
+      ++begin;
+    }
+    if (iter->segment == kT2) {
+      --t2Size_;
+    } else {
+      if (iter == t1Begin_) {
+        ++t1Begin_;
+        fresh_ = false;
+      }
+      --t1Size_;
+    }
+    newest_.onErase(iter);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// ARC's REPLACE. The entry just inserted into T1 doesn't count, since in ARC the
+  /// victim is chosen before it's inserted.
+  ListIter victim(ListType& list, ListIter begin) noexcept {
+    const auto t1Size = t1Size_ - (fresh_ ? 1 : 0);
+    if (t2Size_ == 0 || (t1Size > 0 && (t1Size > target_ || (fromB2_ && t1Size == target_)))) {
+      return newest_.avoid(list, begin, std::prev(list.end()));
+    }
+    return newest_.avoid(list, begin, std::prev(t1Begin_));
+  }
+
+  template <typename Entry>
+  void onEvict(const Entry& entry) {
+    auto& ghosts = (entry.segment == kT1) ? b1_ : b2_;
+    ghosts.push(entry.key);
+    ghosts.trim(capacity_);
+  }
+
+private:
+  ListIter t1Begin_;
+  sizex t1Size_ = 0;
+  sizex t2Size_ = 0;
+  sizex capacity_ = 1;
+
+  /// Target size of T1, aka p
+  sizex target_ = 0;
+
+  /// Was the last insert a new entry in T1, or a B2 ghost hit?
+  bool fresh_ = false;
+  bool fromB2_ = false;
+
+  LruGhostList<Key> b1_;
+  LruGhostList<Key> b2_;
+  LruNewestEntry<ListType> newest_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// O(1) LFU. The region is sorted by descending frequency, and each frequency's bucket
+/// of entries is in LRU order. Only the head of each bucket is tracked, which is where
+/// an entry moving up to that frequency goes. The entry just inserted is never the
+/// victim, or it would always be, being the only one used once.
+template <typename Policy, typename Key, typename ListType>
+class LruFrequencyPolicy {
+  using ListIter = typename ListType::iterator;
+
+  struct Bucket {
+    ListIter head;
+    sizex count;
+  };
+
+public:
+  void resize(sizex) noexcept {}
+
+  void reset(ListType&) {
+    buckets_.clear();
+    newest_.clear();
+  }
+
+  void adopt(ListType&) noexcept { newest_.clear(); }
+
+  void rebuild(ListType& list, ListIter begin) {
+    buckets_.clear();
+    newest_.clear();
+    for (auto iter = begin; iter != list.end(); ++iter) {
+      auto bucket = buckets_.find(iter->frequency);
+      if (bucket == buckets_.end()) {
+        buckets_.emplace(iter->frequency, Bucket{iter, 1});
+      } else {
+        ++buckets_[iter->frequency].count;
+      }
+    }
+  }
+
+  void onInsert(ListType& list, ListIter& begin, ListIter iter) {
+    iter->frequency = 1;
+    addToBucket(list, begin, iter, buckets_.find(1) != buckets_.end() ? buckets_[1].head : list.end());
+    newest_.set(iter);
+  }
+
+  void onAccess(ListType& list, ListIter& begin, ListIter iter) {
+    newest_.set(iter);
+    const auto frequency = iter->frequency;
+    if (frequency == kMaxFrequency) {
+      auto& bucket = buckets_[frequency];
+      moveBefore(list, begin, bucket.head, iter);
+      bucket.head = iter;
+      return;
+    }
+
+    // Goes to the head of the next bucket up, or to the head of its own bucket when it's
+    // the first at the new frequency
+    const auto upper = buckets_.find(frequency + 1);
+    const auto pos = (upper != buckets_.end()) ? upper->second.head : buckets_[frequency].head;
+    removeFromBucket(iter);
+    iter->frequency = frequency + 1;
+    addToBucket(list, begin, iter, pos);
+  }
+
+  void onErase(ListType&, ListIter& begin, ListIter iter) {
+    if (iter == begin) {
+      ++begin;
+    }
+    newest_.onErase(iter);
+    removeFromBucket(iter);
+  }
+
+  ListIter victim(ListType& list, ListIter begin) noexcept {
+    return newest_.avoid(list, begin, std::prev(list.end()));
+  }
+
+  template <typename Entry>
+  void onEvict(const Entry&) noexcept {}
+
+private:
+  static constexpr u32 kMaxFrequency = ~0_u32;
+
+  void addToBucket(ListType& list, ListIter& begin, ListIter iter, ListIter pos) {
+    moveBefore(list, begin, pos, iter);
+    auto bucket = buckets_.find(iter->frequency);
+    if (bucket == buckets_.end()) {
+      buckets_.emplace(iter->frequency, Bucket{iter, 1});
+    } else {
+      auto& value = buckets_[iter->frequency];
+      value.head = iter;
+      ++value.count;
+    }
+  }
+
+  void removeFromBucket(ListIter iter) {
+    auto& bucket = buckets_[iter->frequency];
+    if (--bucket.count == 0) {
+      buckets_.erase(iter->frequency);
+    } else if (bucket.head == iter) {
+      ++bucket.head;
+    }
+  }
+
+  SysHashMap<u32, Bucket> buckets_;
+  LruNewestEntry<ListType> newest_;
+};
+
+template <typename Policy, typename Key, typename ListType>
+constexpr u32 LruFrequencyPolicy<Policy, Key, ListType>::kMaxFrequency;
+
+////////////////////////////////////////////////////////////////////////////////
+/// The list node payload
+template <typename Key, typename T, typename Traits>
+struct LruEntry : LruWeight<typename Traits::Weigher>,
+                  LruExpiry<typename Traits::ExpiryClock>,
+                  LruWindowFlag<!std::is_same<typename Traits::Admission, NoAdmission>::value>,
+                  Traits::Policy::EntryData {
+  template <typename Value>
+  LruEntry(const Key& k, Value&& v) : key(k), value(std::forward<Value>(v)) {}
+
+  Key key;
+  T value;
+};
+
 }  // namespace lru_detail
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -98,6 +1525,109 @@ class LruIterator;
 ///    if (iter != cache.cend())
 ///        std::cout << *iter << std::endl;
 ///
+/// * Use `getOrCompute()` to load missing values. A hit costs a single hash lookup.
+///    auto value = cache.getOrCompute(1, [](int key) { return loadFromDisk(key); });
+///
+/// `std::string` and `PosixPath` keys can be looked up by `StringView`, `StringWrapper` or
+/// `const char*` without building a key (see `KeyHashing`). `get()`, `find()`, `cfind()`,
+/// `contains()`, `refresh()` and `erase()` all take them.
+///
+/// # Weights
+/// By default the cache is limited by its entry count. It can also be limited by weight,
+/// such as the number of bytes a value uses. Supply a `Weigher` via the `Traits`
+/// parameter (see `LruCacheTraits`) and call `setMaxWeight()`. Items are then purged
+/// until both the size and weight limits are met. Each entry's weight is computed when
+/// it's put, and kept with the entry, so updating a value adjusts `totalWeight()` in
+/// O(1). Changes made through a reference or an iterator aren't seen until `reweigh()`.
+///
+/// # Expiry
+/// Entries can be given a time-to-live by supplying an `ExpiryClock` via the `Traits`
+/// parameter. Use `put(key, value, ttl)`, or `setDefaultTtl()` for every put. A zero ttl
+/// never expires. By default the ttl counts from the last put, `setExpiryMode()` can
+/// make it count from the last use instead.
+///
+/// An expired entry is never returned. Hits on one count as a miss and erase it. The
+/// remaining expired entries are reclaimed a few at a time by each `put()`, `get()`,
+/// `find()`, `refresh()` and `operator[]`, so there's never a long sweep. Deadlines are
+/// kept on a hierarchical timing wheel, which finds the due entries without scanning.
+/// Until reclaimed, expired entries still count towards `size()` and are iterated.
+/// Call `expire()` to reclaim them now, such as for a cache that's gone idle. Expiry
+/// applies whether or not kAutoPurge is set.
+///
+/// # Eviction Listener
+/// By default a value leaving the cache is just destroyed. Supply an `EvictionListener`
+/// via the `Traits` parameter to be handed each one instead, moved out, along with its
+/// key and an `LruEvictionReason`, such as to write it back to a slower store. A per
+/// value listener is called as each value is removed. A batched listener is called once
+/// at the end of an operation with all the values it removed, which suits purges that
+/// remove many. Either way the listener must not modify the cache. `clear()` hands over
+/// every value, but destroying the cache does not.
+///
+/// # Admission
+/// Plain LRU admits every new entry, so a scan of keys that are used once flushes out
+/// the whole cache. Setting the `Traits` `Admission` to `TinyLfuAdmission` guards
+/// against this (see `TinyLfuAdmission`). Every lookup and put is counted in a sketch
+/// of a few bits per entry, and a new entry must be used more often than the LRU entry
+/// it would replace. The most recently used entry may then be in the admission window
+/// rather than at the front of the list, and ordered iteration goes through the window
+/// first followed by the main region.
+///
+/// # Eviction Policies
+/// Despite the name, which entry is purged is up to the `Traits` `Policy`. `LruPolicy`
+/// is the default, while `SlruPolicy`, `TwoQPolicy` and `ArcPolicy` resist scans by
+/// favouring entries used more than once, and `LfuPolicy` purges the least often used.
+/// The API is the same for all of them, and every operation stays O(1). The policy keeps
+/// the list in its own order, so ordered iteration follows the policy's segments rather
+/// than pure recency. With admission, the policy orders the main region.
+///
+/// # Statistics
+/// Setting the `Traits` `Stats` to `LocalStats` counts hits, misses, inserts, updates,
+/// removals by reason, and the loads (and their time) of `getOrCompute()`. `snapshot()`
+/// returns them as an `LruCacheStats`. The default, `NoStats`, records nothing and adds
+/// no code to any operation.
+///
+/// # Batches
+/// `getMany()` and `putMany()` handle many keys at once, a group at a time. `getMany()`
+/// hashes the whole group, prefetches the buckets, then resolves the keys and prefetches
+/// the entries found, and only then copies the values and updates the recency. The
+/// misses of one stage overlap across the group instead of being paid key by key.
+/// robin_map doesn't expose its buckets, so with it only the entries are prefetched,
+/// but the lookups reuse the hashes. `putMany()` only prefetches the buckets (not at all
+/// with robin_map) before the puts, so each key is looked up once.
+///
+/// # Sizing
+/// Setting the `Traits` `MissRatio` to `ShardsMissRatio` samples the keys looked up, and
+/// `missRatioCurve()` estimates the miss ratio an LRU cache of each size would
+/// have had on the same traffic (see `MissRatioEstimator`). It's meant for choosing
+/// `maxSize()` from live traffic, and costs little, as only about 1% of keys are tracked.
+///
+/// # Invalidation
+/// Setting the `Traits` `KeyIndex` keeps a secondary index of the keys, updated as
+/// entries are added and removed for any reason, eviction included. `invalidate()`
+/// erases the keys the index matches to a query, in time proportional to the matches
+/// rather than a scan of the whole cache. With `PathPrefixIndex`, `invalidate("/a/b")`
+/// erases every path under "/a/b".
+///
+/// # Shrinking
+/// Shrinking a large cache purges the surplus in one go by default. After
+/// `setPurgeBudget()`, every operation purges at most that many entries instead, so the
+/// surplus goes a little at a time, and `purgeSome()` or `purgeFor()` can be called, such
+/// as from a background thread holding the cache's lock, to get it done sooner.
+///
+/// # Snapshots
+/// `saveSnapshot()` writes the live entries to a file, most recently used first, and
+/// `loadSnapshot()` reads them back, such as to warm up a cache after a restart. Keys and
+/// values are written by the `Traits` `KeySerializer` and `ValueSerializer`. Loading
+/// keeps the saved order, stops once the cache is full so the least recently used
+/// entries aren't even read, and restarts any time-to-live with the default.
+///
+/// # Allocation
+/// Every entry is a list node plus a map node. The `Traits` `Allocator` is rebound for
+/// both, and with `NodePoolAllocator` they come from a pool that's told to expect
+/// `maxSize()` entries. Once full, each replacement reuses the nodes of the entry it
+/// evicted, so the global allocator is no longer called at all. A copy of the cache gets
+/// its own pool, while a move hands over the pool with the entries.
+///
 /// # Iterators
 /// The iterators work for basic needs but they aren't fully compliant with `std`.
 /// The appropriate iterator traits and types aren't set, std::make_reverse_iterator
@@ -115,265 +1645,1255 @@ class LruIterator;
 ///
 /// SCW: Basically just writing this for fun... haven't done one before.
 ////////////////////////////////////////////////////////////////////////////////
-template <typename Key, typename T, bool kAutoPurge = true>
+template <typename Key, typename T, bool kAutoPurge = true, typename Traits = LruCacheTraits<Key, T>>
 class LruCache {
-  using ThisType = LruCache<Key, T, kAutoPurge>;
-  using KeyValuePair = std::pair<Key, T>;
-  using ListType = std::list<KeyValuePair>;
+  using ThisType = LruCache<Key, T, kAutoPurge, Traits>;
+  using Weigher = typename Traits::Weigher;
+  using Expirer = lru_detail::LruExpirer<Key, typename Traits::ExpiryClock>;
+  using Entry = lru_detail::LruEntry<Key, T, Traits>;
+  using Listener = typename Traits::EvictionListener;
+  using EvictionSink = lru_detail::LruEvictionSink<Key, T, Listener>;
+  using HasEvictionListener = std::integral_constant<bool, !std::is_same<Listener, NullEvictionListener>::value>;
+  using HasAdmission = std::integral_constant<bool, !std::is_same<typename Traits::Admission, NoAdmission>::value>;
+  using Allocator = typename Traits::Allocator;
+  using AllocatorTraits = std::allocator_traits<Allocator>;
+  using ListAllocator = typename AllocatorTraits::template rebind_alloc<Entry>;
+  using ListType = std::list<Entry, ListAllocator>;
   using ListIter = typename ListType::iterator;
-  using MapType = SysHashMap<Key, ListIter>;
+  using Admitter = lru_detail::LruAdmitter<typename Traits::Admission, ListIter>;
+  using PolicyType = typename Traits::Policy::template Impl<typename Traits::Policy, Key, ListType>;
+  using PolicyData = typename Traits::Policy::EntryData;
+  using StatsRecorder = lru_detail::LruStatsRecorder<typename Traits::Stats>;
+  using MissRatioTracker = lru_detail::LruMissRatioTracker<typename Traits::MissRatio>;
+  using HasMissRatio = std::integral_constant<bool, !std::is_same<typename Traits::MissRatio, NoMissRatio>::value>;
+  using KeyIndex = typename Traits::KeyIndex;
+  using Hash = typename Traits::Hash;
+  using KeyEqual = typename Traits::KeyEqual;
+  using MapAllocator = typename AllocatorTraits::template rebind_alloc<std::pair<const Key, ListIter>>;
+  using MapType = SysHashMap<Key, ListIter, Hash, KeyEqual, MapAllocator>;
   using ConstListIter = typename ListType::const_iterator;
-  using Map = SysHashMap<Key, ListIter>;
+  using Map = MapType;
   using MapIter = typename Map::iterator;
   using ConstMapIter = typename Map::const_iterator;
 
+  template <typename K>
+  using EnableIfLookupKey = typename std::enable_if<lru_detail::LruIsLookupKey<Key, Hash, KeyEqual, K>::value>::type;
+
 public:
   using UnorderedIterator = lru_detail::LruIterator<ThisType, MapIter, MapIter, ConstMapIter>;
   using ConstUnorderedIterator = lru_detail::LruIterator<ThisType, ConstMapIter, MapIter, ConstMapIter>;
   using OrderedIterator = lru_detail::LruIterator<ThisType, ListIter, ListIter, ConstListIter>;
   using ConstOrderedIterator = lru_detail::LruIterator<ThisType, ConstListIter, ListIter, ConstListIter>;
 
-  using Iterator = UnorderedIterator;
-  using ConstIterator = ConstUnorderedIterator;
-  using KeyType = Key;
-  using ValueType = T;
+  using Iterator = UnorderedIterator;
+  using ConstIterator = ConstUnorderedIterator;
+  using KeyType = Key;
+  using ValueType = T;
+  using TraitsType = Traits;
+  using AllocatorType = Allocator;
+  using Duration = typename Expirer::Duration;
+
+  /// Maximum weight value, which is the default (ie. no weight limit)
+  static constexpr sizex kUnlimitedWeight = ~0_z;
+
+  /// Is there a `Traits::ExpiryClock` for entries to expire by?
+  static constexpr bool kHasExpiry = !std::is_void<typename Traits::ExpiryClock>::value;
+
+  /// Is there a `Traits::EvictionListener` to hand removed values to?
+  static constexpr bool kHasEvictionListener = HasEvictionListener::value;
+
+  /// Are `Traits::Stats` recorded?
+  static constexpr bool kHasStats = !std::is_same<typename Traits::Stats, NoStats>::value;
+
+  /// Is there a `Traits::MissRatio` estimating the miss ratio curve?
+  static constexpr bool kHasMissRatio = HasMissRatio::value;
+
+  /// Is there a `Traits::KeyIndex` for `invalidate()`?
+  static constexpr bool kHasKeyIndex = !std::is_same<KeyIndex, NoKeyIndex>::value;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache and sets the maximum size before items get purged.
+  explicit LruCache(sizex maxSizeValue = 10) : LruCache(maxSizeValue, Listener{}, Allocator()) {}
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache with the maximum size and the listener for removed values
+  LruCache(sizex maxSizeValue, Listener listener) : LruCache(maxSizeValue, std::move(listener), Allocator()) {}
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache with the maximum size, the listener for removed values, and the
+  /// allocator for the list and map nodes
+  LruCache(sizex maxSizeValue, Listener listener, const Allocator& allocator) :
+      map_(MapAllocator(allocator)),
+      list_(ListAllocator(allocator)),
+      maxSize_(std::max(maxSizeValue, 1_z)),
+      evictions_(std::move(listener)),
+      missRatio_(maxSize_) {
+    reserveNodes();
+    admitter_.resize(maxSize_);
+    resetAdmission(HasAdmission{});
+    policy_.resize(maxSize_);
+    policy_.reset(list_);
+  }
+
+  // Cached values will be destructed normally
+  ~LruCache() = default;
+
+  // Create a copy of the given cache
+  LruCache(const LruCache& that) :
+      map_(std::allocator_traits<MapAllocator>::select_on_container_copy_construction(that.map_.get_allocator())),
+      list_(ListAllocator(map_.get_allocator())),
+      maxSize_(that.maxSize_),
+      maxWeight_(that.maxWeight_),
+      purgeBudget_(that.purgeBudget_),
+      expirer_(that.expirer_),
+      evictions_(that.evictions_),
+      admitter_(that.admitter_),
+      policy_(that.policy_),
+      stats_(that.stats_),
+      missRatio_(that.missRatio_) {
+    reserveNodes();
+    doEmptyCopyFrom(that);
+  }
+
+  // Copies the given cache to this cache. All prior entires in this cache are discarded
+  LruCache& operator=(const LruCache& that) {
+    if (this != &that) {
+      clear();
+      maxSize_ = that.maxSize_;
+      maxWeight_ = that.maxWeight_;
+      purgeBudget_ = that.purgeBudget_;
+      expirer_ = that.expirer_;
+      evictions_ = that.evictions_;
+      admitter_ = that.admitter_;
+      policy_ = that.policy_;
+      stats_ = that.stats_;
+      missRatio_ = that.missRatio_;
+      reserveNodes();
+      doEmptyCopyFrom(that);
+    }
+    return *this;
+  }
+
+  // Moves the given cache to this. Not noexcept because list/map moves aren't noexcept
+  LruCache(LruCache&& that) :
+      map_(std::move(that.map_)),
+      list_(std::move(that.list_)),
+      maxSize_(that.maxSize_),
+      maxWeight_(that.maxWeight_),
+      totalWeight_(std::exchange(that.totalWeight_, 0)),
+      purgeBudget_(that.purgeBudget_),
+      expirer_(std::move(that.expirer_)),
+      evictions_(std::move(that.evictions_)),
+      admitter_(std::move(that.admitter_)),
+      policy_(std::move(that.policy_)),
+      stats_(that.stats_),
+      missRatio_(std::move(that.missRatio_)),
+      keyIndex_(std::move(that.keyIndex_)) {
+    that.keyIndex_.clear();
+    adoptAdmission(HasAdmission{});
+    that.resetAdmission(HasAdmission{});
+    that.admitter_.resize(that.maxSize_);
+    policy_.adopt(list_);
+    that.policy_.reset(that.list_);
+  }
+
+  // Moves the given cache to this. Not noexcept because list/map moves aren't noexcept
+  LruCache& operator=(LruCache&& that) {
+    if (this != &that) {
+      map_ = std::move(that.map_);
+      list_ = std::move(that.list_);
+      maxSize_ = that.maxSize_;
+      maxWeight_ = that.maxWeight_;
+      totalWeight_ = std::exchange(that.totalWeight_, 0);
+      purgeBudget_ = that.purgeBudget_;
+      expirer_ = std::move(that.expirer_);
+      evictions_ = std::move(that.evictions_);
+      admitter_ = std::move(that.admitter_);
+      policy_ = std::move(that.policy_);
+      stats_ = that.stats_;
+      missRatio_ = std::move(that.missRatio_);
+      keyIndex_ = std::move(that.keyIndex_);
+      that.keyIndex_.clear();
+      adoptAdmission(HasAdmission{});
+      that.resetAdmission(HasAdmission{});
+      that.admitter_.resize(that.maxSize_);
+      policy_.adopt(list_);
+      that.policy_.reset(that.list_);
+    }
+    return *this;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of items in the map
+  sizex size() const noexcept { return map_.size(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number maximum number of items allowed in the cache. If kAutoPurge is
+  /// `false`, then this is a soft-limit. It can be exceeded, but a `purge()` call will
+  /// remove items to achieve this size.
+  sizex maxSize() const noexcept { return maxSize_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return a copy of the allocator for the list and map nodes
+  Allocator allocator() const { return Allocator(map_.get_allocator()); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Sets the maximum size of the map. Will purge items when `kAutoPurge` is
+  /// true and the maximum size is reduced, within the purge budget.
+  void setMaxSize(sizex maxSizeValue) {
+    auto newMaxSize = std::max(maxSizeValue, 1_z);
+    bool isSmaller = newMaxSize < maxSize_;
+    maxSize_ = newMaxSize;
+    reserveNodes();
+    admitter_.resize(maxSize_);
+    policy_.resize(maxSize_);
+    if (isSmaller)
+      doAutoPurge();
+    evictions_.flush();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the sum of the weights of all cached items. With the default `UnitWeigher`
+  /// this is the same as `size()`.
+  sizex totalWeight() const noexcept { return totalWeight_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the maximum total weight allowed in the cache. Like `maxSize()`, this is a
+  /// soft-limit when kAutoPurge is `false`.
+  sizex maxWeight() const noexcept { return maxWeight_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Sets the maximum total weight of the cache. Will purge items when `kAutoPurge` is
+  /// true and the maximum weight is reduced. Both the size and weight limits apply.
+  void setMaxWeight(sizex maxWeightValue) {
+    bool isSmaller = maxWeightValue < maxWeight_;
+    maxWeight_ = maxWeightValue;
+    if (isSmaller)
+      doAutoPurge();
+    evictions_.flush();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the most entries an operation purges. Unlimited by default.
+  sizex purgeBudget() const noexcept { return purgeBudget_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Limits how many entries any one operation purges, at least two, so shrinking a
+  /// large cache doesn't stall the caller. Until it's back within its limits, every
+  /// operation purges up to the budget, even lookups, and `purgeSome()` can do more.
+  void setPurgeBudget(sizex budget) noexcept { purgeBudget_ = std::max(budget, 2_z); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the cache over its size or weight limit? Only for a while after shrinking with a
+  /// purge budget, or when `kAutoPurge` is false.
+  bool isOverLimit() const noexcept {
+    return size() > maxSize_ || (totalWeight_ > maxWeight_ && size() > 1);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return when entries' time-to-live starts counting
+  LruExpiryMode expiryMode() const noexcept { return expirer_.mode(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Sets when entries' time-to-live starts counting. Takes effect from each entry's
+  /// next use.
+  void setExpiryMode(LruExpiryMode mode) noexcept {
+    static_assert(kHasExpiry, "Expiry needs a Traits::ExpiryClock");
+    expirer_.setMode(mode);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the time-to-live given to entries put without one. Zero means forever.
+  Duration defaultTtl() const noexcept { return expirer_.defaultTtl(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Sets the time-to-live given to entries put without one. Zero means forever.
+  /// Entries already cached keep their time-to-live.
+  void setDefaultTtl(Duration ttl) noexcept {
+    static_assert(kHasExpiry, "Expiry needs a Traits::ExpiryClock");
+    expirer_.setDefaultTtl(ttl);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the counters recorded so far. Needs `Traits::Stats`.
+  LruCacheStats snapshot() const noexcept {
+    static_assert(kHasStats, "Statistics need a Traits::Stats");
+    return stats_.snapshot();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the estimated miss ratios of an LRU cache of other sizes, fed by this cache's
+  /// lookups. Needs `Traits::MissRatio`.
+  const MissRatioEstimator& missRatioCurve() const noexcept {
+    static_assert(kHasMissRatio, "The miss ratio curve needs a Traits::MissRatio");
+    return missRatio_.estimator;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Forget the accesses counted for the miss ratio curve. Needs `Traits::MissRatio`.
+  void resetMissRatioCurve() {
+    static_assert(kHasMissRatio, "The miss ratio curve needs a Traits::MissRatio");
+    missRatio_.estimator.clear();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Zero the counters. Needs `Traits::Stats`.
+  void resetStats() noexcept {
+    static_assert(kHasStats, "Statistics need a Traits::Stats");
+    stats_.reset();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the listener that removed values are handed to
+  Listener& evictionListener() noexcept { return evictions_.listener(); }
+  const Listener& evictionListener() const noexcept { return evictions_.listener(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the map empty?
+  bool empty() const noexcept { return map_.empty(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Check if the given key is mapped to a value in the cache. Does *not* change
+  /// cache ordering. Use `refresh()` for that case.
+  bool contains(const KeyType& key) const { return doContains(key); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Heterogeneous lookup, such as a `StringView` for `std::string` keys. See `Traits`.
+  template <typename K, typename = EnableIfLookupKey<K>>
+  bool contains(const K& key) const {
+    return doContains(key);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Refreshes a cache item if it exists, causing it to move to the front
+  void refresh(const KeyType& key) { doRefresh(key); }
+
+  template <typename K, typename = EnableIfLookupKey<K>>
+  void refresh(const K& key) {
+    doRefresh(key);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Recomputes the weight of a cache item. Weights are only computed when an item is
+  /// put (or created by `operator[]`), so call this after changing a value in place.
+  void reweigh(const KeyType& key) {
+    const auto iter = map_.find(key);
+    if (iter != map_.end()) {
+      updateWeight(*iter->second);
+      doAutoPurge();
+      evictions_.flush();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Purge any entries such that the cache will be within it's max-size. Not necessary
+  /// when auto-purge is enabled
+  void purge() {
+    doPurge();
+    evictions_.flush();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Purge at most `budget` entries, such as from a background thread after shrinking
+  /// with a purge budget. The budget also counts moving entries out of the admission
+  /// window.
+  /// @return The number of entries purged
+  sizex purgeSome(sizex budget) {
+    const auto purged = doPurge(budget);
+    evictions_.flush();
+    return purged;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Purge until the cache is within its limits or the time is up, whichever is first.
+  /// The clock is checked every few entries.
+  /// @return The number of entries purged
+  template <typename Rep, typename Period>
+  sizex purgeFor(std::chrono::duration<Rep, Period> timeBudget) {
+    const auto deadline = std::chrono::steady_clock::now() + timeBudget;
+    sizex purged = 0;
+    do {
+      purged += doPurge(kPurgeStep);
+    } while (isPurgePending(HasAdmission{}) && std::chrono::steady_clock::now() < deadline);
+    evictions_.flush();
+    return purged;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove expired entries, doing at most `budget` units of work. Not necessary for
+  /// correctness, expired entries are never returned, but reclaims their memory.
+  /// @return The number of entries removed
+  sizex expire(sizex budget = ~0_z) {
+    const auto expired = doExpire(expirer_.now(), budget);
+    evictions_.flush();
+    return expired;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Write the live entries to the file at `path`, most recently used first. The file is
+  /// replaced only once the whole snapshot has been written.
+  /// @return false if the file couldn't be written
+  bool saveSnapshot(const std::string& path) const {
+    const auto now = expirer_.now();
+    sizex count = 0;
+    for (const auto& entry : list_) {
+      count += expirer_.isExpired(entry, now) ? 0 : 1;
+    }
+
+    SnapshotWriter out(path);
+    out.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+    out.writeSize(count);
+    for (const auto& entry : list_) {
+      if (!expirer_.isExpired(entry, now)) {
+        Traits::KeySerializer::write(out, entry.key);
+        Traits::ValueSerializer::write(out, entry.value);
+      }
+    }
+    return out.finish();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Add the entries from a `saveSnapshot()` file, in their saved order, behind any
+  /// entries already cached. Keys already cached are skipped as they're more recent, and
+  /// reading stops once the cache is full.
+  /// @return false if the file couldn't be read or is damaged. The entries read before
+  ///         the damage are kept.
+  bool loadSnapshot(const std::string& path) {
+    SnapshotReader in(path);
+    char magic[sizeof(kSnapshotMagic)];
+    in.read(magic, sizeof(magic));
+    if (!in.ok() || std::memcmp(magic, kSnapshotMagic, sizeof(magic)) != 0) {
+      return false;
+    }
+
+    const auto now = expirer_.now();
+    const auto count = in.readSize();
+    for (u64 i = 0; i < count && map_.size() < maxSize_; ++i) {
+      auto key = Traits::KeySerializer::read(in);
+      auto value = Traits::ValueSerializer::read(in);
+      if (!in.ok()) {
+        break;
+      }
+      if (map_.find(key) == map_.end()) {
+        emplaceBack(key, std::move(value), now);
+      }
+    }
+
+    rebuildRegions(HasAdmission{});
+    doAutoPurge();
+    evictions_.flush();
+    return in.ok();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Clear the cache completely. Any eviction listener is handed every value, least
+  /// recently used first.
+  void clear() {
+    ListType list(list_.get_allocator());
+    list.swap(list_);
+    map_.clear();
+    keyIndex_.clear();
+    totalWeight_ = 0;
+    expirer_.clear();
+    resetAdmission(HasAdmission{});
+    policy_.reset(list_);
+    stats_.evict(LruEvictionReason::Erase, list.size());
+    if (kHasEvictionListener) {
+      for (auto iter = list.rbegin(); iter != list.rend(); ++iter) {
+        evictions_.notify(std::move(iter->key), std::move(iter->value), LruEvictionReason::Erase);
+      }
+      evictions_.flush();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a cached value
+  sizex erase(const KeyType& key) { return doErase(key); }
+
+  template <typename K, typename = EnableIfLookupKey<K>>
+  sizex erase(const K& key) {
+    return doErase(key);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The `Traits::KeyIndex`, updated as keys are added and removed
+  const KeyIndex& keyIndex() const noexcept { return keyIndex_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Erase every key the `Traits::KeyIndex` matches to the query, such as a directory
+  /// for `PathPrefixIndex`
+  /// @return The number of entries erased
+  template <typename Query>
+  sizex invalidate(const Query& query) {
+    static_assert(kHasKeyIndex, "Invalidation needs a Traits::KeyIndex");
+    std::vector<KeyType> keys;
+    keyIndex_.collect(query, keys);
+    sizex erased = 0;
+    for (const auto& key : keys) {
+      auto iter = map_.find(key);
+      if (iter != map_.end()) {
+        eraseIter(iter, LruEvictionReason::Erase);
+        ++erased;
+      }
+    }
+    evictions_.flush();
+    return erased;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a cached value using an iterator
+  Iterator erase(const ConstIterator& iter) {
+    if (iter == cend())
+      return end();
+
+    auto next = eraseIter(iter.iter_, LruEvictionReason::Erase);
+    evictions_.flush();
+    return Iterator(next);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return a copy of the cached value for the key. On a miss, `loader(key)` is called
+  /// and its value inserted. A hit costs one lookup, as `get()` does, and a miss one
+  /// more to reserve the map slot. If the loader throws, the cache is left as it was.
+  /// The loader must not use the cache.
+  template <typename Loader>
+  T getOrCompute(const KeyType& key, Loader&& loader) {
+    const auto now = expirer_.now();
+    expireSome(now);
+    recordLookup(key);
+    auto iter = map_.find(key);
+    if (iter != map_.end() && onValueHit(iter, now)) {
+      stats_.hit();
+      evictions_.flush();
+      return valueFromIter(iter);
+    }
+
+    // Missing, or expired and erased
+    stats_.miss();
+    const auto inserted = map_.emplace(key, ListIter{});
+    ListIter listIter;
+    const auto loadStart = stats_.loadStarted();
+    try {
+      listIter = emplaceFront(key, loader(key));
+    } catch (...) {
+      stats_.loadFinished(loadStart);
+      map_.erase(inserted.first);
+      throw;
+    }
+    stats_.loadFinished(loadStart);
+    stats_.insert();
+    setMapValue(inserted.first, listIter);
+    onInserted(listIter, HasAdmission{});
+    expirer_.onWrite(key, *listIter, expirer_.defaultTtl(), now);
+
+    T result = valueFromIter(listIter);
+    doAutoPurge();
+    evictions_.flush();
+    return result;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Extract the cached value for the given key. If the value isn't in the cache, a
+  /// default constructed value will be created, placed in the cache, and returned.
+  T& operator[](const KeyType& key) {
+    const auto now = expirer_.now();
+    expireSome(now);
+    recordLookup(key);
+    auto iter = map_.find(key);
+    if (iter != map_.end() && onValueHit(iter, now)) {
+      // The item already exists and has been brought to the front since it's been "used"
+      stats_.hit();
+      evictions_.flush();
+      return valueFromIter(iter);
+    }
+
+    stats_.miss();
+    stats_.insert();
+
+    // No item. We needs to create a default value in that case
+    // First insert a default value to the front of the list, then add it to the map
+    auto listIter = emplaceFront(key, T{});
+    map_.emplace(key, listIter);
+    onInserted(listIter, HasAdmission{});
+    expirer_.onWrite(key, *listIter, expirer_.defaultTtl(), now);
+    doAutoPurge();
+    evictions_.flush();
+
+    // Purging keeps the newest entry, but don't hand out a node on that promise alone
+    iter = map_.find(key);
+    SW_ASSERT(iter != map_.end());
+    return valueFromIter(iter);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key
+  void put(const KeyType& key, const T& value) { doPut(key, value, expirer_.defaultTtl()); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key
+  void put(const KeyType& key, T&& value) { doPut(key, std::move(value), expirer_.defaultTtl()); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key, which expires
+  /// after `ttl`. A zero ttl never expires.
+  void put(const KeyType& key, const T& value, Duration ttl) {
+    static_assert(kHasExpiry, "Expiry needs a Traits::ExpiryClock");
+    doPut(key, value, ttl);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates mapped value associated with the given key, which expires
+  /// after `ttl`. A zero ttl never expires.
+  void put(const KeyType& key, T&& value, Duration ttl) {
+    static_assert(kHasExpiry, "Expiry needs a Traits::ExpiryClock");
+    doPut(key, std::move(value), ttl);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// @value Will be a copy of the value if it exists, otherwise it is unchanged
+  /// @return true if the value was found
+  bool get(const KeyType& key, T& value) { return doGet(key, value); }
+
+  template <typename K, typename = EnableIfLookupKey<K>>
+  bool get(const K& key, T& value) {
+    return doGet(key, value);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Look up a batch of keys, as if by `get()` on each. For every key `*found` is set,
+  /// and when found `*values` gets a copy of the value. Both output iterators advance
+  /// once per key. The key iterator must be a forward iterator.
+  /// @return The number of keys found
+  template <typename KeyIter, typename ValueIter, typename FoundIter>
+  sizex getMany(KeyIter first, KeyIter last, ValueIter values, FoundIter found) {
+    const auto now = expirer_.now();
+    expireSome(now);
+    sizex hits = 0;
+    std::array<sizex, kBatchSize> slots;
+    std::array<MapIter, kBatchSize> iters;
+    while (first != last) {
+      // Hash the whole group, prefetch the buckets, then resolve the keys and prefetch
+      // the entries found
+      const auto groupBegin = first;
+      sizex count = 0;
+      for (; first != last && count < kBatchSize; ++first, ++count) {
+        slots[count] = probeSlot(*first);
+      }
+      for (sizex i = 0; i < count; ++i) {
+        prefetchSlot(slots[i]);
+      }
+      auto probe = groupBegin;
+      for (sizex i = 0; i < count; ++i, ++probe) {
+        iters[i] = findInSlot(*probe, slots[i]);
+        if (iters[i] != map_.end()) {
+          lru_detail::prefetch(&*iters[i]->second);
+        }
+      }
+
+      // Then use them in order
+      auto key = groupBegin;
+      for (sizex i = 0; i < count; ++i, ++key, ++values, ++found) {
+        recordLookup(*key);
+        auto iter = iters[i];
+        if (iter != map_.end() && !onValueHit(iter, now)) {
+          // Erasing the expired entry may have invalidated the group's later probes
+          auto rest = key;
+          for (sizex j = i + 1; j < count; ++j) {
+            iters[j] = findKey(*++rest);
+          }
+          iter = map_.end();
+        }
+
+        if (iter == map_.end()) {
+          stats_.miss();
+          *found = false;
+        } else {
+          stats_.hit();
+          *values = valueFromIter(iter);
+          *found = true;
+          ++hits;
+        }
+      }
+    }
+
+    evictions_.flush();
+    return hits;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates a batch of key/value pairs, as if by `put()` on each, such as
+  /// from a map or a vector of pairs. With move iterators the values are moved in. The
+  /// iterator must be a forward iterator.
+  template <typename PairIter>
+  void putMany(PairIter first, PairIter last) {
+    const auto now = expirer_.now();
+    expireSome(now);
+    while (first != last) {
+      // Prefetch the buckets, and leave the one lookup per key to the put
+      auto groupBegin = first;
+      for (sizex count = 0; first != last && count < kBatchSize; ++first, ++count) {
+        if (kPrefetchesBuckets) {
+          prefetchSlot(probeSlot((*first).first));
+        }
+      }
+
+      for (; groupBegin != first; ++groupBegin) {
+        auto&& pair = *groupBegin;
+        putOne(pair.first, std::forward<decltype(pair)>(pair).second, expirer_.defaultTtl(), now);
+      }
+    }
+    evictions_.flush();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the cache element with the specified key. If it doesn't exist, end() is
+  /// returned. If it does exist, it will be refreshed to the front of the cache, and
+  /// and a valid Iterator to it is returned.
+  Iterator find(const KeyType& key) { return doFind(key); }
+
+  template <typename K, typename = EnableIfLookupKey<K>>
+  Iterator find(const K& key) {
+    return doFind(key);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the cache element with the specified key. If it doesn't exist, cend() is
+  /// returned. If it does exist, it will be refreshed to the front of the cache, and
+  /// and a valid ConstIterator to it is returned.
+  /// Note that we can't have a `find() const` since find needs to refresh it's cached
+  /// value. Thus to get one with a const iterator there is `cfind`
+  ConstIterator cfind(const KeyType& key) { return doFind(key); }
+
+  template <typename K, typename = EnableIfLookupKey<K>>
+  ConstIterator cfind(const K& key) {
+    return doFind(key);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  Iterator begin() noexcept { return Iterator(map_.begin()); }
+  Iterator end() noexcept { return Iterator(map_.end()); }
+  ConstIterator cbegin() const noexcept { return ConstIterator(map_.begin()); }
+  ConstIterator cend() const noexcept { return ConstIterator(map_.end()); }
+
+  /// Ordered iteration. I suspect this is primarily for debugging/testing, so it's
+  /// not the primary begin/end. ie. you'll have to use a full for loop.
+  OrderedIterator beginOrdered() noexcept { return OrderedIterator(list_.begin()); }
+  OrderedIterator endOrdered() noexcept { return OrderedIterator(list_.end()); }
+  ConstOrderedIterator beginOrdered() const noexcept { return ConstOrderedIterator(list_.cbegin()); }
+  ConstOrderedIterator endOrdered() const noexcept { return ConstOrderedIterator(list_.cend()); }
+  ConstOrderedIterator cbeginOrdered() const noexcept { return ConstOrderedIterator(list_.cbegin()); }
+  ConstOrderedIterator cendOrdered() const noexcept { return ConstOrderedIterator(list_.cend()); }
 
+private:
   ////////////////////////////////////////////////////////////////////////////////
-  /// Creates the cache and sets the maximum size before items get purged.
-  explicit LruCache(sizex maxSizeValue = 10) : maxSize_(std::max(maxSizeValue, 1_z)) {}
+  /// Lookups are templates so they take either a `KeyType` or a heterogeneous key
+  template <typename K>
+  bool doContains(const K& key) const {
+    const auto iter = findKey(key);
+    return iter != map_.end() && !expirer_.isExpired(*iter->second, expirer_.now());
+  }
 
-  // Cached values will be destructed normally
-  ~LruCache() = default;
+  template <typename K>
+  void doRefresh(const K& key) {
+    const auto now = expirer_.now();
+    expireSome(now);
+    recordLookup(key);
+    const auto iter = findKey(key);
+    if (iter != map_.end()) {
+      onValueHit(iter, now);
+    }
+    evictions_.flush();
+  }
 
-  // Create a copy of the given cache
-  LruCache(const LruCache& that) : maxSize_(that.maxSize_) { doEmptyCopyFrom(that); }
+  template <typename K>
+  sizex doErase(const K& key) {
+    auto iter = findKey(key);
+    if (iter == map_.end()) {
+      return 0;
+    }
 
-  // Copies the given cache to this cache. All prior entires in this cache are discarded
-  LruCache& operator=(const LruCache& that) {
-    if (this != &that) {
-      clear();
-      maxSize_ = that.maxSize_;
-      doEmptyCopyFrom(that);
+    eraseIter(iter, LruEvictionReason::Erase);
+    evictions_.flush();
+    return 1;
+  }
+
+  template <typename K>
+  bool doGet(const K& key, T& value) {
+    const auto now = expirer_.now();
+    expireSome(now);
+    recordLookup(key);
+    MapIter iter = findKey(key);
+    if (iter == map_.end() || !onValueHit(iter, now)) {
+      stats_.miss();
+      evictions_.flush();
+      return false;
     }
-    return *this;
+
+    stats_.hit();
+    value = valueFromIter(iter);
+    evictions_.flush();
+    return true;
   }
 
-  // Moves the given cache to this. Not noexcept because list/map moves aren't noexcept
-  LruCache(LruCache&&) = default;
+  template <typename K>
+  Iterator doFind(const K& key) {
+    const auto now = expirer_.now();
+    expireSome(now);
+    recordLookup(key);
+    MapIter iter = findKey(key);
+    if (iter != map_.end() && !onValueHit(iter, now)) {
+      iter = map_.end();
+    }
+    if (iter != map_.end()) {
+      stats_.hit();
+    } else {
+      stats_.miss();
+    }
 
-  // Moves the given cache to this. Not noexcept because list/map moves aren't noexcept
-  LruCache& operator=(LruCache&&) = default;
+    evictions_.flush();
+    return Iterator(iter);
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Return the number of items in the map
-  sizex size() const noexcept { return map_.size(); }
+  /// Probe the map. robin_map looks up heterogeneous keys directly. std::unordered_map
+  /// can't before C++20, so the key is copied into a per-thread probe key whose buffer
+  /// is reused, which avoids an allocation per lookup.
+  MapIter findKey(const KeyType& key) { return map_.find(key); }
+  ConstMapIter findKey(const KeyType& key) const { return map_.find(key); }
+
+  template <typename K>
+  MapIter findKey(const K& key) {
+#if SW_USE_ROBIN_HASH_MAP
+    return map_.find(key);
+#else
+    return map_.find(probeKey(key));
+#endif
+  }
+
+  template <typename K>
+  ConstMapIter findKey(const K& key) const {
+#if SW_USE_ROBIN_HASH_MAP
+    return map_.find(key);
+#else
+    return map_.find(probeKey(key));
+#endif
+  }
+
+  template <typename K>
+  static const KeyType& probeKey(const K& key) {
+    static thread_local KeyType probe;
+    assignKey(probe, asView(key));
+    return probe;
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Return the number maximum number of items allowed in the cache. If kAutoPurge is
-  /// `false`, then this is a soft-limit. It can be exceeded, but a `purge()` call will
-  /// remove items to achieve this size.
-  sizex maxSize() const noexcept { return maxSize_; }
+  /// Staged probes for the batches: locate a key's slot, prefetch it, then resolve it.
+  /// robin_map takes the precomputed hash back in find(), but doesn't expose its
+  /// buckets, so there's nothing to prefetch before the lookup itself. std::unordered_map
+  /// can't take a hash, so the slot is the bucket index, and the bucket and the head of
+  /// its chain are touched before the lookup, which then hashes the key again.
+#if SW_USE_ROBIN_HASH_MAP
+  static constexpr bool kPrefetchesBuckets = false;
+
+  template <typename K>
+  sizex probeSlot(const K& key) const {
+    return map_.hash_function()(key);
+  }
+
+  void prefetchSlot(sizex) const noexcept {}
+
+  template <typename K>
+  MapIter findInSlot(const K& key, sizex hash) {
+    return map_.find(key, hash);
+  }
+#else
+  static constexpr bool kPrefetchesBuckets = true;
+
+  sizex probeSlot(const KeyType& key) const { return map_.bucket(key); }
+
+  template <typename K>
+  sizex probeSlot(const K& key) const {
+    return map_.bucket(probeKey(key));
+  }
+
+  void prefetchSlot(sizex bucket) const {
+    const auto head = map_.begin(bucket);
+    if (head != map_.end(bucket)) {
+      lru_detail::prefetch(&*head);
+    }
+  }
+
+  template <typename K>
+  MapIter findInSlot(const K& key, sizex) {
+    return findKey(key);
+  }
+#endif
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Sets the maximum size of the map. Will purge items when `kAutoPurge` is
-  /// true and the maximum size is reduced.
-  void setMaxSize(sizex maxSizeValue) {
-    auto newMaxSize = std::max(maxSizeValue, 1_z);
-    bool isSmaller = newMaxSize < maxSize_;
-    maxSize_ = newMaxSize;
-    if (isSmaller)
-      doAutoPurge();
+  /// Point a map slot at its list entry. robin_map values are only writable via value()
+  static void setMapValue(MapIter iter, ListIter listIter) noexcept {
+#if SW_USE_ROBIN_HASH_MAP
+    iter.value() = listIter;
+#else
+    iter->second = listIter;
+#endif
   }
 
+  // Clarity Helpers
+  static const KeyType& keyFromIter(const ConstListIter& listIter) noexcept { return listIter->key; }
+  static const T& valueFromIter(const ConstListIter& listIter) noexcept { return listIter->value; }
+  static T& valueFromIter(const ListIter& listIter) noexcept { return listIter->value; }
+  static const KeyType& keyFromIter(const ConstMapIter& mapIter) noexcept { return mapIter->first; }
+  static T& valueFromIter(const ConstMapIter& mapIter) noexcept { return valueFromIter(mapIter->second); }
+  static T& valueFromIter(const MapIter& mapIter) noexcept { return valueFromIter(mapIter->second); }
+
   ////////////////////////////////////////////////////////////////////////////////
-  /// Is the map empty?
-  bool empty() const noexcept { return map_.empty(); }
+  /// Call this when a cached value is used. Entries in the admission window move to the
+  /// front of the list, the rest are reordered by the policy.
+  void onValueUsed(const ConstMapIter& iter) {
+    const auto listIter = iter->second;
+    if (listIter->inWindow()) {
+      list_.splice(list_.begin(), list_, listIter);
+      return;
+    }
+
+    ListIter scratch;
+    policy_.onAccess(list_, regionBegin(scratch, HasAdmission{}), listIter);
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Check if the given key is mapped to a value in the cache. Does *not* change
-  /// cache ordering. Use `refresh()` for that case.
-  bool contains(const KeyType& key) const { return map_.find(key) != map_.end(); }
+  /// The begin of the policy's region. Without admission it's the whole list, and as the
+  /// list tracks its own begin, the policy is handed a scratch copy.
+  ListIter& regionBegin(ListIter& scratch, std::false_type) noexcept {
+    scratch = list_.begin();
+    return scratch;
+  }
+  ListIter& regionBegin(ListIter&, std::true_type) noexcept { return admitter_.mainBegin; }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Refreshes a cache item if it exists, causing it to move to the front
-  void refresh(const KeyType& key) {
-    const auto iter = map_.find(key);
-    if (iter != map_.end()) {
-      onValueUsed(iter);
-    }
+  /// Count a lookup or put of the key in the admission sketch
+  template <typename K>
+  void recordAccess(const K&, std::false_type) noexcept {}
+  template <typename K>
+  void recordAccess(const K& key, std::true_type) {
+    admitter_.sketch.increment(sketchHash(key));
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Purge any entries such that the cache will be within it's max-size. Not necessary
-  /// when auto-purge is enabled
-  void purge() { doPurge(); }
+  /// Count a lookup of the key, for admission and the miss ratio curve. Puts aren't part
+  /// of the curve, as the put filling a miss would count as a second use.
+  template <typename K>
+  void recordLookup(const K& key) {
+    recordAccess(key, HasAdmission{});
+    trackLookup(key, HasMissRatio{});
+  }
+
+  template <typename K>
+  void trackLookup(const K&, std::false_type) noexcept {}
+  template <typename K>
+  void trackLookup(const K& key, std::true_type) {
+    missRatio_.estimator.access(sketchHash(key));
+  }
+
+  template <typename K>
+  u64 sketchHash(const K& key) const {
+    return FrequencySketch::spread(static_cast<u64>(map_.hash_function()(key)));
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Clear the cache completely
-  void clear() {
-    list_.clear();
-    map_.clear();
+  /// Empties the window and main regions, such as when the list was cleared
+  void resetAdmission(std::false_type) noexcept {}
+  void resetAdmission(std::true_type) noexcept {
+    admitter_.mainBegin = list_.end();
+    admitter_.windowSize = 0;
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Remove a cached value
-  sizex erase(const KeyType& key) {
-    auto iter = map_.find(key);
-    if (iter == map_.end()) {
-      return 0;
+  /// After taking another cache's list, an empty main region must begin at our end()
+  void adoptAdmission(std::false_type) noexcept {}
+  void adoptAdmission(std::true_type) noexcept {
+    if (admitter_.windowSize == list_.size()) {
+      admitter_.mainBegin = list_.end();
     }
+  }
 
-    // Remove the node from the list and the map
-    list_.erase(iter->second);
-    map_.erase(iter);
-    return 1;
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Call this once a new entry is at the front of the list. It goes to the policy, or
+  /// with admission, starts in the window.
+  void onInserted(ListIter listIter, std::false_type) {
+    ListIter scratch;
+    policy_.onInsert(list_, regionBegin(scratch, std::false_type{}), listIter);
+  }
+  void onInserted(ListIter listIter, std::true_type) noexcept {
+    listIter->setInWindow(true);
+    ++admitter_.windowSize;
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Remove a cached value using an iterator
-  Iterator erase(const ConstIterator& iter) {
-    if (iter == cend())
-      return end();
+  /// Keeps the regions intact as an entry is removed
+  void onErasing(ListIter listIter, std::false_type) {
+    ListIter scratch;
+    policy_.onErase(list_, regionBegin(scratch, std::false_type{}), listIter);
+  }
+  void onErasing(ListIter listIter, std::true_type) {
+    if (listIter->inWindow()) {
+      --admitter_.windowSize;
+    } else {
+      policy_.onErase(list_, admitter_.mainBegin, listIter);
+    }
+  }
 
-    auto mapIter = iter.iter_;
-    auto listIter = mapIter->second;
-    list_.erase(listIter);
-    return Iterator(map_.erase(mapIter));
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Moves the window's LRU entry to the front of the main region. It's adjacent, so
+  /// this only moves the boundary.
+  ListIter shiftWindow() noexcept {
+    --admitter_.mainBegin;
+    admitter_.mainBegin->setInWindow(false);
+    --admitter_.windowSize;
+    return admitter_.mainBegin;
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Extract the cached value for the given key. If the value isn't in the cache, a
-  /// default constructed value will be created, placed in the cache, and returned.
-  T& operator[](const KeyType& key) {
-    auto iter = map_.find(key);
-    if (iter == map_.end()) {
-      // No item. We needs to create a default value in that case
-      // First insert a default value to the front of the list, then add it to the map
-      list_.emplace_front(key, T{});
-      auto listIter = list_.begin();
-      map_.emplace(key, listIter);
-      doAutoPurge();
-      return valueFromIter(listIter);
+  /// Call this when a lookup finds an entry. A live entry is used, while an expired one
+  /// is erased, invalidating the iterator.
+  /// @return false if the entry had expired, making it a miss
+  bool onValueHit(const MapIter& iter, typename Expirer::TimePoint now) {
+    if (expirer_.isExpired(*iter->second, now)) {
+      eraseIter(iter, LruEvictionReason::Expired);
+      return false;
     }
 
-    // The item already exists - bring it to the front of the list since it's been "used"
+    expirer_.onAccess(*iter->second, now);
     onValueUsed(iter);
-    return valueFromIter(iter);
+    return true;
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Inserts or updates mapped value associated with the given key
-  void put(const KeyType& key, const T& value) {
-    auto iter = map_.find(key);
-    if (iter == map_.end()) {
-      // New item
-      list_.emplace_front(key, value);
-      map_.emplace(key, list_.begin());
-      doAutoPurge();
-    } else {
-      // Item already exists. Update the mapped value and push it to the front
-      valueFromIter(iter) = value;
-      onValueUsed(iter);
-    }
+  template <typename Value>
+  void doPut(const KeyType& key, Value&& value, Duration ttl) {
+    const auto now = expirer_.now();
+    expireSome(now);
+    putOne(key, std::forward<Value>(value), ttl, now);
+    evictions_.flush();
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Inserts or updates mapped value associated with the given key
-  void put(const KeyType& key, T&& value) {
+  /// The work of a put, leaving the expiry and flushing to the caller
+  template <typename Value>
+  void putOne(const KeyType& key, Value&& value, Duration ttl, typename Expirer::TimePoint now) {
+    recordAccess(key, HasAdmission{});
     auto iter = map_.find(key);
     if (iter == map_.end()) {
       // New item
-      list_.emplace_front(key, std::move(value));
-      map_.emplace(key, list_.begin());
-      doAutoPurge();
+      auto listIter = emplaceFront(key, std::forward<Value>(value));
+      map_.emplace(key, listIter);
+      onInserted(listIter, HasAdmission{});
+      expirer_.onWrite(key, *listIter, ttl, now);
+      stats_.insert();
     } else {
       // Item already exists. Update the mapped value and push it to the front
-      valueFromIter(iter) = std::move(value);
+      stats_.update();
+      stats_.evict(LruEvictionReason::Replace);
+      replaceValue(key, valueFromIter(iter), std::forward<Value>(value), HasEvictionListener{});
+      updateWeight(*iter->second);
+      expirer_.onWrite(key, *iter->second, ttl, now);
       onValueUsed(iter);
     }
+    doAutoPurge();
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// @value Will be a copy of the value if it exists, otherwise it is unchanged
-  /// @return true if the value was found
-  bool get(const KeyType& key, T& value) {
-    MapIter iter = map_.find(key);
-    if (iter == map_.end()) {
-      return false;
-    }
+  /// Remove an entry from the list and the map. Any eviction listener is handed the
+  /// entry once it's gone.
+  MapIter eraseIter(ConstMapIter iter, LruEvictionReason reason) {
+    stats_.evict(reason);
+    totalWeight_ -= iter->second->weight();
+    keyIndex_.erase(iter->second->key);
+    onErasing(iter->second, HasAdmission{});
+    return eraseIter(iter, reason, HasEvictionListener{});
+  }
 
-    onValueUsed(iter);
-    value = valueFromIter(iter);
-    return true;
+  MapIter eraseIter(ConstMapIter iter, LruEvictionReason, std::false_type) {
+    list_.erase(iter->second);
+    return map_.erase(iter);
+  }
+
+  MapIter eraseIter(ConstMapIter iter, LruEvictionReason reason, std::true_type) {
+    const auto listIter = iter->second;
+    auto key = std::move(listIter->key);
+    auto value = std::move(listIter->value);
+    list_.erase(listIter);
+    auto next = map_.erase(iter);
+    evictions_.notify(std::move(key), std::move(value), reason);
+    return next;
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Find the cache element with the specified key. If it doesn't exist, end() is
-  /// returned. If it does exist, it will be refreshed to the front of the cache, and
-  /// and a valid Iterator to it is returned.
-  Iterator find(const KeyType& key) {
-    MapIter iter = map_.find(key);
-    if (iter != map_.end()) {
-      onValueUsed(iter);
+  /// Overwrite a value, handing the old one to any eviction listener
+  template <typename Value>
+  void replaceValue(const KeyType&, T& current, Value&& value, std::false_type) {
+    current = std::forward<Value>(value);
+  }
+
+  template <typename Value>
+  void replaceValue(const KeyType& key, T& current, Value&& value, std::true_type) {
+    auto old = std::exchange(current, std::forward<Value>(value));
+    evictions_.notify(key, std::move(old), LruEvictionReason::Replace);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates a new entry at the front of the list and adds in its weight. The caller
+  /// is responsible for the map and the regions.
+  template <typename Value>
+  ListIter emplaceFront(const KeyType& key, Value&& value) {
+    list_.emplace_front(key, std::forward<Value>(value));
+    auto& entry = list_.front();
+    try {
+      entry.setWeight(Weigher{}(entry.key, entry.value));
+      keyIndex_.insert(key);
+    } catch (...) {
+      list_.pop_front();
+      throw;
     }
+    totalWeight_ += entry.weight();
+    return list_.begin();
+  }
 
-    return Iterator(iter);
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Adds a loaded entry as the least recently used, with the policy's default entry
+  /// data. The caller rebuilds the regions.
+  void emplaceBack(const KeyType& key, T&& value, typename Expirer::TimePoint now) {
+    list_.emplace_back(key, std::move(value));
+    auto& entry = list_.back();
+    try {
+      entry.setWeight(Weigher{}(entry.key, entry.value));
+      keyIndex_.insert(key);
+    } catch (...) {
+      list_.pop_back();
+      throw;
+    }
+    totalWeight_ += entry.weight();
+    map_.emplace(key, std::prev(list_.end()));
+    expirer_.onWrite(key, entry, expirer_.defaultTtl(), now);
+    stats_.insert();
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Find the cache element with the specified key. If it doesn't exist, cend() is
-  /// returned. If it does exist, it will be refreshed to the front of the cache, and
-  /// and a valid ConstIterator to it is returned.
-  /// Note that we can't have a `find() const` since find needs to refresh it's cached
-  /// value. Thus to get one with a const iterator there is `cfind`
-  ConstIterator cfind(const KeyType& key) { return find(key); }
+  /// Recomputes an entry's weight after its value changed, adjusting the total in O(1)
+  void updateWeight(Entry& entry) {
+    totalWeight_ -= entry.weight();
+    entry.setWeight(Weigher{}(entry.key, entry.value));
+    totalWeight_ += entry.weight();
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
-  Iterator begin() noexcept { return Iterator(map_.begin()); }
-  Iterator end() noexcept { return Iterator(map_.end()); }
-  ConstIterator cbegin() const noexcept { return ConstIterator(map_.begin()); }
-  ConstIterator cend() const noexcept { return ConstIterator(map_.end()); }
+  /// Purge, doing at most `budget` steps. The most recent item is never purged for weight
+  /// alone, so an item heavier than the maximum weight is still cached (on its own).
+  /// @return The number of entries purged
+  sizex doPurge(sizex budget = ~0_z) { return doPurge(budget, HasAdmission{}); }
 
-  /// Ordered iteration. I suspect this is primarily for debugging/testing, so it's
-  /// not the primary begin/end. ie. you'll have to use a full for loop.
-  OrderedIterator beginOrdered() noexcept { return OrderedIterator(list_.begin()); }
-  OrderedIterator endOrdered() noexcept { return OrderedIterator(list_.end()); }
-  ConstOrderedIterator beginOrdered() const noexcept { return ConstOrderedIterator(list_.cbegin()); }
-  ConstOrderedIterator endOrdered() const noexcept { return ConstOrderedIterator(list_.cend()); }
-  ConstOrderedIterator cbeginOrdered() const noexcept { return ConstOrderedIterator(list_.cbegin()); }
-  ConstOrderedIterator cendOrdered() const noexcept { return ConstOrderedIterator(list_.cend()); }
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Each entry pushed out of the window becomes a candidate for the main region. While
+  /// the cache is over its limit, the candidate duels with the policy's victim and the
+  /// one seen less often is purged. Ties go to the victim, since the candidate hasn't
+  /// proven itself.
+  sizex doPurge(sizex budget, std::true_type) {
+    sizex steps = 0;
+    sizex purged = 0;
+    while (admitter_.windowSize > admitter_.maxWindowSize && steps < budget) {
+      ++steps;
+      const auto candidate = shiftWindow();
+      policy_.onInsert(list_, admitter_.mainBegin, candidate);
+      if (!isOverLimit()) {
+        continue;
+      }
+
+      auto loser = policy_.victim(list_, admitter_.mainBegin);
+      if (loser != candidate &&
+          admitter_.sketch.frequency(sketchHash(candidate->key)) <= admitter_.sketch.frequency(sketchHash(loser->key))) {
+        loser = candidate;
+      }
+      evict(loser);
+      ++purged;
+    }
 
-private:
-  // Clarity Helpers
-  static const KeyType& keyFromIter(const ConstListIter& listIter) noexcept { return (*listIter).first; }
-  static const T& valueFromIter(const ConstListIter& listIter) noexcept { return (*listIter).second; }
-  static T& valueFromIter(const ListIter& listIter) noexcept { return (*listIter).second; }
-  static const KeyType& keyFromIter(const ConstMapIter& mapIter) noexcept { return mapIter->first; }
-  static T& valueFromIter(const ConstMapIter& mapIter) noexcept { return valueFromIter(mapIter->second); }
-  static T& valueFromIter(const MapIter& mapIter) noexcept { return valueFromIter(mapIter->second); }
+    // Only reached when shrinking or for weight, the window's LRU goes once main is empty
+    while (isOverLimit() && steps < budget) {
+      ++steps;
+      evict((admitter_.mainBegin == list_.end()) ? std::prev(list_.end())
+                                                 : policy_.victim(list_, admitter_.mainBegin));
+      ++purged;
+    }
+    return purged;
+  }
+
+  sizex doPurge(sizex budget, std::false_type) {
+    // Delete the policy's victim till our size and weight are ok
+    sizex purged = 0;
+    while (isOverLimit() && purged < budget) {
+      ListIter begin = list_.begin();
+      evict(policy_.victim(list_, begin));
+      ++purged;
+    }
+    return purged;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is there purging left over from an operation that ran out of budget?
+  bool isPurgePending(std::true_type) const noexcept {
+    return admitter_.windowSize > admitter_.maxWindowSize || isOverLimit();
+  }
+  bool isPurgePending(std::false_type) const noexcept { return isOverLimit(); }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Call this when a cached value is used, thus pushing it to the front of the list.
-  void onValueUsed(const ConstMapIter& iter) { list_.splice(list_.begin(), list_, iter->second); }
+  /// Purge an entry for size or weight, letting the policy remember it
+  void evict(ListIter listIter) {
+    if (!listIter->inWindow()) {
+      policy_.onEvict(*listIter);
+    }
+    auto mapIter = map_.find(LruCache::keyFromIter(listIter));
+    SW_ASSERT(mapIter != map_.end());
+    eraseIter(mapIter, LruEvictionReason::Size);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove expired entries as their timing wheel items fire
+  /// @return The number of entries removed
+  sizex doExpire(typename Expirer::TimePoint now, sizex budget) {
+    sizex expired = 0;
+    expirer_.advance(now, budget, [this, now, &expired](const KeyType& key, u64 tick) {
+      auto iter = map_.find(key);
+      if (iter == map_.end() || !expirer_.isLive(*iter->second, tick)) {
+        return;
+      }
+
+      if (expirer_.isExpired(*iter->second, now)) {
+        eraseIter(iter, LruEvictionReason::Expired);
+        ++expired;
+      } else {
+        expirer_.reschedule(key, *iter->second);
+      }
+    });
+    return expired;
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
-  void doPurge() {
-    // Delete the last (aka oldest) item till our size is ok
-    while (size() > maxSize_) {
-      auto listIter = --list_.end();
-      auto mapIter = map_.find(LruCache::keyFromIter(listIter));
-      SW_ASSERT(mapIter != map_.end());
-      map_.erase(mapIter);
-      list_.erase(listIter);
+  /// A little expiry work done by each operation, so the work is spread out, along with
+  /// any purging left over by the purge budget. Should optimize to a NOP when expiry is
+  /// disabled, bar the limit check.
+  void expireSome(typename Expirer::TimePoint now) {
+    doExpire(now, kExpireBudget);
+    if (kAutoPurge && isPurgePending(HasAdmission{})) {
+      doPurge(purgeBudget_);
     }
   }
 
   ////////////////////////////////////////////////////////////////////////////////
-  /// Will auto purge the cache if configured. Should optimize to a NOP when auto
-  /// purge is disabled
+  /// Will auto purge the cache if configured, within the purge budget. Should optimize
+  /// to a NOP when auto purge is disabled
   void doAutoPurge() {
     if (kAutoPurge) {
-      doPurge();
+      doPurge(purgeBudget_);
     }
   }
 
@@ -381,17 +2901,38 @@ private:
   /// Copies the contents of the given cache into this cache, assumes this cache is empty
   void doEmptyCopyFrom(const LruCache& cache) {
     SW_ASSERT(empty());
-    if (cache.empty())
-      return;
-
-    auto iter = cache.cendOrdered();
-    do {
+    for (auto iter = cache.cendOrdered(); iter != cache.cbeginOrdered();) {
       --iter;
       const auto& key = iter.key();
       const auto& value = iter.value();
-      list_.emplace_front(key, value);
-      map_.emplace(key, list_.begin());
-    } while (iter != cache.cbeginOrdered());
+      auto listIter = emplaceFront(key, value);
+      map_.emplace(key, listIter);
+      expirer_.onCopy(key, *listIter, *iter.iter_);
+      listIter->setInWindow(iter.iter_->inWindow());
+      static_cast<PolicyData&>(*listIter) = static_cast<const PolicyData&>(*iter.iter_);
+    }
+    rebuildRegions(HasAdmission{});
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Let the allocator expect the nodes of a full cache, plus the one being inserted
+  void reserveNodes() {
+    auto allocator = map_.get_allocator();
+    lru_detail::reserveNodes(allocator, maxSize_ + 1, 0);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The copied entries kept their region data, so recount the window and let the policy
+  /// find its segments
+  void rebuildRegions(std::false_type) { policy_.rebuild(list_, list_.begin()); }
+  void rebuildRegions(std::true_type) {
+    admitter_.windowSize = 0;
+    admitter_.mainBegin = list_.begin();
+    while (admitter_.mainBegin != list_.end() && admitter_.mainBegin->inWindow()) {
+      ++admitter_.mainBegin;
+      ++admitter_.windowSize;
+    }
+    policy_.rebuild(list_, admitter_.mainBegin);
   }
 
 private:
@@ -399,12 +2940,54 @@ private:
   /// unless you erase the underlying item, thus they're effectively like having a node pointer
   MapType map_;
 
-  /// The list holds the key/value pairs
+  /// The list holds the key/value entries
   ListType list_;
 
   /// Maximum size for the cache (aka max num entries)
   sizex maxSize_ = 10;
 
+  /// Maximum total weight for the cache
+  sizex maxWeight_ = kUnlimitedWeight;
+
+  /// Sum of the weights of all entries
+  sizex totalWeight_ = 0;
+
+  /// Most entries purged by an operation
+  sizex purgeBudget_ = ~0_z;
+
+  /// Tracks entry deadlines. Empty when expiry is disabled.
+  Expirer expirer_;
+
+  /// Hands removed values to the eviction listener
+  EvictionSink evictions_;
+
+  /// Admission window and frequency sketch. Empty without admission.
+  Admitter admitter_;
+
+  /// Orders the list, or the main region with admission, and picks the victims
+  PolicyType policy_;
+
+  /// Counters for `snapshot()`. Empty without stats.
+  StatsRecorder stats_;
+
+  /// Reuse distance sampling for `missRatioCurve()`. Empty without it.
+  MissRatioTracker missRatio_;
+
+  /// Secondary index of the keys for `invalidate()`. Copies rebuild their own.
+  KeyIndex keyIndex_;
+
+  /// Units of expiry work done by each operation
+  static constexpr sizex kExpireBudget = 8;
+
+  /// Entries purged by `purgeFor()` between looks at the clock
+  static constexpr sizex kPurgeStep = 64;
+
+  /// Keys probed ahead by `getMany()` and `putMany()`
+  static constexpr sizex kBatchSize = 16;
+
+  /// Start of a snapshot file, with its format version last
+  static constexpr char kSnapshotMagic[8] = {'S', 'W', 'L', 'R', 'U', 'S', 'N', 1};
+
   // We let the cache and iterators access each other's privates
   friend UnorderedIterator;
   friend ConstUnorderedIterator;
@@ -412,6 +2995,29 @@ private:
   friend ConstOrderedIterator;
 };
 
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr sizex LruCache<Key, T, kAutoPurge, Traits>::kUnlimitedWeight;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr bool LruCache<Key, T, kAutoPurge, Traits>::kHasExpiry;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr bool LruCache<Key, T, kAutoPurge, Traits>::kHasEvictionListener;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr bool LruCache<Key, T, kAutoPurge, Traits>::kHasStats;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr bool LruCache<Key, T, kAutoPurge, Traits>::kHasMissRatio;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr bool LruCache<Key, T, kAutoPurge, Traits>::kHasKeyIndex;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr sizex LruCache<Key, T, kAutoPurge, Traits>::kExpireBudget;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr sizex LruCache<Key, T, kAutoPurge, Traits>::kBatchSize;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr bool LruCache<Key, T, kAutoPurge, Traits>::kPrefetchesBuckets;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr sizex LruCache<Key, T, kAutoPurge, Traits>::kPurgeStep;
+template <typename Key, typename T, bool kAutoPurge, typename Traits>
+constexpr char LruCache<Key, T, kAutoPurge, Traits>::kSnapshotMagic[8];
+
 namespace lru_detail {
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,213 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+namespace lz_detail {
+
+constexpr sizex kMinMatch = 4;
+constexpr sizex kMaxOffset = 65535;
+constexpr u32 kMaxHashBits = 12;
+
+inline u32 read32(const unsigned char* data) noexcept {
+  u32 value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+inline u32 hash4(u32 sequence, u32 hashBits) noexcept { return (sequence * 2654435761u) >> (32 - hashBits); }
+
+////////////////////////////////////////////////////////////////////////////////
+/// Append a length beyond what fit in its nibble
+inline void writeLength(std::string& out, sizex length) {
+  while (length >= 255) {
+    out.push_back(static_cast<char>(255));
+    length -= 255;
+  }
+  out.push_back(static_cast<char>(length));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Append one sequence. A match length of zero means the literals end the input.
+inline void writeSequence(std::string& out, const unsigned char* literals, sizex literalCount, sizex offset,
+                          sizex matchLength) {
+  const auto matchExtra = matchLength == 0 ? 0 : matchLength - kMinMatch;
+  const auto token = (std::min<sizex>(literalCount, 15) << 4u) | std::min<sizex>(matchExtra, 15);
+  out.push_back(static_cast<char>(token));
+  if (literalCount >= 15) {
+    writeLength(out, literalCount - 15);
+  }
+  out.append(reinterpret_cast<const char*>(literals), literalCount);
+  if (matchLength == 0) {
+    return;
+  }
+  out.push_back(static_cast<char>(offset & 0xffu));
+  out.push_back(static_cast<char>(offset >> 8u));
+  if (matchExtra >= 15) {
+    writeLength(out, matchExtra - 15);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Read a length continuing from its nibble. False if the input runs out.
+inline bool readLength(const unsigned char*& in, const unsigned char* end, sizex& length) noexcept {
+  unsigned char next = 255;
+  while (next == 255) {
+    if (in == end) {
+      return false;
+    }
+    next = *in++;
+    length += next;
+  }
+  return true;
+}
+
+}  // namespace lz_detail
+
+////////////////////////////////////////////////////////////////////////////////
+/// Return the most bytes `lzCompress()` can produce for the given input size
+constexpr sizex lzMaxCompressedSize(sizex size) noexcept { return size + size / 255 + 16; }
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A small, fast LZ77 codec in the style of the LZ4 block format, for compressing cached
+/// values. It favours speed over ratio: text and JSON typically shrink 3-5x, at hundreds
+/// of MB/s each way.
+///
+/// The compressed form is a run of sequences. Each starts with a token byte, whose high
+/// nibble is the literal count and low nibble the match length less four. A nibble of 15
+/// continues in the following bytes, each adding up to 255. Then come the literals, then
+/// the match as a two byte little-endian offset back into the output, then any match
+/// length bytes. The final sequence is literals only, and ends the input.
+///
+/// The raw size isn't stored. The caller keeps it and hands it to `lzDecompress()`,
+/// which checks every length and offset against it, so corrupt input fails rather than
+/// overrunning.
+///
+/// Compress the bytes, replacing the contents of `out`
+inline void lzCompress(const char* data, sizex size, std::string& out) {
+  using namespace lz_detail;
+  out.clear();
+  out.reserve(lzMaxCompressedSize(size));
+
+  const auto begin = reinterpret_cast<const unsigned char*>(data);
+  const auto end = begin + size;
+
+  // Positions plus one of the last sequence seen with each hash, zero for none. Small
+  // inputs use part of the table, so there's less of it to clear.
+  u32 hashBits = 8;
+  while (hashBits < kMaxHashBits && (sizex(1) << hashBits) < size) {
+    ++hashBits;
+  }
+  u32 table[1u << kMaxHashBits];
+  std::fill(table, table + (1u << hashBits), 0u);
+
+  const unsigned char* anchor = begin;
+  const unsigned char* pos = begin;
+  while (size >= kMinMatch && pos + kMinMatch <= end) {
+    const auto sequence = read32(pos);
+    auto& slot = table[hash4(sequence, hashBits)];
+    const auto candidate = slot == 0 ? nullptr : begin + (slot - 1);
+    slot = static_cast<u32>(pos - begin) + 1;
+
+    if (candidate == nullptr || static_cast<sizex>(pos - candidate) > kMaxOffset || read32(candidate) != sequence) {
+      // Step further the longer it's been since a match, so incompressible data is fast
+      pos += 1 + (static_cast<sizex>(pos - anchor) >> 6u);
+      continue;
+    }
+
+    auto matchEnd = pos + kMinMatch;
+    auto from = candidate + kMinMatch;
+    while (matchEnd < end && *matchEnd == *from) {
+      ++matchEnd;
+      ++from;
+    }
+    writeSequence(out, anchor, static_cast<sizex>(pos - anchor), static_cast<sizex>(pos - candidate),
+                  static_cast<sizex>(matchEnd - pos));
+    pos = matchEnd;
+    anchor = pos;
+  }
+  writeSequence(out, anchor, static_cast<sizex>(end - anchor), 0, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Decompress bytes made by `lzCompress()`, replacing the contents of `out`
+/// @return false if the input is corrupt or doesn't decompress to exactly `rawSize`
+inline bool lzDecompress(const char* data, sizex size, sizex rawSize, std::string& out) {
+  using namespace lz_detail;
+  out.assign(rawSize, '\0');
+
+  auto in = reinterpret_cast<const unsigned char*>(data);
+  const auto end = in + size;
+  auto dest = reinterpret_cast<unsigned char*>(&out[0]);
+  const auto destBegin = dest;
+  const auto destEnd = dest + rawSize;
+
+  while (in != end) {
+    const auto token = *in++;
+    sizex literalCount = token >> 4u;
+    if (literalCount == 15 && !readLength(in, end, literalCount)) {
+      return false;
+    }
+    if (literalCount > static_cast<sizex>(end - in) || literalCount > static_cast<sizex>(destEnd - dest)) {
+      return false;
+    }
+    std::memcpy(dest, in, literalCount);
+    in += literalCount;
+    dest += literalCount;
+    if (in == end) {
+      break;
+    }
+
+    if (end - in < 2) {
+      return false;
+    }
+    const auto offset = static_cast<sizex>(in[0]) | (static_cast<sizex>(in[1]) << 8u);
+    in += 2;
+    sizex matchLength = token & 15u;
+    if (matchLength == 15 && !readLength(in, end, matchLength)) {
+      return false;
+    }
+    matchLength += kMinMatch;
+    if (offset == 0 || offset > static_cast<sizex>(dest - destBegin) ||
+        matchLength > static_cast<sizex>(destEnd - dest)) {
+      return false;
+    }
+
+    // Byte by byte, since a match may overlap the bytes it's producing
+    const unsigned char* from = dest - offset;
+    for (sizex i = 0; i < matchLength; ++i) {
+      *dest++ = *from++;
+    }
+  }
+  return dest == destEnd;
+}
+
+SW_NAMESPACE_END
@@ -0,0 +1,451 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Memory use and pressure of a cgroup, as read by `readMemoryStatus()`
+struct MemoryStatus {
+  static constexpr u64 kUnlimited = ~0_u64;
+
+  /// Were the cgroup's memory files readable?
+  bool ok = false;
+
+  /// Bytes charged to the cgroup, from `memory.current`
+  u64 current = 0;
+
+  /// Bytes of the page cache the kernel can reclaim first, from `inactive_file` in
+  /// `memory.stat`
+  u64 inactiveFile = 0;
+
+  /// The lower of `memory.max` and `memory.high`, or kUnlimited
+  u64 limit = kUnlimited;
+
+  /// Percent of the last ten seconds some task stalled on memory, from the "some avg10"
+  /// field of `memory.pressure`. Zero when PSI isn't available.
+  double pressure = 0;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the bytes in use less the inactive page cache, which is how kubelet counts
+  /// the working set that it evicts a container over
+  u64 workingSet() const noexcept { return current - std::min(current, inactiveFile); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the fraction of the limit the working set uses, or zero without a limit
+  double usage() const noexcept {
+    return limit == kUnlimited || limit == 0 ? 0.0 : static_cast<double>(workingSet()) / static_cast<double>(limit);
+  }
+};
+
+namespace pressure_detail {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Read a small file such as those in a cgroup or in /proc. False if it can't be read.
+inline bool readSmallFile(const std::string& path, std::string& contents) {
+  auto file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  contents.clear();
+  char buffer[512];
+  sizex count = 0;
+  while ((count = std::fread(buffer, 1, sizeof(buffer), file)) != 0) {
+    contents.append(buffer, count);
+  }
+  std::fclose(file);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse a byte count, or "max" as unlimited
+inline bool parseBytes(const std::string& text, u64& bytes) {
+  if (text.compare(0, 3, "max") == 0) {
+    bytes = MemoryStatus::kUnlimited;
+    return true;
+  }
+  char* end = nullptr;
+  bytes = std::strtoull(text.c_str(), &end, 10);
+  return end != text.c_str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse the "some avg10=" field of a PSI file
+inline bool parsePressure(const std::string& text, double& pressure) {
+  static constexpr char kField[] = "some avg10=";
+  const auto pos = text.find(kField);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  pressure = std::strtod(text.c_str() + pos + sizeof(kField) - 1, nullptr);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse the value of a "name value" line, such as in `memory.stat`
+inline bool parseStatField(const std::string& text, const char* name, u64& value) {
+  const auto field = std::string(name) + ' ';
+  sizex pos = 0;
+  while (pos < text.size()) {
+    if (text.compare(pos, field.size(), field) == 0) {
+      return parseBytes(text.substr(pos + field.size()), value);
+    }
+    pos = text.find('\n', pos);
+    if (pos == std::string::npos) {
+      break;
+    }
+    ++pos;
+  }
+  return false;
+}
+
+}  // namespace pressure_detail
+
+////////////////////////////////////////////////////////////////////////////////
+/// Return the cgroup v2 directory of the calling process, from its "0::" line in
+/// `/proc/self/cgroup`, under the cgroup mount. In a container with its own cgroup
+/// namespace, that's the mount itself. Otherwise, such as on a host or in a container
+/// sharing the host's namespace, the mount is the root cgroup, which has no
+/// `memory.current`, and the process's cgroup is somewhere below it. The mount is
+/// returned if the file can't be read or has no cgroup v2 line.
+inline std::string ownCgroupPath(const std::string& mount = "/sys/fs/cgroup",
+                                 const std::string& procFile = "/proc/self/cgroup") {
+  std::string text;
+  if (!pressure_detail::readSmallFile(procFile, text)) {
+    return mount;
+  }
+  for (sizex pos = 0; pos < text.size();) {
+    auto end = text.find('\n', pos);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    if (text.compare(pos, 3, "0::") == 0) {
+      const auto path = text.substr(pos + 3, end - pos - 3);
+      return path.empty() || path == "/" ? mount : mount + path;
+    }
+    pos = end + 1;
+  }
+  return mount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Read the memory use, limit and pressure of the cgroup v2 directory, by default the
+/// process's own (see `ownCgroupPath()`). Missing `memory.max`, `memory.high`,
+/// `memory.stat` or `memory.pressure` files count as no limit, no inactive page cache
+/// and no pressure, and `ok` is false only when `memory.current` can't be read.
+inline MemoryStatus readMemoryStatus(const std::string& cgroupPath = ownCgroupPath()) {
+  MemoryStatus status;
+  std::string text;
+  if (!pressure_detail::readSmallFile(cgroupPath + "/memory.current", text) ||
+      !pressure_detail::parseBytes(text, status.current)) {
+    return status;
+  }
+  status.ok = true;
+
+  u64 bytes = 0;
+  for (const char* name : {"/memory.max", "/memory.high"}) {
+    if (pressure_detail::readSmallFile(cgroupPath + name, text) && pressure_detail::parseBytes(text, bytes)) {
+      status.limit = std::min(status.limit, bytes);
+    }
+  }
+  if (pressure_detail::readSmallFile(cgroupPath + "/memory.stat", text)) {
+    pressure_detail::parseStatField(text, "inactive_file", status.inactiveFile);
+  }
+  if (pressure_detail::readSmallFile(cgroupPath + "/memory.pressure", text)) {
+    pressure_detail::parsePressure(text, status.pressure);
+  }
+  return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Watermarks and step sizes for `MemoryPressureMonitor`
+struct MemoryPressureOptions {
+  /// The cgroup v2 directory to read. Empty means the process's own, as found by
+  /// `ownCgroupPath()` when the monitor is created.
+  std::string cgroupPath;
+
+  /// Fraction of the limit in use that starts shrinking
+  double highWatermark = 0.9;
+
+  /// Fraction of the limit in use under which caches grow back
+  double lowWatermark = 0.8;
+
+  /// PSI "some avg10" percentage that starts shrinking, whatever the usage
+  double pressureThreshold = 10.0;
+
+  /// Fraction of the current limits given back on each pressured poll
+  double shrinkStep = 0.1;
+
+  /// Fraction of the current limits taken back on each relaxed poll
+  double growStep = 0.05;
+
+  /// Caches never shrink below this fraction of their registered limits
+  double minScale = 0.1;
+
+  /// Most entries any cache evicts in one operation, and on each poll, while shrinking
+  sizex purgeBudget = 256;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// Shrinks registered caches while the container is short of memory, and grows them
+/// back once it isn't, so caches can run close to a hard limit without the OOM killer
+/// getting there first.
+///
+/// Each `poll()` reads the cgroup's memory status. Usage counts the working set, which
+/// leaves out the page cache the kernel can drop, as kubelet does when it decides which
+/// pod to evict. When usage is over the high watermark, or the PSI stall percentage is
+/// over the pressure threshold, every cache is scaled down by `shrinkStep` of its
+/// current limit, down to `minScale` of its registered limit. When usage is under the
+/// low watermark and the pressure has eased to half the threshold, they grow back by
+/// `growStep` at a time. In between, nothing changes, so the limits don't flap around
+/// the watermark.
+///
+/// All caches are scaled by the same fraction of the limit they had when registered, by
+/// either `maxSize` or `maxWeight`. Any later change to that limit by the owner is
+/// overridden on the next rescale.
+///
+/// Shrinking never evicts everything at once. Each cache is given a purge budget, so
+/// `setMaxSize()` only evicts that many entries, and the rest happen a budget at a time,
+/// as the cache is used and on every later poll.
+///
+/// # Threading
+/// The caches are called from whichever thread polls. A `ConcurrentLruCache` can be
+/// polled from the monitor's own thread with `start()`, but a plain `LruCache` must only
+/// be polled from the thread that uses it. Removing a cache waits for any poll in
+/// progress, so the cache can be destroyed right after.
+////////////////////////////////////////////////////////////////////////////////
+class MemoryPressureMonitor {
+public:
+  using Options = MemoryPressureOptions;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  explicit MemoryPressureMonitor(Options options = Options()) : options_(withCgroupPath(std::move(options))) {}
+
+  // Holds a mutex and maybe a thread, so no move/copy
+  MemoryPressureMonitor(const MemoryPressureMonitor&) = delete;
+  MemoryPressureMonitor& operator=(const MemoryPressureMonitor&) = delete;
+  MemoryPressureMonitor(MemoryPressureMonitor&&) = delete;
+  MemoryPressureMonitor& operator=(MemoryPressureMonitor&&) = delete;
+
+  ~MemoryPressureMonitor() { stop(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Register a cache to scale by its maximum size. The cache needs `maxSize()`,
+  /// `setMaxSize()`, `setPurgeBudget()` and `purgeSome()`, like `LruCache` and
+  /// `ConcurrentLruCache`. It must outlive its registration.
+  /// @return The id to remove the cache with
+  template <typename Cache>
+  u64 addCache(Cache& cache) {
+    const auto base = cache.maxSize();
+    return addPurgeable([&cache, base](double scale) { cache.setMaxSize(scaled(base, scale)); }, cache);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Register a cache to scale by its maximum weight, such as an `LruCache` weighed in
+  /// bytes. Otherwise the same as `addCache()`.
+  template <typename Cache>
+  u64 addCacheByWeight(Cache& cache) {
+    const auto base = cache.maxWeight();
+    return addPurgeable([&cache, base](double scale) { cache.setMaxWeight(scaled(base, scale)); }, cache);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Register any other memory user. `rescale(double)` is given the fraction of its full
+  /// size to shrink or grow to, and `purge(sizex budget)` does a budget of deferred
+  /// eviction, returning how much it did.
+  u64 addClient(std::function<void(double)> rescale, std::function<sizex(sizex)> purge) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (scale_ < 1.0) {
+      rescale(scale_);
+    }
+    clients_.push_back(Client{++lastId_, std::move(rescale), std::move(purge)});
+    return lastId_;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Unregister a cache, leaving its limit as it is. Waits for any poll in progress.
+  /// @return false if there is no such id
+  bool removeCache(u64 id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = std::find_if(clients_.begin(), clients_.end(), [id](const Client& c) { return c.id == id; });
+    if (iter == clients_.end()) {
+      return false;
+    }
+    clients_.erase(iter);
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the fraction of their registered limits the caches are scaled to
+  double scale() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scale_;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the status read by the last poll
+  MemoryStatus lastStatus() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return status_;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Read the cgroup and rescale the caches if needed, then do a budget of deferred
+  /// eviction in each
+  /// @return The scale the caches are at
+  double poll() { return update(readMemoryStatus(options_.cgroupPath)); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// `poll()` with a status from elsewhere. An unreadable status changes nothing.
+  double update(const MemoryStatus& status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_ = status;
+
+    auto newScale = scale_;
+    if (status.ok) {
+      const auto usage = status.usage();
+      if (usage >= options_.highWatermark || status.pressure >= options_.pressureThreshold) {
+        newScale = std::max(scale_ * (1.0 - options_.shrinkStep), options_.minScale);
+      } else if (usage < options_.lowWatermark && status.pressure < options_.pressureThreshold / 2) {
+        newScale = std::min(scale_ * (1.0 + options_.growStep), 1.0);
+      }
+    }
+
+    if (newScale != scale_) {
+      scale_ = newScale;
+      for (auto& client : clients_) {
+        client.rescale(scale_);
+      }
+    }
+    for (auto& client : clients_) {
+      client.purge(options_.purgeBudget);
+    }
+    return scale_;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Poll on a thread of the monitor's own, every interval, until `stop()`. Every
+  /// registered cache must be thread-safe.
+  template <typename Rep, typename Period>
+  void start(std::chrono::duration<Rep, Period> interval) {
+    stop();
+    std::lock_guard<std::mutex> lock(threadMutex_);
+    stopping_ = false;
+    thread_ = std::thread([this, interval]() {
+      std::unique_lock<std::mutex> threadLock(threadMutex_);
+      while (!threadWake_.wait_for(threadLock, interval, [this]() { return stopping_; })) {
+        threadLock.unlock();
+        poll();
+        threadLock.lock();
+      }
+    });
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Stop the polling thread, if started, waiting for it to finish
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(threadMutex_);
+      stopping_ = true;
+    }
+    threadWake_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+private:
+  struct Client {
+    u64 id;
+    std::function<void(double)> rescale;
+    std::function<sizex(sizex)> purge;
+  };
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Resolve an empty cgroup path to the process's own cgroup
+  static Options withCgroupPath(Options options) {
+    if (options.cgroupPath.empty()) {
+      options.cgroupPath = ownCgroupPath();
+    }
+    return options;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The base limit scaled down, clamped to the base first, since an unlimited base such
+  /// as `LruCache::kUnlimitedWeight` rounds up to 2^64 as a double, which a sizex can't hold
+  static sizex scaled(sizex base, double scale) noexcept {
+    const auto limit = static_cast<double>(base) * scale;
+    if (limit >= static_cast<double>(base)) {
+      return base;
+    }
+    return std::max(static_cast<sizex>(limit), 1_z);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Give the cache the purge budget, and register it with its own `purgeSome()`
+  template <typename Cache>
+  u64 addPurgeable(std::function<void(double)> rescale, Cache& cache) {
+    cache.setPurgeBudget(options_.purgeBudget);
+    return addClient(std::move(rescale), [&cache](sizex budget) { return cache.purgeSome(budget); });
+  }
+
+private:
+  const Options options_;
+
+  /// Guards the clients, scale and status
+  mutable std::mutex mutex_;
+
+  std::vector<Client> clients_;
+
+  /// Id of the last client added
+  u64 lastId_ = 0;
+
+  /// Fraction of their registered limits the clients are scaled to
+  double scale_ = 1.0;
+
+  /// The status from the last update
+  MemoryStatus status_;
+
+  /// Guards the polling thread's stop flag
+  std::mutex threadMutex_;
+  std::condition_variable threadWake_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+SW_NAMESPACE_END
@@ -0,0 +1,282 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// Estimates the miss ratio an LRU cache would have at every size up to a maximum, from
+/// the stream of accessed keys, using spatially hashed sampling (SHARDS).
+///
+/// An LRU cache of size C hits exactly when the reuse distance, the number of distinct
+/// keys used since the key's last use, is less than C. So a histogram of reuse distances
+/// gives the whole miss ratio curve at once. Measuring every distance is costly, so only
+/// keys whose hash falls under a threshold are tracked, about `samplingRate` of them.
+/// Since a key is either always or never sampled, distances among the sampled keys scale
+/// up by 1 / rate to the full stream's. Each sampled access then stands in for 1 / rate
+/// accesses in the histogram.
+///
+/// Memory is bounded by `maxSamples` tracked keys. When there are more, the threshold is
+/// lowered, dropping the keys with the highest hashes and lowering the rate. Each access
+/// costs a hash comparison, and a sampled access an O(log n) distance count.
+///
+/// Hashes should already be well mixed, such as from `FrequencySketch::spread()`.
+////////////////////////////////////////////////////////////////////////////////
+class MissRatioEstimator {
+public:
+  /// A point on the curve
+  struct Point {
+    sizex cacheSize;
+    double missRatio;
+  };
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the estimator for cache sizes up to `maxCacheSize`, in `buckets` steps
+  explicit MissRatioEstimator(sizex maxCacheSize = 1024, sizex buckets = 64, double samplingRate = 0.01,
+                              sizex maxSamples = 16384) :
+      bucketSize_(std::max((maxCacheSize + buckets - 1) / std::max(buckets, 1_z), 1_z)),
+      histogram_(std::max(buckets, 1_z), 0.0),
+      maxSamples_(std::max(maxSamples, 1_z)) {
+    const auto rate = std::min(std::max(samplingRate, 1.0 / kModulus), 1.0);
+    threshold_ = static_cast<u64>(rate * kModulus);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Count an access of the key with the given hash
+  void access(u64 hash) {
+    ++references_;
+    const auto spatial = hash & (kModulus - 1);
+    if (spatial >= threshold_) {
+      return;
+    }
+
+    const auto weight = 1.0 / samplingRate();
+    auto iter = lastAccess_.find(hash);
+    if (iter == lastAccess_.end()) {
+      cold_ += weight;
+      iter = lastAccess_.emplace(hash, 0).first;
+      bySpatial_.emplace(spatial, hash);
+    } else {
+      const auto distance = static_cast<double>(countAfter(iter->second)) * weight;
+      const auto bucket = static_cast<sizex>(distance) / bucketSize_;
+      if (bucket < histogram_.size()) {
+        histogram_[bucket] += weight;
+      } else {
+        beyond_ += weight;
+      }
+      addAt(iter->second, -1);
+      iter->second = 0;
+    }
+
+    if (now_ + 1 >= tree_.size()) {
+      compact();
+    }
+    iter->second = ++now_;
+    addAt(now_, 1);
+
+    if (lastAccess_.size() > maxSamples_) {
+      lowerThreshold();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the estimated miss ratio of an LRU cache of the given size, rounded down to
+  /// a bucket boundary. Sizes past the maximum get the maximum's ratio.
+  double missRatio(sizex cacheSize) const noexcept {
+    const auto buckets = std::min(cacheSize / bucketSize_, histogram_.size());
+    double hits = 0;
+    double total = cold_ + beyond_;
+    for (sizex i = 0; i < histogram_.size(); ++i) {
+      total += histogram_[i];
+      hits += (i < buckets) ? histogram_[i] : 0.0;
+    }
+    return total > 0 ? 1.0 - hits / total : 0.0;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the miss ratio at each bucket boundary, smallest size first
+  std::vector<Point> curve() const {
+    std::vector<Point> result;
+    result.reserve(histogram_.size());
+    for (sizex i = 1; i <= histogram_.size(); ++i) {
+      result.push_back(Point{i * bucketSize_, missRatio(i * bucketSize_)});
+    }
+    return result;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the estimated accesses per reuse distance bucket. Bucket `i` holds the
+  /// distances `[i * bucketSize(), (i + 1) * bucketSize())`.
+  const std::vector<double>& histogram() const noexcept { return histogram_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the width of each histogram bucket, in entries
+  sizex bucketSize() const noexcept { return bucketSize_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the estimated accesses of keys never seen before
+  double coldMisses() const noexcept { return cold_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the estimated accesses with a reuse distance past the last bucket
+  double beyondMax() const noexcept { return beyond_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of accesses, sampled or not
+  u64 references() const noexcept { return references_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the fraction of keys currently sampled
+  double samplingRate() const noexcept { return static_cast<double>(threshold_) / kModulus; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of keys being tracked
+  sizex samples() const noexcept { return lastAccess_.size(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Forget everything but the configuration and the current sampling rate
+  void clear() {
+    lastAccess_.clear();
+    bySpatial_ = SpatialQueue();
+    tree_.clear();
+    now_ = 0;
+    std::fill(histogram_.begin(), histogram_.end(), 0.0);
+    cold_ = 0;
+    beyond_ = 0;
+    references_ = 0;
+  }
+
+private:
+  /// The spatial hash is the hash modulo this
+  static constexpr u64 kModulus = 1_u64 << 24u;
+
+  struct IdentityHash {
+    sizex operator()(u64 hash) const noexcept { return static_cast<sizex>(hash); }
+  };
+
+  using SpatialQueue = std::priority_queue<std::pair<u64, u64>>;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Count the tracked keys last used after the given time, using the Fenwick tree of
+  /// last use times
+  sizex countAfter(sizex time) const noexcept { return prefix(now_) - prefix(time); }
+
+  sizex prefix(sizex time) const noexcept {
+    sizex sum = 0;
+    for (; time > 0; time &= time - 1) {
+      sum += tree_[time];
+    }
+    return sum;
+  }
+
+  void addAt(sizex time, int delta) noexcept {
+    for (; time < tree_.size(); time += time & (~time + 1)) {
+      tree_[time] += static_cast<sizex>(delta);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Renumber the last use times from 1, keeping their order, and leave room for as many
+  /// accesses again before the next compaction
+  void compact() {
+    std::vector<std::pair<sizex, u64>> byTime;
+    byTime.reserve(lastAccess_.size());
+    for (const auto& kv : lastAccess_) {
+      if (kv.second != 0) {
+        byTime.emplace_back(kv.second, kv.first);
+      }
+    }
+    std::sort(byTime.begin(), byTime.end());
+
+    tree_.assign(2 * byTime.size() + kMinTreeSize, 0);
+    now_ = 0;
+    for (const auto& item : byTime) {
+      lastAccess_[item.second] = ++now_;
+      tree_[now_] = 1;
+    }
+    for (sizex i = 1; i < tree_.size(); ++i) {
+      const auto parent = i + (i & (~i + 1));
+      if (parent < tree_.size()) {
+        tree_[parent] += tree_[i];
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Drop the keys with the highest spatial hash, lowering the rate to exclude them
+  void lowerThreshold() {
+    threshold_ = bySpatial_.top().first;
+    while (!bySpatial_.empty() && bySpatial_.top().first >= threshold_) {
+      auto iter = lastAccess_.find(bySpatial_.top().second);
+      SW_ASSERT(iter != lastAccess_.end());
+      addAt(iter->second, -1);
+      lastAccess_.erase(iter);
+      bySpatial_.pop();
+    }
+  }
+
+private:
+  static constexpr sizex kMinTreeSize = 1024;
+
+  /// Width of a histogram bucket
+  sizex bucketSize_;
+
+  /// Estimated accesses per reuse distance bucket
+  std::vector<double> histogram_;
+
+  /// Estimated accesses of new keys, and with distances past the histogram
+  double cold_ = 0;
+  double beyond_ = 0;
+
+  /// Most keys tracked at once
+  sizex maxSamples_;
+
+  /// Keys whose spatial hash is below this are sampled
+  u64 threshold_ = 0;
+
+  /// Accesses, sampled or not
+  u64 references_ = 0;
+
+  /// Last use time of each tracked key, by hash. Zero while a key is being moved.
+  std::unordered_map<u64, sizex, IdentityHash> lastAccess_;
+
+  /// Tracked keys, highest spatial hash first
+  SpatialQueue bySpatial_;
+
+  /// Fenwick tree with a one at each tracked key's last use time
+  std::vector<sizex> tree_;
+
+  /// Latest use time
+  sizex now_ = 0;
+};
+
+SW_NAMESPACE_END
@@ -0,0 +1,318 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A free-list pool of fixed-size blocks, carved from large slabs. Node based containers
+/// such as `std::list` and `std::unordered_map` allocate one node per element, so a
+/// container that keeps erasing and inserting, like a full cache replacing entries,
+/// can recycle the freed nodes rather than going back to the global allocator each time.
+///
+/// Each distinct block size gets its own free list. A freed block goes onto the front of
+/// its list and is the next one handed out, which keeps recently touched memory hot.
+/// Slabs are only returned when the pool is destroyed.
+///
+/// Slabs grow geometrically, starting small, until the expected node count given to
+/// `reserve()` is reached. So an idle pool costs little, and a pool sized for its workload
+/// stops growing once it's full.
+///
+/// Not thread-safe, it's meant to be owned by a single container or cache.
+////////////////////////////////////////////////////////////////////////////////
+class NodePool {
+public:
+  /// Nodes in the first slab of each block size
+  static constexpr sizex kMinSlabNodes = 16;
+
+  NodePool() = default;
+
+  // Owns the slabs, so no move/copy
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+  NodePool(NodePool&&) = delete;
+  NodePool& operator=(NodePool&&) = delete;
+
+  ~NodePool() {
+    for (auto slab : slabs_) {
+      ::operator delete(slab);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Expect about `nodes` live blocks of each size. Slabs grow until they hold this many.
+  void reserve(sizex nodes) noexcept { expected_ = std::max(nodes, sizex{kMinSlabNodes}); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return a block of at least `size` bytes, aligned for `align`. Throws std::bad_alloc.
+  void* allocate(sizex size, sizex align) {
+    if (align > alignof(std::max_align_t)) {
+      ++upstreamAllocations_;
+      return allocateUpstream(size, align);
+    }
+
+    auto& sizeClass = classFor(blockSize(size, align));
+    if (sizeClass.freeList != nullptr) {
+      auto node = sizeClass.freeList;
+      sizeClass.freeList = node->next;
+      return node;
+    }
+
+    if (sizeClass.carveLeft == 0) {
+      addSlab(sizeClass);
+    }
+    auto block = sizeClass.carve;
+    sizeClass.carve += sizeClass.size;
+    --sizeClass.carveLeft;
+    return block;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return a block from `allocate()`, with the same size and alignment, to its free list
+  void deallocate(void* block, sizex size, sizex align) noexcept {
+    if (align > alignof(std::max_align_t)) {
+      deallocateUpstream(block, align);
+      return;
+    }
+
+    auto& sizeClass = classFor(blockSize(size, align));
+    auto node = static_cast<FreeNode*>(block);
+    node->next = sizeClass.freeList;
+    sizeClass.freeList = node;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return how many times the pool went to the global allocator, either for a slab or
+  /// for a block it can't pool
+  sizex upstreamAllocations() const noexcept { return upstreamAllocations_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Count a block, such as a hash table's bucket array, allocated outside of the pool
+  void countUpstream() noexcept { ++upstreamAllocations_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Allocate from the global allocator, aligned for `align`. Before C++17 operator new
+  /// only aligns for std::max_align_t, so a stricter alignment over-allocates and keeps
+  /// the original address just before the block. Throws std::bad_alloc.
+  static void* allocateUpstream(sizex size, sizex align) {
+    if (align <= alignof(std::max_align_t)) {
+      return ::operator new(size);
+    }
+
+    SW_ASSERT((align & (align - 1)) == 0);
+    const auto extra = align + sizeof(void*);
+    if (size > ~0_z - extra) {
+      throw std::bad_alloc();
+    }
+    auto raw = static_cast<char*>(::operator new(size + extra));
+    auto addr = reinterpret_cast<std::uintptr_t>(raw + sizeof(void*));
+    addr = (addr + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+    auto block = reinterpret_cast<void**>(addr);
+    block[-1] = raw;
+    return block;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return a block from `allocateUpstream()`, with the same alignment
+  static void deallocateUpstream(void* block, sizex align) noexcept {
+    if (align <= alignof(std::max_align_t)) {
+      ::operator delete(block);
+    } else {
+      ::operator delete(static_cast<void**>(block)[-1]);
+    }
+  }
+
+private:
+  struct FreeNode {
+    FreeNode* next;
+  };
+
+  struct SizeClass {
+    /// Block size in bytes
+    sizex size = 0;
+
+    /// Freed blocks, most recent first
+    FreeNode* freeList = nullptr;
+
+    /// Next never used block in the newest slab
+    char* carve = nullptr;
+
+    /// Never used blocks left in the newest slab
+    sizex carveLeft = 0;
+
+    /// Blocks in all the slabs so far
+    sizex capacity = 0;
+  };
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Round up so every block in a slab stays aligned and can hold a free list link
+  static sizex blockSize(sizex size, sizex align) noexcept {
+    align = std::max(align, alignof(FreeNode));
+    size = std::max(size, sizeof(FreeNode));
+    return (size + align - 1) / align * align;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the size class for the block size. A pool seldom sees more than a few sizes.
+  SizeClass& classFor(sizex size) {
+    for (auto& sizeClass : classes_) {
+      if (sizeClass.size == size) {
+        return sizeClass;
+      }
+    }
+    classes_.emplace_back();
+    classes_.back().size = size;
+    return classes_.back();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Allocate the next slab for the size class. It doubles the capacity, but doesn't
+  /// overshoot the expected node count until that's been reached.
+  void addSlab(SizeClass& sizeClass) {
+    auto nodes = std::max(sizeClass.capacity, sizex{kMinSlabNodes});
+    if (sizeClass.capacity < expected_) {
+      nodes = std::min(nodes, expected_ - sizeClass.capacity);
+    }
+    if (nodes > (~0_z / sizeClass.size)) {
+      throw std::bad_alloc();
+    }
+
+    slabs_.reserve(slabs_.size() + 1);
+    auto slab = static_cast<char*>(::operator new(nodes * sizeClass.size));
+    slabs_.push_back(slab);
+    ++upstreamAllocations_;
+
+    sizeClass.carve = slab;
+    sizeClass.carveLeft = nodes;
+    sizeClass.capacity += nodes;
+  }
+
+private:
+  /// One per distinct block size
+  std::vector<SizeClass> classes_;
+
+  /// Every slab, freed with the pool
+  std::vector<void*> slabs_;
+
+  /// Node count the slabs grow to before growing further
+  sizex expected_ = kMinSlabNodes;
+
+  /// Slabs and unpooled blocks from the global allocator
+  sizex upstreamAllocations_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// A std allocator drawing single nodes from a shared `NodePool`. Arrays, such as hash
+/// table buckets, go to the global allocator as usual.
+///
+/// Rebound copies share the pool, so a container's node allocations all land in the
+/// same pool, and a default constructed allocator creates a new one. Copying a container
+/// gives the copy its own pool, while moving a container keeps the pool with the nodes.
+template <typename T>
+class NodePoolAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the allocator with a new pool
+  NodePoolAllocator() : pool_(std::make_shared<NodePool>()) {}
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the allocator sharing the given allocator's pool
+  template <typename U>
+  NodePoolAllocator(const NodePoolAllocator<U>& that) noexcept : pool_(that.pool_) {}
+
+  // Copies share the pool. There's no move, so a moved-from allocator still works.
+  NodePoolAllocator(const NodePoolAllocator& that) noexcept : pool_(that.pool_) {}
+  NodePoolAllocator& operator=(const NodePoolAllocator& that) noexcept {
+    pool_ = that.pool_;
+    return *this;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// See std::allocator::allocate
+  T* allocate(sizex count) {
+    if (count == 1) {
+      return static_cast<T*>(pool_->allocate(sizeof(T), alignof(T)));
+    }
+
+    if (count > (~0_z / sizeof(T))) {
+      throw std::bad_alloc();
+    }
+    pool_->countUpstream();
+    return static_cast<T*>(NodePool::allocateUpstream(count * sizeof(T), alignof(T)));
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// See std::allocator::deallocate
+  void deallocate(T* addr, sizex count) noexcept {
+    if (count == 1) {
+      pool_->deallocate(addr, sizeof(T), alignof(T));
+    } else {
+      NodePool::deallocateUpstream(addr, alignof(T));
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// A copied container gets a pool of its own
+  NodePoolAllocator select_on_container_copy_construction() const { return NodePoolAllocator(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Expect about `nodes` live nodes of each type. See `NodePool::reserve()`.
+  void reserveNodes(sizex nodes) noexcept { pool_->reserve(nodes); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the shared pool
+  NodePool& pool() const noexcept { return *pool_; }
+
+  template <typename U>
+  bool operator==(const NodePoolAllocator<U>& that) const noexcept {
+    return pool_ == that.pool_;
+  }
+  template <typename U>
+  bool operator!=(const NodePoolAllocator<U>& that) const noexcept {
+    return pool_ != that.pool_;
+  }
+
+private:
+  template <typename U>
+  friend class NodePoolAllocator;
+
+  std::shared_ptr<NodePool> pool_;
+};
+
+SW_NAMESPACE_END
@@ -0,0 +1,255 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/strings.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A `KeyIndex` for an `LruCache` keyed by paths, either `PosixPath` or `std::string`,
+/// so that `invalidate("/a/b")` erases "/a/b" and everything under it, such as once a
+/// directory has changed:
+///    struct PathTraits : LruCacheTraits<PosixPath, Result> {
+///      using KeyIndex = PathPrefixIndex;
+///    };
+///    LruCache<PosixPath, Result, true, PathTraits> cache;
+///
+/// It's a prefix tree of path segments. Every node counts the keys at or below it, and
+/// nodes left with none are pruned, so every node under a prefix leads to a key.
+/// Invalidating thus takes time proportional to the keys matched and their depth,
+/// however big the cache is.
+///
+/// Matching is lexical: "/a/b" matches "/a/b/c" but not "/a/bc", and a trailing
+/// separator on the prefix is ignored. Paths are not normalized here, so keys and
+/// prefixes should be normalized alike. "/" matches every absolute path, and an empty
+/// prefix matches every key.
+////////////////////////////////////////////////////////////////////////////////
+class PathPrefixIndex {
+  /// Orders segments by their bytes, so they can be looked up by a view
+  struct SegmentLess {
+    using is_transparent = void;
+
+    template <typename Lhs, typename Rhs>
+    bool operator()(const Lhs& lhs, const Rhs& rhs) const noexcept {
+      const auto left = asView(lhs);
+      const auto right = asView(rhs);
+      const auto size = std::min(left.size(), right.size());
+      const auto order = size != 0 ? std::memcmp(left.data(), right.data(), size) : 0;
+      return order < 0 || (order == 0 && left.size() < right.size());
+    }
+  };
+
+  struct Node;
+  using Children = std::map<std::string, std::unique_ptr<Node>, SegmentLess>;
+
+  struct Node {
+    Children children;
+
+    /// Keys at or below this node
+    sizex keys = 0;
+
+    /// Is this node's path a key?
+    bool isKey = false;
+  };
+
+public:
+  static constexpr char kSep = '/';
+
+  PathPrefixIndex() = default;
+
+  // The cache rebuilds its index as it copies entries, so only moves are needed
+  PathPrefixIndex(const PathPrefixIndex&) = delete;
+  PathPrefixIndex& operator=(const PathPrefixIndex&) = delete;
+  PathPrefixIndex(PathPrefixIndex&&) = default;
+  PathPrefixIndex& operator=(PathPrefixIndex&&) = default;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of indexed keys
+  sizex size() const noexcept { return root_.keys; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  bool empty() const noexcept { return size() == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Add a key. Adding it again does nothing.
+  template <typename Key>
+  void insert(const Key& key) {
+    trail_.clear();
+    Node* node = &root_;
+    forEachKeySegment(asView(key), [&](const StringView& segment) {
+      auto iter = node->children.find(segment);
+      if (iter == node->children.end()) {
+        iter = node->children.emplace(std::string(segment.data(), segment.size()), std::unique_ptr<Node>(new Node))
+                   .first;
+      }
+      trail_.push_back(node);
+      node = iter->second.get();
+    });
+
+    if (!node->isKey) {
+      node->isKey = true;
+      ++node->keys;
+      for (auto parent : trail_) {
+        ++parent->keys;
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a key, pruning the nodes that no longer lead to any
+  template <typename Key>
+  void erase(const Key& key) {
+    trail_.clear();
+    childTrail_.clear();
+    Node* node = &root_;
+    forEachKeySegment(asView(key), [&](const StringView& segment) {
+      if (node == nullptr) {
+        return;
+      }
+      auto iter = node->children.find(segment);
+      if (iter == node->children.end()) {
+        node = nullptr;
+        return;
+      }
+      trail_.push_back(node);
+      childTrail_.push_back(iter);
+      node = iter->second.get();
+    });
+
+    if (node == nullptr || !node->isKey) {
+      return;
+    }
+    node->isKey = false;
+    --node->keys;
+    for (auto i = trail_.size(); i-- > 0;) {
+      if (childTrail_[i]->second->keys == 0) {
+        trail_[i]->children.erase(childTrail_[i]);
+      }
+      --trail_[i]->keys;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove every key
+  void clear() noexcept {
+    root_.children.clear();
+    root_.keys = 0;
+    root_.isKey = false;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Append the keys at or under the prefix, built from their path strings
+  template <typename Key>
+  void collect(const StringView& prefix, std::vector<Key>& keys) const {
+    if (prefix.empty()) {
+      std::string path;
+      collectFrom(root_, path, false, keys);
+      return;
+    }
+
+    auto view = prefix;
+    if (view.back() == kSep) {
+      view = StringView(view.data(), view.size() - 1);
+    }
+
+    const Node* node = &root_;
+    forEachSegment(view, [&](const StringView& segment) {
+      if (node == nullptr) {
+        return;
+      }
+      auto iter = node->children.find(segment);
+      node = iter != node->children.end() ? iter->second.get() : nullptr;
+    });
+
+    if (node != nullptr) {
+      std::string path(view.data(), view.size());
+      collectFrom(*node, path, true, keys);
+    }
+  }
+
+private:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Call `func(const StringView&)` with each segment of a key. The empty key has none,
+  /// so it's the root itself, apart from the root of the absolute paths.
+  template <typename Func>
+  static void forEachKeySegment(const StringView& path, Func&& func) {
+    if (!path.empty()) {
+      forEachSegment(path, std::forward<Func>(func));
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Call `func(const StringView&)` with each segment between separators. An empty path
+  /// is one empty segment, and a leading separator gives an empty first segment, so
+  /// absolute and relative paths never share a node. An empty prefix thus stands for
+  /// the root of the absolute paths, once "/" has lost its trailing separator.
+  template <typename Func>
+  static void forEachSegment(const StringView& path, Func&& func) {
+    sizex start = 0;
+    while (true) {
+      auto end = start;
+      while (end < path.size() && path[end] != kSep) {
+        ++end;
+      }
+      func(StringView(path.data() + start, end - start));
+      if (end == path.size()) {
+        return;
+      }
+      start = end + 1;
+    }
+  }
+
+  template <typename Key>
+  static void collectFrom(const Node& node, std::string& path, bool hasPath, std::vector<Key>& keys) {
+    if (node.isKey) {
+      keys.emplace_back(path);
+    }
+
+    const auto size = path.size();
+    for (const auto& child : node.children) {
+      if (hasPath) {
+        path += kSep;
+      }
+      path += child.first;
+      collectFrom(*child.second, path, true, keys);
+      path.resize(size);
+    }
+  }
+
+private:
+  Node root_;
+
+  /// Scratch for the nodes along a key's path, and the child taken from each
+  std::vector<Node*> trail_;
+  std::vector<Children::iterator> childTrail_;
+};
+
+SW_NAMESPACE_END
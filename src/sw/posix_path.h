@@ -23,6 +23,7 @@
 #include "strings.h"
 #include "types.h"
 
+#include <algorithm>
 #include <cctype>
 #include <numeric>
 #include <string>
@@ -175,6 +176,15 @@ public:
   iterator end();
   const_iterator cend() const;
 
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Replace the path, reusing the string's buffer
+  PosixPath& assign(const StringView& sv) {
+    _pstr.assign(sv.data(), sv.size());
+    _normalized = false;
+    _absolute = false;
+    return *this;
+  }
+
   ////////////////////////////////////////////////////////////////////////////////
   PosixPath& absolutize(const PosixPath& cwd) {
     if (!is_absolute()) {
@@ -631,21 +641,41 @@ struct PosixPathHasher {
   sizex operator()(const PosixPath& p) const { return hash_value(p); }
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/// Paths are string-like for `StringHash` and `StringEqual`, comparing as `compare()` does
+inline StringView asView(const PosixPath& p) noexcept {
+  return asView(p.u8());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Overwrite a path key in place, reusing its buffer
+inline void assignKey(PosixPath& key, const StringView& str) {
+  key.assign(str);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Path keys can be looked up by any string type
+template <>
+struct KeyHashing<PosixPath> {
+  using Hash = StringHash;
+  using Equal = StringEqual;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Converts a PosixPath to a windows compatible path string.
 ///
 /// Note that this function is available on all platforms. On Posix systems, it will
 /// use utf-32 wchars.
 inline std::wstring toWin32(const PosixPath& path) {
-  const auto& u8 = path.u8();
-  const auto str = u8.data();
-  const auto len = u8.size();
+  const auto& u8str = path.u8();
+  const auto str = u8str.data();
+  const auto len = u8str.size();
 
   // First convert the path string to windows format.
   const bool hasDriveRoot = path_detail::isDriveRoot(str, len);
 
   // Start the windows path. Chop off the first `//` if it's a drive root. Assumes ':'
-  auto winPath = hasDriveRoot ? std::string(str + 2, len - 2) : std::string(u8);
+  auto winPath = hasDriveRoot ? std::string(str + 2, len - 2) : std::string(u8str);
   static_assert(path_detail::kDriveChar == ':', "If drive-root char changes, fix this code");
 
   // Convert to windows separators
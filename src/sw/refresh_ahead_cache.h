@@ -0,0 +1,241 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/concurrent_lru_cache.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+
+SW_NAMESPACE_BEGIN
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A thread-safe loading cache that reloads entries ahead of their expiry, so hot keys
+/// never miss. It wraps a `ConcurrentLruCache`, stamping each value with the time it
+/// was loaded.
+///
+/// `get()` sorts an entry by its age:
+/// - Younger than `refreshAfter`: the cached value is returned.
+/// - Between `refreshAfter` and `expireAfter`: the cached (stale) value is returned
+///   straight away, and a reload is handed to the executor to run in the background.
+/// - At least `expireAfter`, or missing: the value is loaded before returning, with
+///   concurrent callers sharing the one load as `ConcurrentLruCache::getOrCompute()`.
+///
+/// Refreshes are coalesced. While a key's reload is queued or running, further stale
+/// reads of it don't schedule another. A reload only replaces the value it was
+/// scheduled for, so it never overwrites a newer `put()` nor brings back an erased key.
+/// A reload that throws leaves the stale value in place, and the next stale read tries
+/// again.
+///
+/// # Executor
+/// The executor is a `void(std::function<void()>)` that runs the task, now or later, on
+/// whatever thread it likes: a thread pool, an event loop, or a new thread. It must run
+/// every task it accepts, since the destructor waits for outstanding refreshes. If it
+/// throws, the refresh is dropped and the stale value is kept.
+///
+/// The `Clock` only needs a static `now()`, so tests can substitute a fake one.
+////////////////////////////////////////////////////////////////////////////////
+template <typename Key, typename T, typename Clock = std::chrono::steady_clock, sizex kShards = 16>
+class RefreshAheadCache {
+  using TimePoint = typename Clock::time_point;
+
+  struct Entry {
+    T value;
+    TimePoint loadedAt;
+  };
+
+  using KeySet = std::unordered_set<Key, typename KeyHashing<Key>::Hash, typename KeyHashing<Key>::Equal>;
+
+public:
+  using KeyType = Key;
+  using ValueType = T;
+  using Duration = typename Clock::duration;
+  using Loader = std::function<T(const Key&)>;
+  using Task = std::function<void()>;
+  using Executor = std::function<void(Task)>;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache. Entries are reloaded in the background once they are
+  /// `refreshAfter` old, and no longer served once they are `expireAfter` old.
+  RefreshAheadCache(sizex maxSizeValue, Duration refreshAfter, Duration expireAfter, Loader loader,
+                    Executor executor) :
+      cache_(maxSizeValue),
+      refreshAfter_(refreshAfter),
+      expireAfter_(std::max(expireAfter, refreshAfter)),
+      loader_(std::move(loader)),
+      executor_(std::move(executor)) {}
+
+  // Holds a mutex and is referenced by queued tasks, so no move/copy
+  RefreshAheadCache(const RefreshAheadCache&) = delete;
+  RefreshAheadCache& operator=(const RefreshAheadCache&) = delete;
+  RefreshAheadCache(RefreshAheadCache&&) = delete;
+  RefreshAheadCache& operator=(RefreshAheadCache&&) = delete;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Waits for outstanding refreshes, which still reference the cache
+  ~RefreshAheadCache() { waitForRefreshes(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of items in the cache
+  sizex size() const { return cache_.size(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the cache empty?
+  bool empty() const { return cache_.empty(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Check if the given key is cached, however stale. Does *not* count as a use.
+  bool contains(const KeyType& key) const { return cache_.contains(key); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the value for the key, loading it first if it's missing or expired, and
+  /// scheduling a background reload if it's due for a refresh. Throws whatever the
+  /// loader throws when it has to load in the foreground.
+  T get(const KeyType& key) {
+    const auto now = Clock::now();
+    auto entry = cache_.getOrCompute(key, [this](const KeyType& k) { return load(k); });
+    if (now - entry.loadedAt >= expireAfter_) {
+      // Too stale to serve, so this caller waits on a load like a miss would. Only the
+      // stale value is dropped, as a concurrent caller may already have replaced it.
+      const auto staleAt = entry.loadedAt;
+      cache_.eraseIf(key, [&staleAt](const Entry& cached) { return cached.loadedAt == staleAt; });
+      entry = cache_.getOrCompute(key, [this](const KeyType& k) { return load(k); });
+    } else if (now - entry.loadedAt >= refreshAfter_) {
+      scheduleRefresh(key, entry.loadedAt);
+    }
+    return std::move(entry.value);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or replaces the value for the key, as if it had just been loaded
+  void put(const KeyType& key, T value) { cache_.put(key, Entry{std::move(value), Clock::now()}); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Schedule a background reload of the key, unless one is already pending. A key
+  /// that isn't cached is left for the next `get()` to load.
+  void refresh(const KeyType& key) {
+    TimePoint loadedAt;
+    if (cache_.find(key, [&loadedAt](const Entry& cached) { loadedAt = cached.loadedAt; })) {
+      scheduleRefresh(key, loadedAt);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a cached value. A refresh in flight won't put it back.
+  sizex erase(const KeyType& key) { return cache_.erase(key); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Clear the cache completely
+  void clear() { cache_.clear(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of refreshes queued or running
+  sizex pendingRefreshes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return refreshing_.size();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Block until no refreshes are queued or running
+  void waitForRefreshes() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return refreshing_.empty(); });
+  }
+
+private:
+  Entry load(const KeyType& key) {
+    auto value = loader_(key);
+    return Entry{std::move(value), Clock::now()};
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Hand a reload of the value loaded at `staleAt` to the executor, unless one is
+  /// already pending
+  void scheduleRefresh(const KeyType& key, TimePoint staleAt) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!refreshing_.insert(key).second) {
+        return;
+      }
+    }
+
+    try {
+      executor_([this, key, staleAt]() { reload(key, staleAt); });
+    } catch (...) {
+      // The executor refused the task, so keep serving the stale value
+      finishRefresh(key);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The background half of `scheduleRefresh()`, run by the executor. The fresh value
+  /// is only installed over the value loaded at `staleAt`, so a newer put or an erase
+  /// since wins.
+  void reload(const KeyType& key, TimePoint staleAt) {
+    try {
+      auto fresh = load(key);
+      cache_.find(key, [&](Entry& cached) {
+        if (cached.loadedAt == staleAt) {
+          cached = std::move(fresh);
+        }
+      });
+    } catch (...) {
+      // Keep the stale value, the next stale read tries again
+    }
+    finishRefresh(key);
+  }
+
+  void finishRefresh(const KeyType& key) {
+    // Notify with the lock held, since the destructor may run as soon as it's released
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshing_.erase(key);
+    idle_.notify_all();
+  }
+
+private:
+  ConcurrentLruCache<Key, Entry, kShards> cache_;
+
+  /// Age at which a read schedules a background reload
+  Duration refreshAfter_;
+
+  /// Age at which a value is no longer served
+  Duration expireAfter_;
+
+  Loader loader_;
+  Executor executor_;
+
+  /// Guards `refreshing_`
+  mutable std::mutex mutex_;
+
+  /// Signalled as refreshes finish
+  std::condition_variable idle_;
+
+  /// Keys with a refresh queued or running
+  KeySet refreshing_;
+};
+
+SW_NAMESPACE_END
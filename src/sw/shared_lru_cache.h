@@ -0,0 +1,513 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/strings.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#if SW_POSIX
+#  include <fcntl.h>
+#  include <pthread.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+#if SW_POSIX
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hashes a `SharedLruCache` key by its bytes, as the cache compares keys, with
+/// `hashBytes()`, which gives the same answer in every process
+struct SharedKeyHash {
+  template <typename Key>
+  sizex operator()(const Key& key) const noexcept {
+    return static_cast<sizex>(hashBytes(reinterpret_cast<const char*>(&key), sizeof(Key)));
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// An LRU cache in a named POSIX shared memory region, so every process on the host
+/// that opens the same name shares one cache rather than each holding its own copy.
+///
+/// Everything lives in the region: a header, the hash buckets and a fixed array of
+/// `capacity` entries. Entries are linked by their index in the array rather than by
+/// pointer, since each process maps the region at its own address. Keys and values are
+/// stored in place, so they must be trivially copyable, such as integers, enums and
+/// `std::array`s of them. Keys are hashed (by the default `SharedKeyHash`) and compared
+/// as bytes, so a key type must have no padding: two equal keys with different padding
+/// bytes would be different keys. A custom hash must give the same answer in every
+/// process, and agree with the byte comparison.
+///
+/// # Opening
+/// The first process to open a name creates the region and lays it out. Others wait for
+/// it to be ready, then check its layout matches their own `Key`, `T` and capacity. If
+/// it doesn't, or the region can't be opened or mapped, `ok()` is false and the cache
+/// does nothing: puts are dropped and lookups miss. So too if the creator died before
+/// the region was ready. The region outlives the processes using it, until `unlink()`
+/// is called.
+///
+/// # Locking
+/// One process-shared mutex in the region guards the cache. On Linux it's a robust
+/// mutex, so a process that dies holding it doesn't wedge the others. The next process
+/// to lock it finds the cache possibly half-updated, and clears it before carrying on;
+/// it's only a cache. `find()` reads the value in place, with the lock held, rather than
+/// copying it out.
+////////////////////////////////////////////////////////////////////////////////
+template <typename Key, typename T, typename Hash = SharedKeyHash>
+class SharedLruCache {
+  static_assert(std::is_trivially_copyable<Key>::value, "Shared keys are copied as bytes");
+  static_assert(std::is_trivially_copyable<T>::value, "Shared values are copied as bytes");
+
+  static constexpr u32 kNil = ~0_u32;
+  static constexpr u64 kMagic = 0x5357534c52554331_u64;  // "SWSLRUC1"
+  static constexpr u32 kReady = 1;
+
+  struct Entry {
+    /// The LRU list, most recent first
+    u32 prev;
+    u32 next;
+
+    /// The next entry in the same bucket
+    u32 chain;
+
+    Key key;
+    T value;
+  };
+
+  struct Header {
+    u64 magic;
+    u64 regionSize;
+    u32 keySize;
+    u32 valueSize;
+    u32 capacity;
+    u32 bucketCount;
+
+    /// Set last by the creator, once everything else is in place
+    std::atomic<u32> ready;
+
+    pthread_mutex_t mutex;
+
+    u32 size;
+    u32 head;
+    u32 tail;
+
+    /// Unused entries, linked through `next`
+    u32 freeHead;
+  };
+
+public:
+  using KeyType = Key;
+  using ValueType = T;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Opens the shared cache of the given name, such as "/my-cache", creating it with
+  /// room for `capacity` entries if it doesn't exist yet.
+  SharedLruCache(const std::string& name, sizex capacity) { open(name, static_cast<u32>(std::max(capacity, 1_z))); }
+
+  // Owns the mapping, so no move/copy
+  SharedLruCache(const SharedLruCache&) = delete;
+  SharedLruCache& operator=(const SharedLruCache&) = delete;
+  SharedLruCache(SharedLruCache&&) = delete;
+  SharedLruCache& operator=(SharedLruCache&&) = delete;
+
+  ~SharedLruCache() {
+    if (region_ != nullptr) {
+      ::munmap(region_, regionSize_);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove the named region. Processes with it open keep using it, but the next open
+  /// creates a new one.
+  static bool unlink(const std::string& name) { return ::shm_unlink(name.c_str()) == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Was the region opened, and does it have the expected layout?
+  bool ok() const noexcept { return region_ != nullptr; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of entries the cache holds before evicting
+  sizex capacity() const noexcept { return ok() ? header()->capacity : 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of entries, across all processes
+  sizex size() const {
+    if (!ok()) {
+      return 0;
+    }
+    Lock lock(*this);
+    return header()->size;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  bool empty() const { return size() == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Check if the key is cached. Does *not* count as a use.
+  bool contains(const KeyType& key) const {
+    if (!ok()) {
+      return false;
+    }
+    Lock lock(*this);
+    return findIndex(key, bucketOf(key)) != kNil;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates the value for the key, evicting the least recently used entry
+  /// when full
+  void put(const KeyType& key, const T& value) {
+    if (!ok()) {
+      return;
+    }
+    Lock lock(*this);
+    auto h = header();
+    const auto bucket = bucketOf(key);
+    auto index = findIndex(key, bucket);
+    if (index != kNil) {
+      entryAt(index).value = value;
+      moveToFront(index);
+      return;
+    }
+
+    if (h->freeHead != kNil) {
+      index = h->freeHead;
+      h->freeHead = entryAt(index).next;
+      ++h->size;
+    } else {
+      index = h->tail;
+      removeFromBucket(index);
+      unlinkEntry(index);
+    }
+
+    auto& entry = entryAt(index);
+    entry.key = key;
+    entry.value = value;
+    entry.chain = buckets()[bucket];
+    buckets()[bucket] = index;
+    pushFront(index);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// @value Will be a copy of the value if it exists, otherwise it is unchanged
+  /// @return true if the value was found
+  bool get(const KeyType& key, T& value) {
+    return find(key, [&value](const T& found) { value = found; });
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the value for the key and, if it exists, call `func(const T&)` with it where it
+  /// lies in shared memory. The cache is locked for all processes during the call, so
+  /// keep it short.
+  /// @return true if the value was found
+  template <typename Func>
+  bool find(const KeyType& key, Func&& func) {
+    if (!ok()) {
+      return false;
+    }
+    Lock lock(*this);
+    const auto index = findIndex(key, bucketOf(key));
+    if (index == kNil) {
+      return false;
+    }
+    moveToFront(index);
+    func(static_cast<const T&>(entryAt(index).value));
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove a cached value
+  sizex erase(const KeyType& key) {
+    if (!ok()) {
+      return 0;
+    }
+    Lock lock(*this);
+    const auto index = findIndex(key, bucketOf(key));
+    if (index == kNil) {
+      return 0;
+    }
+    removeFromBucket(index);
+    unlinkEntry(index);
+    freeEntry(index);
+    --header()->size;
+    return 1;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Clear the cache for all processes
+  void clear() {
+    if (!ok()) {
+      return;
+    }
+    Lock lock(*this);
+    reset();
+  }
+
+private:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Locks the region's mutex. A previous owner that died with it held leaves the cache
+  /// in an unknown state, so it's cleared.
+  class Lock {
+  public:
+    explicit Lock(const SharedLruCache& cache) : mutex_(&cache.header()->mutex) {
+      const auto result = ::pthread_mutex_lock(mutex_);
+#  if SW_LINUX
+      if (result == EOWNERDEAD) {
+        cache.reset();
+        ::pthread_mutex_consistent(mutex_);
+      }
+#  else
+      SW_ASSERT(result == 0);
+      (void)result;
+#  endif
+    }
+    ~Lock() { ::pthread_mutex_unlock(mutex_); }
+
+    Lock(const Lock&) = delete;
+    Lock& operator=(const Lock&) = delete;
+
+  private:
+    pthread_mutex_t* mutex_;
+  };
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Bytes taken by the header, aligned for the buckets and entries that follow
+  static sizex headerBytes() noexcept {
+    constexpr auto align = alignof(Entry) > alignof(std::max_align_t) ? alignof(Entry) : alignof(std::max_align_t);
+    return (sizeof(Header) + align - 1) / align * align;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  static sizex bucketBytes(u32 bucketCount) noexcept {
+    constexpr auto align = alignof(Entry);
+    return (bucketCount * sizeof(u32) + align - 1) / align * align;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Open or create the region, leaving `region_` null on any failure
+  void open(const std::string& name, u32 capacityValue) {
+    u32 bucketCount = 8;
+    while (bucketCount < capacityValue * 2_u64) {
+      bucketCount <<= 1u;
+    }
+    const auto size = headerBytes() + bucketBytes(bucketCount) + sizex(capacityValue) * sizeof(Entry);
+
+    bool isCreator = true;
+    auto fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+      isCreator = false;
+      fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+      return;
+    }
+
+    // The creator sizes the region in one step, so any other size is a different layout
+    bool sized = isCreator && ::ftruncate(fd, static_cast<off_t>(size)) == 0;
+    for (int attempt = 0; !isCreator && attempt < kOpenAttempts; ++attempt) {
+      struct stat info;
+      if (::fstat(fd, &info) != 0) {
+        break;
+      }
+      if (info.st_size != 0) {
+        sized = static_cast<sizex>(info.st_size) == size;
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    void* region = sized ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (region == MAP_FAILED) {
+      return;
+    }
+
+    region_ = static_cast<char*>(region);
+    regionSize_ = size;
+    if (isCreator) {
+      initialize(size, capacityValue, bucketCount);
+    } else if (!waitUntilReady(size, capacityValue, bucketCount)) {
+      ::munmap(region_, regionSize_);
+      region_ = nullptr;
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Lay out a new region, marking it ready last
+  void initialize(sizex size, u32 capacityValue, u32 bucketCount) {
+    auto h = header();
+    h->magic = kMagic;
+    h->regionSize = size;
+    h->keySize = sizeof(Key);
+    h->valueSize = sizeof(T);
+    h->capacity = capacityValue;
+    h->bucketCount = bucketCount;
+
+    pthread_mutexattr_t attr;
+    ::pthread_mutexattr_init(&attr);
+    ::pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#  if SW_LINUX
+    ::pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#  endif
+    ::pthread_mutex_init(&h->mutex, &attr);
+    ::pthread_mutexattr_destroy(&attr);
+
+    reset();
+    h->ready.store(kReady, std::memory_order_release);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Wait for the creator to finish, then check the layout is the one expected
+  bool waitUntilReady(sizex size, u32 capacityValue, u32 bucketCount) const {
+    auto h = header();
+    for (int attempt = 0; h->ready.load(std::memory_order_acquire) != kReady; ++attempt) {
+      if (attempt == kOpenAttempts) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return h->magic == kMagic && h->regionSize == size && h->keySize == sizeof(Key) && h->valueSize == sizeof(T) &&
+           h->capacity == capacityValue && h->bucketCount == bucketCount;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Empty the buckets and put every entry on the free list. The lock must be held.
+  void reset() const noexcept {
+    auto h = header();
+    std::fill(buckets(), buckets() + h->bucketCount, kNil);
+    for (u32 i = 0; i < h->capacity; ++i) {
+      entryAt(i).next = i + 1 < h->capacity ? i + 1 : kNil;
+    }
+    h->freeHead = 0;
+    h->size = 0;
+    h->head = kNil;
+    h->tail = kNil;
+  }
+
+  Header* header() const noexcept { return reinterpret_cast<Header*>(region_); }
+  u32* buckets() const noexcept { return reinterpret_cast<u32*>(region_ + headerBytes()); }
+  Entry& entryAt(u32 index) const noexcept {
+    SW_ASSERT(index < header()->capacity);
+    return reinterpret_cast<Entry*>(region_ + headerBytes() + bucketBytes(header()->bucketCount))[index];
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Mix the hash, since a custom one such as `std::hash` is often the identity for
+  /// integers
+  u32 bucketOf(const KeyType& key) const noexcept {
+    auto hash = static_cast<u64>(Hash{}(key));
+    hash ^= hash >> 33u;
+    hash *= 0xff51afd7ed558ccd_u64;
+    hash ^= hash >> 33u;
+    return static_cast<u32>(hash) & (header()->bucketCount - 1);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Compared as bytes, as the key was stored
+  u32 findIndex(const KeyType& key, u32 bucket) const noexcept {
+    for (auto index = buckets()[bucket]; index != kNil; index = entryAt(index).chain) {
+      if (std::memcmp(&entryAt(index).key, &key, sizeof(Key)) == 0) {
+        return index;
+      }
+    }
+    return kNil;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void removeFromBucket(u32 index) noexcept {
+    auto link = &buckets()[bucketOf(entryAt(index).key)];
+    while (*link != index) {
+      SW_ASSERT(*link != kNil);
+      link = &entryAt(*link).chain;
+    }
+    *link = entryAt(index).chain;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void pushFront(u32 index) noexcept {
+    auto h = header();
+    auto& entry = entryAt(index);
+    entry.prev = kNil;
+    entry.next = h->head;
+    if (h->head != kNil) {
+      entryAt(h->head).prev = index;
+    } else {
+      h->tail = index;
+    }
+    h->head = index;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void unlinkEntry(u32 index) noexcept {
+    auto h = header();
+    auto& entry = entryAt(index);
+    (entry.prev != kNil ? entryAt(entry.prev).next : h->head) = entry.next;
+    (entry.next != kNil ? entryAt(entry.next).prev : h->tail) = entry.prev;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void moveToFront(u32 index) noexcept {
+    if (header()->head != index) {
+      unlinkEntry(index);
+      pushFront(index);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void freeEntry(u32 index) noexcept {
+    entryAt(index).next = header()->freeHead;
+    header()->freeHead = index;
+  }
+
+private:
+  /// How many 1ms waits for another process to finish creating the region
+  static constexpr int kOpenAttempts = 5000;
+
+  /// The mapped region, or null if it couldn't be opened
+  char* region_ = nullptr;
+  sizex regionSize_ = 0;
+};
+
+template <typename Key, typename T, typename Hash>
+constexpr u32 SharedLruCache<Key, T, Hash>::kNil;
+template <typename Key, typename T, typename Hash>
+constexpr u64 SharedLruCache<Key, T, Hash>::kMagic;
+template <typename Key, typename T, typename Hash>
+constexpr u32 SharedLruCache<Key, T, Hash>::kReady;
+template <typename Key, typename T, typename Hash>
+constexpr int SharedLruCache<Key, T, Hash>::kOpenAttempts;
+
+#endif  // SW_POSIX
+
+SW_NAMESPACE_END
@@ -0,0 +1,404 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/types.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if SW_POSIX
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// Buffered writer of a binary snapshot file. The bytes go to a temporary file next to
+/// the destination, which `finish()` syncs to disk and renames into place, so neither a
+/// crash mid-write nor a power loss right after leaves a truncated snapshot behind. The
+/// temporary file's name is unique to the writer, so writers racing on one destination
+/// don't clobber each other, and the last to finish wins. Any failure is sticky, and
+/// reported by `ok()` and `finish()`.
+///
+/// Values are written in host byte order, as snapshots are meant to be reloaded by the
+/// same program on the same machine.
+///
+/// A default constructed writer collects the bytes in memory instead, for `bytes()`,
+/// such as to serialize one record at a time.
+////////////////////////////////////////////////////////////////////////////////
+class SnapshotWriter {
+public:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Writes to memory rather than a file
+  SnapshotWriter() : inMemory_(true) {}
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Opens the temporary file for the given destination
+  explicit SnapshotWriter(std::string path) : path_(std::move(path)), tempPath_(uniqueTempPath(path_)) {
+    file_ = std::fopen(tempPath_.c_str(), "wb");
+    buffer_.reserve(kBufferSize);
+  }
+
+  // Owns the file, so no move/copy
+  SnapshotWriter(const SnapshotWriter&) = delete;
+  SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+  SnapshotWriter(SnapshotWriter&&) = delete;
+  SnapshotWriter& operator=(SnapshotWriter&&) = delete;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// An unfinished snapshot is discarded
+  ~SnapshotWriter() {
+    if (file_ != nullptr) {
+      std::fclose(file_);
+      std::remove(tempPath_.c_str());
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Has everything succeeded so far?
+  bool ok() const noexcept { return inMemory_ || file_ != nullptr; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The bytes written by an in-memory writer
+  const std::vector<char>& bytes() const noexcept { return buffer_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Discard the bytes written by an in-memory writer, keeping the capacity
+  void clearBytes() noexcept { buffer_.clear(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Append raw bytes
+  void write(const void* data, sizex size) {
+    const auto bytes = static_cast<const char*>(data);
+    if (!inMemory_ && buffer_.size() + size > kBufferSize) {
+      flush();
+      if (size > kBufferSize) {
+        put(bytes, size);
+        return;
+      }
+    }
+    buffer_.insert(buffer_.end(), bytes, bytes + size);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Append an unsigned value as a LEB128 varint, a byte for every 7 bits
+  void writeSize(u64 value) {
+    char bytes[10];
+    sizex count = 0;
+    while (value >= 0x80) {
+      bytes[count++] = static_cast<char>((value & 0x7f) | 0x80);
+      value >>= 7u;
+    }
+    bytes[count++] = static_cast<char>(value);
+    write(bytes, count);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Flush the file and sync it to disk, close it, and move it into place. The
+  /// directory is then synced too, so the rename survives a power loss, but that's best
+  /// effort, as the snapshot is already in place.
+  /// @return true if the whole snapshot was written
+  bool finish() {
+    if (inMemory_) {
+      return true;
+    }
+
+    flush();
+    if (file_ == nullptr) {
+      return false;
+    }
+
+    const auto synced = std::fflush(file_) == 0 && syncFile(file_);
+    const auto closed = std::fclose(file_) == 0;
+    file_ = nullptr;
+    if (!synced || !closed || std::rename(tempPath_.c_str(), path_.c_str()) != 0) {
+      std::remove(tempPath_.c_str());
+      return false;
+    }
+    syncDirectoryOf(path_);
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The temporary file written until finished
+  const std::string& tempPath() const noexcept { return tempPath_; }
+
+private:
+  static constexpr sizex kBufferSize = 64 * 1024;
+
+  /// The destination plus the process id and a per-process count
+  static std::string uniqueTempPath(const std::string& path) {
+    static std::atomic<u64> counter{0};
+    auto temp = path;
+#if SW_POSIX
+    temp += '.';
+    temp += std::to_string(::getpid());
+#endif
+    temp += '.';
+    temp += std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+    temp += ".tmp";
+    return temp;
+  }
+
+  static bool syncFile(std::FILE* file) {
+#if SW_POSIX
+    return ::fsync(::fileno(file)) == 0;
+#else
+    return true;
+#endif
+  }
+
+  static void syncDirectoryOf(const std::string& path) {
+#if SW_POSIX
+    const auto slash = path.find_last_of('/');
+    const auto dir = slash == std::string::npos ? std::string(".") : path.substr(0, slash == 0 ? 1 : slash);
+    const auto fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      ::fsync(fd);
+      ::close(fd);
+    }
+#endif
+  }
+
+  void flush() {
+    put(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+
+  void put(const char* bytes, sizex size) {
+    if (file_ != nullptr && size != 0 && std::fwrite(bytes, 1, size, file_) != size) {
+      std::fclose(file_);
+      file_ = nullptr;
+      std::remove(tempPath_.c_str());
+    }
+  }
+
+private:
+  /// Destination, and the file written until finished
+  std::string path_;
+  std::string tempPath_;
+
+  /// Collecting bytes rather than writing a file?
+  bool inMemory_ = false;
+
+  /// Null once closed or failed
+  std::FILE* file_ = nullptr;
+
+  /// Pending bytes
+  std::vector<char> buffer_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// Reader of a snapshot file from `SnapshotWriter`. On POSIX the file is memory-mapped
+/// and read sequentially in place, so strings are copied straight out of the page cache
+/// with no read buffer in between. Elsewhere the whole file is read into memory.
+///
+/// Reading past the end, or a missing file, makes `ok()` false and every later read
+/// return zeros. So a caller can read a whole record and check once.
+///
+/// A reader can also be given bytes already in memory, such as a record read back from
+/// a bigger file.
+////////////////////////////////////////////////////////////////////////////////
+class SnapshotReader {
+public:
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Maps the file. `ok()` is false if it can't be opened.
+  explicit SnapshotReader(const std::string& path) { open(path); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Reads the given bytes, which must outlive the reader
+  SnapshotReader(const char* data, sizex size) noexcept : data_(data), size_(size), ok_(true) {}
+
+  // Owns the mapping, so no move/copy
+  SnapshotReader(const SnapshotReader&) = delete;
+  SnapshotReader& operator=(const SnapshotReader&) = delete;
+  SnapshotReader(SnapshotReader&&) = delete;
+  SnapshotReader& operator=(SnapshotReader&&) = delete;
+
+  ~SnapshotReader() {
+#if SW_POSIX
+    if (mapped_ != nullptr) {
+      ::munmap(mapped_, size_);
+    }
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Has everything succeeded so far?
+  bool ok() const noexcept { return ok_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is all of the file read?
+  bool atEnd() const noexcept { return pos_ == size_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the next `size` bytes in place, or nullptr if the file is too short. The
+  /// bytes are valid for the life of the reader.
+  const char* view(sizex size) noexcept {
+    if (!ok_ || size > size_ - pos_) {
+      ok_ = false;
+      return nullptr;
+    }
+    const auto bytes = data_ + pos_;
+    pos_ += size;
+    return bytes;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Copy out the next `size` bytes, or zeros if the file is too short
+  void read(void* data, sizex size) noexcept {
+    const auto bytes = view(size);
+    if (bytes != nullptr) {
+      std::memcpy(data, bytes, size);
+    } else {
+      std::memset(data, 0, size);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Read a varint from `SnapshotWriter::writeSize()`
+  u64 readSize() noexcept {
+    u64 value = 0;
+    for (u32 shift = 0; shift < 64; shift += 7) {
+      const auto bytes = view(1);
+      if (bytes == nullptr) {
+        return 0;
+      }
+      const auto bits = static_cast<u8>(*bytes);
+      value |= u64(bits & 0x7fu) << shift;
+      if ((bits & 0x80u) == 0) {
+        return value;
+      }
+    }
+    ok_ = false;
+    return 0;
+  }
+
+private:
+#if SW_POSIX
+  void open(const std::string& path) {
+    const auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) == 0) {
+      size_ = static_cast<sizex>(info.st_size);
+      ok_ = true;
+      if (size_ != 0) {
+        auto mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+          ok_ = false;
+          size_ = 0;
+        } else {
+          ::madvise(mapped, size_, MADV_SEQUENTIAL);
+          mapped_ = mapped;
+          data_ = static_cast<const char*>(mapped);
+        }
+      }
+    }
+    ::close(fd);
+  }
+#else
+  void open(const std::string& path) {
+    auto file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+      return;
+    }
+
+    char chunk[64 * 1024];
+    sizex count = 0;
+    while ((count = std::fread(chunk, 1, sizeof(chunk), file)) != 0) {
+      contents_.insert(contents_.end(), chunk, chunk + count);
+    }
+    ok_ = std::ferror(file) == 0;
+    std::fclose(file);
+    data_ = contents_.data();
+    size_ = ok_ ? contents_.size() : 0;
+  }
+#endif
+
+private:
+  /// The file's bytes
+  const char* data_ = nullptr;
+  sizex size_ = 0;
+
+  /// Read position
+  sizex pos_ = 0;
+
+  /// False once opening or a read has failed
+  bool ok_ = false;
+
+#if SW_POSIX
+  void* mapped_ = nullptr;
+#else
+  std::vector<char> contents_;
+#endif
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Writes and reads one type in a snapshot. Specialize this, or supply your own type
+/// with the same static members, for other types:
+///    static void write(SnapshotWriter&, const T&);
+///    static T read(SnapshotReader&);
+/// Trivially copyable types are written as their bytes, and strings with a length.
+template <typename T, typename = void>
+struct SnapshotSerializer;
+
+template <typename T>
+struct SnapshotSerializer<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type> {
+  static void write(SnapshotWriter& out, const T& value) { out.write(&value, sizeof(T)); }
+
+  static T read(SnapshotReader& in) {
+    T value;
+    in.read(&value, sizeof(T));
+    return value;
+  }
+};
+
+template <>
+struct SnapshotSerializer<std::string> {
+  static void write(SnapshotWriter& out, const std::string& value) {
+    out.writeSize(value.size());
+    out.write(value.data(), value.size());
+  }
+
+  static std::string read(SnapshotReader& in) {
+    const auto size = in.readSize();
+    const auto bytes = in.view(static_cast<sizex>(size));
+    return bytes != nullptr ? std::string(bytes, static_cast<sizex>(size)) : std::string();
+  }
+};
+
+SW_NAMESPACE_END
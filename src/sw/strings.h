@@ -27,7 +27,9 @@
 
 #include <codecvt>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <locale>
 #include <sstream>
 #include <string>
 
@@ -298,4 +300,102 @@ inline std::string toString(const StringView& sv) {
   return std::string(sv.data(), sv.size());
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// View any of the string types without copying. Other string-like types can take part
+/// in `StringHash` and `StringEqual` by adding an `asView()` overload.
+inline StringView asView(const StringView& str) noexcept {
+  return str;
+}
+inline StringView asView(const std::string& str) noexcept {
+  return StringView(str.data(), str.size());
+}
+inline StringView asView(const StringWrapper& str) {
+  return StringView(str.data(), str.size());
+}
+inline StringView asView(const char* str) noexcept {
+  return StringView(str);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Overwrite a string key in place, reusing its buffer
+inline void assignKey(std::string& key, const StringView& str) {
+  key.assign(str.data(), str.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// 64-bit MurmurHash2 (MurmurHash64A) of a block of bytes
+inline u64 hashBytes(const char* data, sizex size) noexcept {
+  constexpr u64 kMul = 0xc6a4a7935bd1e995_u64;
+  constexpr u32 kShift = 47;
+  constexpr u64 kSeed = 0x9747b28c_u64;
+
+  u64 hash = kSeed ^ (static_cast<u64>(size) * kMul);
+  const char* end = data + (size & ~7_z);
+  for (; data != end; data += 8) {
+    u64 word = 0;
+    std::memcpy(&word, data, sizeof(word));
+    word *= kMul;
+    word ^= word >> kShift;
+    word *= kMul;
+    hash ^= word;
+    hash *= kMul;
+  }
+
+  // The trailing bytes, little endian
+  const auto remaining = size & 7_z;
+  if (remaining != 0) {
+    u64 tail = 0;
+    for (auto i = remaining; i-- > 0;) {
+      tail = (tail << 8u) | static_cast<u8>(data[i]);
+    }
+    hash ^= tail;
+    hash *= kMul;
+  }
+
+  hash ^= hash >> kShift;
+  hash *= kMul;
+  hash ^= hash >> kShift;
+  return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Transparent hash for anything with an `asView()`, so std::string, StringView,
+/// StringWrapper and const char* all hash alike. With `StringEqual`, hash maps can then
+/// be probed by a view without building a std::string key.
+struct StringHash {
+  using is_transparent = void;
+
+  template <typename Str>
+  auto operator()(const Str& str) const -> decltype(asView(str), sizex()) {
+    const auto view = asView(str);
+    return static_cast<sizex>(hashBytes(view.data(), view.size()));
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Transparent equality to go with `StringHash`
+struct StringEqual {
+  using is_transparent = void;
+
+  template <typename Lhs, typename Rhs>
+  auto operator()(const Lhs& lhs, const Rhs& rhs) const -> decltype(asView(lhs) == asView(rhs)) {
+    return asView(lhs) == asView(rhs);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// The hash and equality a container should default to for a key type. String-like
+/// keys get the transparent ones.
+template <typename Key>
+struct KeyHashing {
+  using Hash = std::hash<Key>;
+  using Equal = std::equal_to<Key>;
+};
+
+template <>
+struct KeyHashing<std::string> {
+  using Hash = StringHash;
+  using Equal = StringEqual;
+};
+
 SW_NAMESPACE_END
@@ -0,0 +1,440 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/lru_cache.h>
+#include <sw/snapshot_io.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if SW_POSIX
+#  include <sys/types.h>
+#endif
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Where a record lives in a `TieredCache` spill file
+struct SpillLocation {
+  u64 offset;
+  sizex size;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Weighs a spilled record by its bytes
+struct SpillWeigher {
+  template <typename Key>
+  sizex operator()(const Key&, const SpillLocation& location) const noexcept {
+    return location.size;
+  }
+};
+
+namespace tiered_detail {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Seek from the start of the file, past 2GB where the platform allows
+inline bool seek(std::FILE* file, u64 offset) noexcept {
+#if SW_POSIX
+  return ::fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#else
+  return std::fseek(file, static_cast<long>(offset), SEEK_SET) == 0;
+#endif
+}
+
+}  // namespace tiered_detail
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A two-tier cache for working sets bigger than memory. The memory tier is an
+/// `LruCache`. Entries it purges for size are spilled to a local file rather than
+/// dropped, and a hit on a spilled entry promotes it back into memory. A key lives in
+/// one tier at most.
+///
+/// # Disk Tier
+/// The spill file is append-only: each batch of spilled entries is serialized, using the
+/// `Traits` `KeySerializer` and `ValueSerializer` (see `SnapshotSerializer`), and written
+/// to the end in one go. Only the index of key to file location is kept in memory. The
+/// index is itself an `LruCache`, weighed by record size, so the disk tier holds at most
+/// `diskMaxBytes` of live records and drops its least recently spilled ones to make room.
+///
+/// Records that are promoted, replaced, erased or dropped leave dead bytes behind in the
+/// file. Once the dead bytes outweigh the live ones, and there are at least
+/// `kCompactMinBytes` of them, the live records are copied to a new file that replaces
+/// the old. So the file stays within about twice the disk capacity. `compact()` does so
+/// on demand.
+///
+/// The spill file is scratch space. It's truncated when the cache is created and removed
+/// when it's destroyed. If it can't be opened, `isDiskOk()` reports false. Entries that
+/// can't be spilled, for that or because the write failed, are dropped as a plain
+/// `LruCache` would, and counted by `spillFailures()`.
+///
+/// # Traits
+/// The memory tier uses the `Traits`, except for its eviction listener, which is how
+/// spilling works. Entries dropped from the disk tier are just destroyed.
+///
+/// Like `LruCache`, this is not thread-safe.
+////////////////////////////////////////////////////////////////////////////////
+template <typename Key, typename T, typename Traits = LruCacheTraits<Key, T>>
+class TieredCache {
+  using KeySerializer = typename Traits::KeySerializer;
+  using ValueSerializer = typename Traits::ValueSerializer;
+
+  /// Counts the bytes of records that are no longer indexed
+  struct DeadBytes {
+    void operator()(const Key&, SpillLocation&& location, LruEvictionReason) noexcept { bytes += location.size; }
+    sizex bytes = 0;
+  };
+
+  struct MemoryTraits : Traits {
+    /// Gathers the memory tier's evictions to be spilled once its operation is over
+    using EvictionListener = LruEvictionCollector<Key, T>;
+  };
+
+  struct IndexTraits : LruCacheTraits<Key, SpillLocation> {
+    using Weigher = SpillWeigher;
+    using EvictionListener = DeadBytes;
+    using Hash = typename Traits::Hash;
+    using KeyEqual = typename Traits::KeyEqual;
+  };
+
+public:
+  using KeyType = Key;
+  using ValueType = T;
+  using MemoryCache = LruCache<Key, T, true, MemoryTraits>;
+  using IndexCache = LruCache<Key, SpillLocation, true, IndexTraits>;
+
+  /// Dead bytes needed before the spill file is compacted automatically
+  static constexpr sizex kCompactMinBytes = 64 * 1024;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the cache holding up to `memoryMaxSize` entries in memory, and up to
+  /// `diskMaxBytes` of spilled records in the file at `spillPath`.
+  TieredCache(sizex memoryMaxSize, std::string spillPath, sizex diskMaxBytes) :
+      memory_(memoryMaxSize), index_(std::max(diskMaxBytes, 1_z)), path_(std::move(spillPath)) {
+    index_.setMaxWeight(diskMaxBytes);
+    file_ = std::fopen(path_.c_str(), "w+b");
+  }
+
+  // Owns the spill file, so no move/copy
+  TieredCache(const TieredCache&) = delete;
+  TieredCache& operator=(const TieredCache&) = delete;
+  TieredCache(TieredCache&&) = delete;
+  TieredCache& operator=(TieredCache&&) = delete;
+
+  ~TieredCache() {
+    if (file_ != nullptr) {
+      std::fclose(file_);
+      std::remove(path_.c_str());
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of entries in both tiers
+  sizex size() const noexcept { return memory_.size() + index_.size(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the cache empty?
+  bool empty() const noexcept { return size() == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of entries in memory
+  sizex memorySize() const noexcept { return memory_.size(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of spilled entries
+  sizex diskSize() const noexcept { return index_.size(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the bytes of the spilled entries, which is at most `diskMaxBytes()`
+  sizex diskBytes() const noexcept { return index_.totalWeight(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  sizex diskMaxBytes() const noexcept { return index_.maxWeight(); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the size of the spill file, live records and dead
+  u64 fileBytes() const noexcept { return fileBytes_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Is the spill file usable? If not, entries purged from memory are dropped.
+  bool isDiskOk() const noexcept { return file_ != nullptr; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of entries purged from memory that were dropped rather than
+  /// spilled, because the spill file was unusable or the write to it failed
+  u64 spillFailures() const noexcept { return spillFailures_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// The memory tier, such as for its `snapshot()`
+  const MemoryCache& memory() const noexcept { return memory_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Check if the key is in either tier. Does *not* count as a use.
+  bool contains(const KeyType& key) const { return memory_.contains(key) || index_.contains(key); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Clear both tiers, truncating the spill file
+  void clear() {
+    memory_.clear();
+    memory_.evictionListener().collected.clear();
+    resetDisk();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove the key from whichever tier has it
+  sizex erase(const KeyType& key) {
+    const auto erased = memory_.erase(key) + index_.erase(key);
+    spill();
+    return erased;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates the value in memory, spilling whatever that purges
+  void put(const KeyType& key, const T& value) { doPut(key, value); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Inserts or updates the value in memory, spilling whatever that purges
+  void put(const KeyType& key, T&& value) { doPut(key, std::move(value)); }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Look in memory, then on disk, promoting a spilled entry back into memory.
+  /// @value Will be a copy of the value if it exists, otherwise it is unchanged
+  /// @return true if the value was found
+  bool get(const KeyType& key, T& value) {
+    if (memory_.get(key, value)) {
+      spill();
+      return true;
+    }
+
+    auto iter = index_.cfind(key);
+    if (iter == index_.cend()) {
+      spill();
+      return false;
+    }
+    const auto location = iter.value();
+    index_.erase(key);
+    if (!readRecord(location, value)) {
+      spill();
+      return false;
+    }
+
+    memory_.put(key, value);
+    spill();
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Rewrite the spill file with only the live records. If the new file can't be
+  /// written, the old one stays in use. If it's written but can't replace the old one,
+  /// or be reopened, the spilled entries are dropped and the spill file starts over
+  /// empty. The memory tier is untouched either way.
+  /// @return true if the file was compacted
+  bool compact() {
+    if (file_ == nullptr) {
+      return false;
+    }
+
+    const auto tempPath = path_ + ".compact";
+    auto out = std::fopen(tempPath.c_str(), "wb");
+    if (out == nullptr) {
+      return false;
+    }
+
+    // Copy the records, only updating the index once the new file is complete
+    std::vector<u64> offsets;
+    offsets.reserve(index_.size());
+    u64 offset = 0;
+    bool ok = true;
+    for (auto iter = index_.cbegin(); ok && iter != index_.cend(); ++iter) {
+      const auto& location = iter.value();
+      ok = readBytes(location) && std::fwrite(scratch_.data(), 1, location.size, out) == location.size;
+      offsets.push_back(offset);
+      offset += location.size;
+    }
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok) {
+      std::remove(tempPath.c_str());
+      return false;
+    }
+
+    std::fclose(file_);
+    file_ = nullptr;
+    if (std::rename(tempPath.c_str(), path_.c_str()) != 0) {
+      std::remove(tempPath.c_str());
+      resetDisk();
+      return false;
+    }
+
+    file_ = std::fopen(path_.c_str(), "r+b");
+    if (file_ == nullptr) {
+      resetDisk();
+      return false;
+    }
+
+    auto next = offsets.begin();
+    for (auto iter = index_.begin(); iter != index_.end(); ++iter) {
+      iter.value().offset = *next++;
+    }
+    fileBytes_ = offset;
+    index_.evictionListener().bytes = 0;
+    return true;
+  }
+
+private:
+  template <typename Value>
+  void doPut(const KeyType& key, Value&& value) {
+    // Any spilled copy is now stale
+    index_.erase(key);
+    memory_.put(key, std::forward<Value>(value));
+    spill();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Drop the disk tier, and start the spill file over empty
+  void resetDisk() {
+    index_.clear();
+    index_.evictionListener().bytes = 0;
+    fileBytes_ = 0;
+    if (file_ != nullptr) {
+      std::fclose(file_);
+    }
+    file_ = std::fopen(path_.c_str(), "w+b");
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Append what the memory tier purged to the spill file in one write, and index it.
+  /// If the write fails, the entries are dropped and counted. Whatever part of it did
+  /// reach the file lies past `fileBytes_`, unindexed, and the next spill writes over it.
+  void spill() {
+    auto& collected = memory_.evictionListener().collected;
+    if (collected.empty()) {
+      return;
+    }
+
+    auto evictions = std::move(collected);
+    collected.clear();
+    if (file_ == nullptr) {
+      spillFailures_ += static_cast<u64>(std::count_if(evictions.begin(), evictions.end(), isSpilled));
+      return;
+    }
+
+    writer_.clearBytes();
+    locations_.clear();
+    for (const auto& eviction : evictions) {
+      if (!isSpilled(eviction)) {
+        continue;
+      }
+      const auto start = writer_.bytes().size();
+      KeySerializer::write(writer_, eviction.key);
+      ValueSerializer::write(writer_, eviction.value);
+      locations_.push_back(SpillLocation{fileBytes_ + start, writer_.bytes().size() - start});
+    }
+
+    const auto& bytes = writer_.bytes();
+    if (bytes.empty()) {
+      return;
+    }
+    // Flushed, so a failed write is seen now rather than by a later seek
+    if (!tiered_detail::seek(file_, fileBytes_) || std::fwrite(bytes.data(), 1, bytes.size(), file_) != bytes.size() ||
+        std::fflush(file_) != 0) {
+      spillFailures_ += locations_.size();
+      return;
+    }
+    fileBytes_ += bytes.size();
+
+    auto location = locations_.begin();
+    for (const auto& eviction : evictions) {
+      if (isSpilled(eviction)) {
+        index_.put(eviction.key, *location++);
+      }
+    }
+
+    const auto dead = index_.evictionListener().bytes;
+    if (dead >= kCompactMinBytes && dead > diskBytes()) {
+      compact();
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Only entries purged for size go to disk, the rest were removed on purpose
+  static bool isSpilled(const LruEviction<Key, T>& eviction) noexcept {
+    return eviction.reason == LruEvictionReason::Size;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Read a record's bytes into `scratch_`
+  bool readBytes(const SpillLocation& location) {
+    scratch_.resize(location.size);
+    return tiered_detail::seek(file_, location.offset) &&
+           std::fread(scratch_.data(), 1, location.size, file_) == location.size;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Read back a record's value, skipping its key
+  bool readRecord(const SpillLocation& location, T& value) {
+    if (file_ == nullptr || !readBytes(location)) {
+      return false;
+    }
+
+    SnapshotReader in(scratch_.data(), scratch_.size());
+    KeySerializer::read(in);
+    auto loaded = ValueSerializer::read(in);
+    if (!in.ok()) {
+      return false;
+    }
+    value = std::move(loaded);
+    return true;
+  }
+
+private:
+  /// The memory tier
+  MemoryCache memory_;
+
+  /// The disk tier, mapping spilled keys to their records
+  IndexCache index_;
+
+  /// The spill file, null if it couldn't be opened
+  std::string path_;
+  std::FILE* file_ = nullptr;
+
+  /// End of the last record written. A failed spill may leave bytes past it.
+  u64 fileBytes_ = 0;
+
+  /// Entries purged from memory that couldn't be spilled
+  u64 spillFailures_ = 0;
+
+  /// Scratch space for serializing and reading records
+  SnapshotWriter writer_;
+  std::vector<SpillLocation> locations_;
+  std::vector<char> scratch_;
+};
+
+template <typename Key, typename T, typename Traits>
+constexpr sizex TieredCache<Key, T, Traits>::kCompactMinBytes;
+
+SW_NAMESPACE_END
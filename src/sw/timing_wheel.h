@@ -0,0 +1,253 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <sw/assert.h>
+#include <sw/fixed_width_int_literals.h>
+#include <sw/types.h>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+using namespace sw::intliterals;
+
+namespace wheel_detail {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Index of the highest set bit. Value must be non-zero.
+inline u32 highestBit(u64 value) noexcept {
+  SW_ASSERT(value != 0);
+#if SW_GCC_CXX || SW_CLANG_CXX
+  return 63u - static_cast<u32>(__builtin_clzll(value));
+#else
+  u32 result = 0;
+  while (value >>= 1u) {
+    ++result;
+  }
+  return result;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Index of the lowest set bit. Value must be non-zero.
+inline u32 lowestBit(u64 value) noexcept {
+  SW_ASSERT(value != 0);
+#if SW_GCC_CXX || SW_CLANG_CXX
+  return static_cast<u32>(__builtin_ctzll(value));
+#else
+  u32 result = 0;
+  while ((value & 1u) == 0) {
+    value >>= 1u;
+    ++result;
+  }
+  return result;
+#endif
+}
+
+}  // namespace wheel_detail
+
+////////////////////////////////////////////////////////////////////////////////
+/// # Overview
+/// A hierarchical timing wheel. Values are scheduled to fire at a tick, and `advance()`
+/// hands back the values whose tick has been reached. Time is purely in ticks, it's up
+/// to the owner to map a clock onto them.
+///
+/// There are `kLevels` wheels of `kSlots` slots each. A slot on level `n` spans
+/// `kSlots^n` ticks. A value is placed on the lowest level where its tick shares the
+/// current "digits" above that level, and as time reaches the start of that slot the
+/// values cascade down a level, until they finally fire from level zero. Each value is
+/// thus touched at most `kLevels` times, scheduling is O(1), and empty stretches of time
+/// are skipped using a per-level occupancy bitmask rather than by stepping every tick.
+///
+/// `advance()` takes a budget of work. Once the budget is spent it returns, leaving the
+/// rest of the work for the next call. So a slot holding a million values is drained a
+/// little at a time rather than in one long stall.
+///
+/// Ticks further out than the wheel spans (kSlots^kLevels) are parked in the top level
+/// and re-placed as time catches up.
+////////////////////////////////////////////////////////////////////////////////
+template <typename Value>
+class TimingWheel {
+public:
+  static constexpr u32 kSlotBits = 6;
+  static constexpr u32 kSlots = 1u << kSlotBits;
+  static constexpr u32 kLevels = 6;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Creates the wheel with the given current tick
+  explicit TimingWheel(u64 startTick = 0) : slots_(kLevels * kSlots), current_(startTick) {
+    occupied_.fill(0);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the last tick the wheel advanced to
+  u64 currentTick() const noexcept { return current_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Return the number of scheduled values that haven't fired
+  sizex size() const noexcept { return size_; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  bool empty() const noexcept { return size_ == 0; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Remove all values. The current tick is unchanged.
+  void clear() {
+    for (auto& slot : slots_) {
+      slot.clear();
+    }
+    occupied_.fill(0);
+    pending_.clear();
+    size_ = 0;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Schedule a value to fire at the given tick. A tick that has already passed fires on
+  /// the next `advance()`.
+  void schedule(Value value, u64 tick) {
+    ++size_;
+    if (tick <= current_) {
+      pending_.push_back(Item{std::move(value), tick});
+    } else {
+      place(Item{std::move(value), tick});
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Move time forward to `nowTick`, calling `func(Value&&, u64 tick)` for each value
+  /// whose tick has been reached. At most `budget` values are either fired or cascaded,
+  /// so the wheel may not have caught up when this returns. `func` may schedule values.
+  /// @return The number of values fired
+  template <typename Func>
+  sizex advance(u64 nowTick, sizex budget, Func&& func) {
+    sizex fired = 0;
+    sizex work = 0;
+    while (work < budget) {
+      if (!pending_.empty()) {
+        ++work;
+        auto item = std::move(pending_.back());
+        pending_.pop_back();
+        if (item.tick <= current_) {
+          --size_;
+          ++fired;
+          func(std::move(item.value), item.tick);
+        } else {
+          place(std::move(item));
+        }
+        continue;
+      }
+
+      if (current_ >= nowTick) {
+        break;
+      }
+
+      // Jump to the next occupied slot, or straight to now when nothing is due
+      u32 level = 0;
+      u32 slot = 0;
+      u64 startTick = 0;
+      if (!nextSlot(level, slot, startTick) || startTick > nowTick) {
+        current_ = nowTick;
+        break;
+      }
+
+      current_ = startTick;
+      occupied_[level] &= ~(1_u64 << slot);
+      pending_.swap(slotAt(level, slot));
+    }
+
+    return fired;
+  }
+
+private:
+  struct Item {
+    Value value;
+    u64 tick;
+  };
+
+  std::vector<Item>& slotAt(u32 level, u32 slot) { return slots_[level * kSlots + slot]; }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Put an item, due after the current tick, on the level of the highest digit where
+  /// its tick differs from the current tick
+  void place(Item&& item) {
+    SW_ASSERT(item.tick > current_);
+    const auto level = std::min(wheel_detail::highestBit(item.tick ^ current_) / kSlotBits, kLevels - 1);
+    const auto slot = static_cast<u32>(item.tick >> (level * kSlotBits)) & (kSlots - 1);
+    occupied_[level] |= 1_u64 << slot;
+    slotAt(level, slot).push_back(std::move(item));
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  /// Find the earliest occupied slot after the current tick. Any occupied slot on a lower
+  /// level starts before every slot on a higher level, so the first level with a later
+  /// slot has the answer.
+  bool nextSlot(u32& level, u32& slot, u64& startTick) const noexcept {
+    for (u32 n = 0; n < kLevels; ++n) {
+      const auto shift = n * kSlotBits;
+      const auto index = static_cast<u32>(current_ >> shift) & (kSlots - 1);
+      const auto later = (index == kSlots - 1) ? 0 : occupied_[n] & (~0_u64 << (index + 1));
+      const auto blockMask = (shift + kSlotBits >= 64) ? ~0_u64 : (1_u64 << (shift + kSlotBits)) - 1;
+      if (later != 0) {
+        level = n;
+        slot = wheel_detail::lowestBit(later);
+        startTick = (current_ & ~blockMask) + (u64(slot) << shift);
+        return true;
+      }
+
+      // Far future ticks parked on the top level may sit at or before the current index,
+      // in which case they belong to the next top level revolution
+      if (n == kLevels - 1 && occupied_[n] != 0) {
+        level = n;
+        slot = wheel_detail::lowestBit(occupied_[n]);
+        startTick = (current_ & ~blockMask) + blockMask + 1 + (u64(slot) << shift);
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  /// kLevels * kSlots slots, level major
+  std::vector<std::vector<Item>> slots_;
+
+  /// Bit per slot, set when the slot isn't empty
+  std::array<u64, kLevels> occupied_;
+
+  /// Items taken from a slot that still need to fire or cascade
+  std::vector<Item> pending_;
+
+  /// The current tick
+  u64 current_ = 0;
+
+  /// Scheduled item count
+  sizex size_ = 0;
+};
+
+template <typename Value>
+constexpr u32 TimingWheel<Value>::kSlotBits;
+template <typename Value>
+constexpr u32 TimingWheel<Value>::kSlots;
+template <typename Value>
+constexpr u32 TimingWheel<Value>::kLevels;
+
+SW_NAMESPACE_END
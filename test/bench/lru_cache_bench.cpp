@@ -0,0 +1,235 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+/// LruCache throughput and latency benchmarks. Each operation is run over uniform,
+/// Zipf and scan key streams, at several key and value sizes, and reported as ops/sec
+/// and p50/p99 latency.
+///
+/// Every measurement starts from a fresh cache warmed the same way. The ops are run
+/// twice: once back to back for the throughput, and once with each op timed on its own
+/// for the latency percentiles, less the cost of reading the clock.
+///
+///    sw-cxx-common-bench [--ops N] [--keys N] [--filter SUBSTRING]
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/cache_simulator.h>
+#include <sw/lru_cache.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+#if SW_USE_ROBIN_HASH_MAP
+constexpr const char* kBackend = "robin_map";
+#else
+constexpr const char* kBackend = "unordered_map";
+#endif
+
+struct Options {
+  sizex ops = 1000000;
+  sizex keys = 100000;
+  std::string filter;
+};
+
+struct Workload {
+  std::string name;
+  CacheTrace trace;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Keys of a given size: u64 for 8 bytes, otherwise fixed length strings
+template <sizex kBytes>
+struct KeyMaker {
+  using Key = std::string;
+  static Key make(u64 key) {
+    auto str = std::to_string(key);
+    str.insert(0, kBytes - std::min(str.size(), kBytes), 'k');
+    return str;
+  }
+};
+
+template <>
+struct KeyMaker<8> {
+  using Key = u64;
+  static Key make(u64 key) { return key; }
+};
+
+template <sizex kBytes>
+using Value = std::array<char, kBytes>;
+
+////////////////////////////////////////////////////////////////////////////////
+/// The cost of reading the clock, to subtract from each timed op
+double clockOverheadNs() {
+  std::vector<double> samples(1000);
+  for (auto& sample : samples) {
+    const auto start = Clock::now();
+    sample = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+struct Measurement {
+  double opsPerSecond = 0;
+  double p50Ns = 0;
+  double p99Ns = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Run `setup()` then `count` calls of `op(i)`, twice, measuring each way
+Measurement measure(sizex count, const std::function<void()>& setup, const std::function<void(sizex)>& op,
+                    double overheadNs) {
+  Measurement result;
+  setup();
+  const auto start = Clock::now();
+  for (sizex i = 0; i < count; ++i) {
+    op(i);
+  }
+  const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  result.opsPerSecond = seconds > 0 ? static_cast<double>(count) / seconds : 0;
+
+  std::vector<double> latencies(count);
+  setup();
+  for (sizex i = 0; i < count; ++i) {
+    const auto opStart = Clock::now();
+    op(i);
+    latencies[i] = std::chrono::duration<double, std::nano>(Clock::now() - opStart).count() - overheadNs;
+  }
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    result.p50Ns = std::max(latencies[latencies.size() / 2], 0.0);
+    result.p99Ns = std::max(latencies[latencies.size() * 99 / 100], 0.0);
+  }
+  return result;
+}
+
+void report(const std::string& workload, sizex keyBytes, sizex valueBytes,
+            const char* op, const Measurement& result) {
+  std::printf("%-14s %-10s %5zu %6zu %-10s %10.2f %9.0f %9.0f\n", kBackend, workload.c_str(), keyBytes, valueBytes,
+              op, result.opsPerSecond / 1e6, result.p50Ns, result.p99Ns);
+  std::fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Every op over one workload, for one key and value size
+template <sizex kKeyBytes, sizex kValueBytes>
+void benchSizes(const Options& options, const Workload& workload, double overheadNs) {
+  using Maker = KeyMaker<kKeyBytes>;
+  using Key = typename Maker::Key;
+  using Cache = LruCache<Key, Value<kValueBytes>>;
+
+  const auto& records = workload.trace.records();
+  std::vector<Key> keys;
+  keys.reserve(records.size());
+  for (const auto& record : records) {
+    keys.push_back(Maker::make(record.key));
+  }
+
+  // The cache holds a tenth of the key space, and starts full of the stream's keys
+  const auto capacity = std::max(options.keys / 10, 1_z);
+  const auto count = keys.size();
+  Cache cache(capacity);
+  Value<kValueBytes> value{};
+  auto warm = [&]() {
+    cache = Cache(capacity);
+    for (const auto& key : keys) {
+      cache.put(key, value);
+    }
+  };
+  auto run = [&](const char* op, const std::function<void()>& setup, const std::function<void(sizex)>& func) {
+    if (!options.filter.empty() && (workload.name + " " + op).find(options.filter) == std::string::npos) {
+      return;
+    }
+    report(workload.name, kKeyBytes, kValueBytes, op, measure(count, setup, func, overheadNs));
+  };
+
+  volatile sizex sink = 0;
+  run("put", [&]() { cache = Cache(capacity); }, [&](sizex i) { cache.put(keys[i], value); });
+  run("get", warm, [&](sizex i) { sink = sink + (cache.get(keys[i], value) ? 1 : 0); });
+  run("find", warm, [&](sizex i) { sink = sink + (cache.find(keys[i]) != cache.end() ? 1 : 0); });
+  run("operator[]", warm, [&](sizex i) { sink = sink + static_cast<sizex>(cache[keys[i]][0]); });
+  run("erase", warm, [&](sizex i) { sink = sink + cache.erase(keys[i]); });
+
+  // Each op purges one entry from a full cache shrunk to half
+  const auto purges = capacity / 2;
+  if (purges != 0) {
+    auto shrink = [&]() {
+      warm();
+      cache.setPurgeBudget(2);
+      cache.setMaxSize(capacity - purges);
+    };
+    const auto result = measure(purges, shrink, [&](sizex) { sink = sink + cache.purgeSome(1); }, overheadNs);
+    if (options.filter.empty() || (workload.name + " purge").find(options.filter) != std::string::npos) {
+      report(workload.name, kKeyBytes, kValueBytes, "purge", result);
+    }
+  }
+}
+
+}  // namespace
+
+SW_NAMESPACE_END
+
+int main(int argc, char** argv) {
+  using namespace sw;
+
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i];
+    if (arg == "--ops") {
+      options.ops = std::strtoull(argv[i + 1], nullptr, 10);
+    } else if (arg == "--keys") {
+      options.keys = std::max<sizex>(std::strtoull(argv[i + 1], nullptr, 10), 1);
+    } else if (arg == "--filter") {
+      options.filter = argv[i + 1];
+    } else {
+      std::fprintf(stderr, "usage: %s [--ops N] [--keys N] [--filter SUBSTRING]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const std::vector<Workload> workloads = {
+      {"uniform", CacheTrace::zipf(options.ops, options.keys, 0.0)},
+      {"zipf0.8", CacheTrace::zipf(options.ops, options.keys, 0.8)},
+      {"zipf1.0", CacheTrace::zipf(options.ops, options.keys, 1.0)},
+      {"zipf1.2", CacheTrace::zipf(options.ops, options.keys, 1.2)},
+      {"scan", CacheTrace::scan(options.ops, options.keys, 1.0, options.keys / 5, options.keys)},
+  };
+
+  const auto overheadNs = clockOverheadNs();
+  std::printf("%zu ops over %zu keys, cache of %zu, clock overhead %.0f ns\n", options.ops, options.keys,
+              std::max(options.keys / 10, 1_z), overheadNs);
+  std::printf("%-14s %-10s %5s %6s %-10s %10s %9s %9s\n", "backend", "workload", "key", "value", "op", "Mops/s",
+              "p50 ns", "p99 ns");
+  for (const auto& workload : workloads) {
+    benchSizes<8, 8>(options, workload, overheadNs);
+    benchSizes<32, 128>(options, workload, overheadNs);
+    benchSizes<128, 1024>(options, workload, overheadNs);
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/cache_simulator.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+bool sameRecords(const CacheTrace& lhs, const CacheTrace& rhs) {
+  return std::equal(lhs.records().begin(), lhs.records().end(), rhs.records().begin(), rhs.records().end(),
+                    [](const TraceRecord& a, const TraceRecord& b) { return a.key == b.key && a.size == b.size; });
+}
+}  // namespace
+
+TEST(CacheSimulatorTest, generators) {
+  const auto zipf = CacheTrace::zipf(10000, 1000, 1.0, 7);
+  ASSERT_EQ(10000u, zipf.size());
+  ASSERT_LE(zipf.distinctKeys(), 1000u);
+  sizex hottest = 0;
+  for (const auto& record : zipf.records()) {
+    ASSERT_LT(record.key, 1000u);
+    hottest += record.key == 0 ? 1 : 0;
+  }
+  // Key 0 gets about 1 / H(1000) of the traffic, roughly 13%
+  ASSERT_GT(hottest, 1000u);
+  ASSERT_LT(hottest, 1700u);
+
+  // Same seed, same trace
+  const auto again = CacheTrace::zipf(10000, 1000, 1.0, 7);
+  ASSERT_TRUE(sameRecords(zipf, again));
+
+  const auto scan = CacheTrace::scan(1000, 100, 1.0, 50, 100, 7);
+  ASSERT_EQ(1000u, scan.size());
+  // Scanned keys are past the Zipf keys, and each is used once
+  std::vector<TraceRecord> scanned;
+  for (const auto& record : scan.records()) {
+    if (record.key >= 100) {
+      scanned.push_back(record);
+    }
+  }
+  ASSERT_GT(scanned.size(), 300u);
+  ASSERT_EQ(scanned.size(), CacheTrace(scanned).distinctKeys());
+
+  const auto loop = CacheTrace::loop(100, 10);
+  ASSERT_EQ(10u, loop.distinctKeys());
+  ASSERT_EQ(3u, loop.records()[13].key);
+}
+
+TEST(CacheSimulatorTest, files) {
+  const auto binaryPath = ::testing::TempDir() + "trace.bin";
+  const auto trace = CacheTrace::zipf(1000, 100, 0.8);
+  ASSERT_TRUE(trace.save(binaryPath));
+  CacheTrace loaded;
+  ASSERT_TRUE(loaded.load(binaryPath));
+  ASSERT_TRUE(sameRecords(trace, loaded));
+  std::remove(binaryPath.c_str());
+
+  const auto textPath = ::testing::TempDir() + "trace.txt";
+  auto file = std::fopen(textPath.c_str(), "w");
+  ASSERT_NE(nullptr, file);
+  std::fputs("# key size\n12 100\n\n/a/b.txt 2048\n12\n  /a/b.txt\n", file);
+  std::fclose(file);
+  ASSERT_TRUE(loaded.load(textPath));
+  ASSERT_EQ(4u, loaded.size());
+  ASSERT_EQ(12u, loaded.records()[0].key);
+  ASSERT_EQ(100u, loaded.records()[0].size);
+  ASSERT_EQ(1u, loaded.records()[2].size);
+  ASSERT_EQ(loaded.records()[1].key, loaded.records()[3].key);
+  ASSERT_EQ(2u, loaded.distinctKeys());
+  std::remove(textPath.c_str());
+
+  ASSERT_FALSE(loaded.load(textPath));
+}
+
+TEST(CacheSimulatorTest, run) {
+  CacheSimulator simulator;
+  ASSERT_TRUE(simulator.hasPolicy("arc"));
+  ASSERT_FALSE(simulator.hasPolicy("mru"));
+
+  // A loop one longer than the cache defeats LRU entirely
+  const auto loop = CacheTrace::loop(10000, 101);
+  const auto results = simulator.run(loop, {100, 101}, {"lru", "lfu", "flat", "mru"});
+  ASSERT_EQ(6u, results.size());
+  ASSERT_EQ("lru", results[0].policy);
+  ASSERT_EQ(100u, results[0].cacheSize);
+  ASSERT_EQ(0u, results[0].hits);
+  ASSERT_EQ(10000u - 101u, results[1].hits);
+  ASSERT_EQ("lfu", results[2].policy);
+  ASSERT_EQ(0u, results[4].hits);
+  ASSERT_EQ(loop.totalBytes(), results[0].requestBytes);
+
+  // The single pass LRU curve is exact at its bucket boundaries
+  const auto zipf = CacheTrace::zipf(50000, 5000, 0.9);
+  const auto curve = CacheSimulator::lruCurve(zipf, 1000, 10);
+  for (const auto& result : simulator.run(zipf, {100, 500, 1000}, {"lru"})) {
+    ASSERT_NEAR(1.0 - result.hitRatio(), curve.missRatio(result.cacheSize), 1e-9);
+    ASSERT_GT(result.byteHitRatio(), 0.0);
+    ASSERT_GT(result.opsPerSecond(), 0.0);
+  }
+
+  simulator.addPolicy("never", [](const CacheTrace& trace, sizex) {
+    SimulationResult result;
+    result.requests = trace.size();
+    return result;
+  });
+  ASSERT_EQ(0.0, simulator.run(zipf, {10}, {"never"}).at(0).hitRatio());
+}
+
+SW_NAMESPACE_END
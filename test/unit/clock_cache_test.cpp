@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/clock_cache.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+TEST(ClockCacheTest, putAndGet) {
+  ClockCache<int, std::string> cache;
+  cache.put(1, "1");
+  cache.put(2, "2");
+  ASSERT_EQ(2u, cache.size());
+
+  std::string str;
+  ASSERT_FALSE(cache.get(3, str));
+  ASSERT_TRUE(cache.get(1, str));
+  ASSERT_EQ("1", str);
+
+  cache.put(1, "11");
+  ASSERT_TRUE(cache.find(1, [](const std::string& value) { ASSERT_EQ("11", value); }));
+  ASSERT_FALSE(cache.find(3, [](const std::string&) { FAIL(); }));
+
+  ASSERT_EQ(1u, cache.erase(1));
+  ASSERT_EQ(0u, cache.erase(1));
+  ASSERT_FALSE(cache.contains(1));
+  ASSERT_TRUE(cache.contains(2));
+}
+
+TEST(ClockCacheTest, secondChance) {
+  ClockCache<int, int> cache(3);
+  cache.put(1, 1);
+  cache.put(2, 2);
+  cache.put(3, 3);
+
+  // 1 was used, so the hand skips it and evicts 2
+  int value = 0;
+  ASSERT_TRUE(cache.get(1, value));
+  cache.put(4, 4);
+  ASSERT_EQ(3u, cache.size());
+  ASSERT_TRUE(cache.contains(1));
+  ASSERT_FALSE(cache.contains(2));
+  ASSERT_TRUE(cache.contains(3));
+  ASSERT_TRUE(cache.contains(4));
+
+  // 1 lost its reference bit on the last sweep, and nothing has been used since
+  cache.put(5, 5);
+  ASSERT_FALSE(cache.contains(3));
+  cache.put(6, 6);
+  ASSERT_FALSE(cache.contains(1));
+  ASSERT_EQ(3u, cache.size());
+}
+
+TEST(ClockCacheTest, shrink) {
+  ClockCache<int, int> cache(10);
+  for (int i = 0; i < 10; ++i) {
+    cache.put(i, i);
+  }
+  int value = 0;
+  ASSERT_TRUE(cache.get(7, value));
+
+  cache.setMaxSize(3);
+  ASSERT_EQ(3u, cache.maxSize());
+  ASSERT_EQ(3u, cache.size());
+  ASSERT_TRUE(cache.contains(7));
+
+  cache.clear();
+  ASSERT_TRUE(cache.empty());
+}
+
+TEST(ClockCacheTest, concurrentReaders) {
+  ClockCache<int, int> cache(100);
+  for (int i = 0; i < 100; ++i) {
+    cache.put(i, i);
+  }
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (int i = 0; i < 10000; ++i) {
+        const int key = (i * 7 + t) % 120;
+        int value = -1;
+        if (cache.get(key, value)) {
+          EXPECT_EQ(key, value);
+        } else if (t == 0) {
+          cache.put(key, key);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(100u, cache.size());
+}
+
+SW_NAMESPACE_END
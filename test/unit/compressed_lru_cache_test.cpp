@@ -0,0 +1,164 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/compressed_lru_cache.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+
+std::string textValue(int i) {
+  std::string text;
+  while (text.size() < 1000) {
+    text += R"({"key": )" + std::to_string(i) + R"(, "status": "ok", "payload": "lorem ipsum dolor"} )";
+  }
+  return text;
+}
+
+/// Is the key in the back segment, compressed? Looking it up there would count as a use.
+bool isCompressed(const CompressedLruCache<int>& cache, int key) {
+  for (auto iter = cache.back().cbegin(); iter != cache.back().cend(); ++iter) {
+    if (iter.key() == key) {
+      return iter.value().isCompressed();
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+TEST(CompressedLruCacheTest, demoteAndPromote) {
+  CompressedLruCache<int> cache(100000, 3000);
+  ASSERT_EQ(100000u, cache.maxBytes());
+  for (int i = 0; i < 10; ++i) {
+    cache.put(i, textValue(i));
+  }
+  ASSERT_EQ(10u, cache.size());
+  ASSERT_LE(cache.front().totalWeight(), 3000u);
+  ASSERT_EQ(cache.size(), cache.front().size() + cache.back().size());
+
+  // The oldest were compressed on their way out of the front
+  ASSERT_TRUE(cache.back().contains(0));
+  ASSERT_TRUE(isCompressed(cache, 0));
+  ASSERT_LT(cache.back().totalWeight() * 4, cache.back().size() * textValue(0).size());
+
+  // A hit decompresses the value back into the front
+  std::string value;
+  ASSERT_TRUE(cache.get(0, value));
+  ASSERT_EQ(textValue(0), value);
+  ASSERT_TRUE(cache.front().contains(0));
+  ASSERT_FALSE(cache.back().contains(0));
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(cache.get(i, value));
+    ASSERT_EQ(textValue(i), value);
+  }
+  ASSERT_FALSE(cache.get(10, value));
+
+  // Replacing or erasing a compressed entry leaves no stale copy behind
+  ASSERT_TRUE(cache.back().contains(1));
+  cache.put(1, "one");
+  ASSERT_TRUE(cache.get(1, value));
+  ASSERT_EQ("one", value);
+  ASSERT_TRUE(cache.back().contains(2));
+  ASSERT_EQ(1u, cache.erase(2));
+  ASSERT_FALSE(cache.contains(2));
+  ASSERT_EQ(9u, cache.size());
+
+  cache.clear();
+  ASSERT_TRUE(cache.empty());
+  ASSERT_EQ(0u, cache.storedBytes());
+}
+
+TEST(CompressedLruCacheTest, holdsMoreThanRaw) {
+  // 50KB of raw 1KB values would be 50 entries
+  CompressedLruCache<int> cache(50000);
+  for (int i = 0; i < 5000; ++i) {
+    cache.put(i, textValue(i));
+  }
+  ASSERT_GT(cache.size(), 200u);
+  ASSERT_LE(cache.storedBytes(), cache.maxBytes());
+
+  // The survivors are the most recent, intact
+  std::string value;
+  ASSERT_TRUE(cache.get(4999, value));
+  ASSERT_EQ(textValue(4999), value);
+  ASSERT_FALSE(cache.contains(0));
+}
+
+TEST(CompressedLruCacheTest, storesSomeRaw) {
+  CompressedLruCache<int> cache(100000, 10, 64);
+
+  // Too small to be worth it, and too random to shrink
+  cache.put(1, "tiny");
+  std::string noise;
+  for (int i = 0; i < 200; ++i) {
+    noise.push_back(static_cast<char>((i * 7919) ^ (i >> 3)));
+  }
+  cache.put(2, noise);
+  cache.put(3, textValue(3));
+  cache.put(4, "pushes 3 out");
+
+  ASSERT_TRUE(cache.back().contains(1));
+  ASSERT_FALSE(isCompressed(cache, 1));
+  ASSERT_TRUE(cache.back().contains(2));
+  ASSERT_FALSE(isCompressed(cache, 2));
+  ASSERT_TRUE(isCompressed(cache, 3));
+
+  std::string value;
+  ASSERT_TRUE(cache.get(1, value));
+  ASSERT_EQ("tiny", value);
+  ASSERT_TRUE(cache.get(2, value));
+  ASSERT_EQ(noise, value);
+  ASSERT_TRUE(cache.get(3, value));
+  ASSERT_EQ(textValue(3), value);
+}
+
+namespace {
+struct TinyLfuTraits : LruCacheTraits<int, std::string> {
+  using Admission = TinyLfuAdmission;
+};
+}  // namespace
+
+TEST(CompressedLruCacheTest, entryLimitsWithAdmission) {
+  // The entry counts, which size the admission sketch, come from the average value
+  // size rather than the byte budgets
+  CompressedLruCache<int, TinyLfuTraits> cache(1000000, 100000, 128, 1000);
+  ASSERT_EQ(100u, cache.front().maxSize());
+  ASSERT_EQ(100000u, cache.front().maxWeight());
+  ASSERT_EQ(900u, cache.back().maxSize());
+  ASSERT_EQ(1000000u, cache.maxBytes());
+
+  for (int i = 0; i < 2000; ++i) {
+    cache.put(i, textValue(i));
+  }
+  ASSERT_LE(cache.front().size(), 100u);
+  ASSERT_LE(cache.storedBytes(), cache.maxBytes());
+  std::string value;
+  for (int i = 0; i < 2000; ++i) {
+    if (cache.contains(i)) {
+      ASSERT_TRUE(cache.get(i, value));
+      ASSERT_EQ(textValue(i), value);
+    }
+  }
+}
+
+SW_NAMESPACE_END
@@ -0,0 +1,364 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/concurrent_lru_cache.h>
+#include <sw/posix_path.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+TEST(ConcurrentLruCacheTest, putAndGet) {
+  ConcurrentLruCache<int, std::string, 4> cache(100);
+  cache.put(1, "1");
+  cache.put(2, "2");
+  cache.put(3, "3");
+  ASSERT_EQ(3u, cache.size());
+  ASSERT_TRUE(cache.contains(2));
+
+  std::string str;
+  ASSERT_FALSE(cache.get(4, str));
+  ASSERT_TRUE(cache.get(3, str));
+  ASSERT_EQ("3", str);
+
+  cache.put(3, "33");
+  ASSERT_TRUE(cache.get(3, str));
+  ASSERT_EQ("33", str);
+  ASSERT_EQ(3u, cache.size());
+}
+
+TEST(ConcurrentLruCacheTest, findAndErase) {
+  ConcurrentLruCache<int, std::string, 4> cache(100);
+  cache.put(1, "1");
+  ASSERT_TRUE(cache.find(1, [](std::string& value) { value += "1"; }));
+  ASSERT_FALSE(cache.find(2, [](std::string&) { FAIL(); }));
+
+  std::string str;
+  ASSERT_TRUE(cache.get(1, str));
+  ASSERT_EQ("11", str);
+
+  ASSERT_EQ(0u, cache.eraseIf(1, [](const std::string& value) { return value == "1"; }));
+  ASSERT_EQ(0u, cache.eraseIf(2, [](const std::string&) { return true; }));
+  ASSERT_EQ(1u, cache.eraseIf(1, [](const std::string& value) { return value == "11"; }));
+  ASSERT_TRUE(cache.empty());
+
+  cache.put(1, "1");
+  ASSERT_EQ(1u, cache.erase(1));
+  ASSERT_EQ(0u, cache.erase(1));
+  ASSERT_TRUE(cache.empty());
+}
+
+TEST(ConcurrentLruCacheTest, pathKeys) {
+  // Paths have no std::hash, so shards and loads hash them with KeyHashing
+  ConcurrentLruCache<PosixPath, int, 4> cache(100);
+  cache.put(PosixPath("/usr/lib"), 1);
+  ASSERT_TRUE(cache.contains(PosixPath("/usr/lib")));
+  ASSERT_FALSE(cache.contains(PosixPath("/usr/bin")));
+  ASSERT_EQ(2, cache.getOrCompute(PosixPath("/usr/bin"), [](const PosixPath&) { return 2; }));
+  int value = 0;
+  ASSERT_TRUE(cache.get(PosixPath("/usr/bin"), value));
+  ASSERT_EQ(2, value);
+  ASSERT_EQ(1u, cache.erase(PosixPath("/usr/lib")));
+  ASSERT_EQ(1u, cache.size());
+}
+
+TEST(ConcurrentLruCacheTest, capacity) {
+  ConcurrentLruCache<int, int, 4> cache(10);
+
+  // Rounded up to a multiple of the shard count
+  ASSERT_EQ(12u, cache.maxSize());
+  for (sizex i = 0; i < 4; ++i) {
+    ASSERT_EQ(3u, cache.shardMaxSize(i));
+  }
+
+  cache.setShardMaxSize(0, 5);
+  ASSERT_EQ(14u, cache.maxSize());
+
+  // No shard can exceed its own capacity
+  cache.setMaxSize(4);
+  for (int i = 0; i < 1000; ++i) {
+    cache.put(i, i);
+  }
+  ASSERT_EQ(4u, cache.size());
+  ASSERT_EQ(4u, cache.maxSize());
+
+  cache.clear();
+  ASSERT_TRUE(cache.empty());
+}
+
+TEST(ConcurrentLruCacheTest, multiThreaded) {
+  constexpr int kThreads = 8;
+  constexpr int kKeysPerThread = 1000;
+  ConcurrentLruCache<int, int, 8> cache(kThreads * kKeysPerThread);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (int i = 0; i < kKeysPerThread; ++i) {
+        const int key = t * kKeysPerThread + i;
+        cache.put(key, key);
+        int value = -1;
+        if (cache.get(key, value)) {
+          EXPECT_EQ(key, value);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_LE(cache.size(), cache.maxSize());
+  ASSERT_GT(cache.size(), 0u);
+}
+
+namespace {
+
+/// Counts evictions, and checks it's never called with the value's shard locked
+struct CountingListener {
+  void operator()(const int& key, int&& value, LruEvictionReason) {
+    EXPECT_EQ(key, value);
+    EXPECT_FALSE(cache->contains(key));
+    count->fetch_add(1, std::memory_order_relaxed);
+  }
+  const ConcurrentLruCache<int, int, 4, std::mutex, CountingListener>* cache = nullptr;
+  std::atomic<sizex>* count = nullptr;
+};
+
+}  // namespace
+
+TEST(ConcurrentLruCacheTest, evictionListener) {
+  std::atomic<sizex> count{0};
+  ConcurrentLruCache<int, int, 4, std::mutex, CountingListener> cache(40, CountingListener{});
+  cache.evictionListener() = CountingListener{&cache, &count};
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (int i = 0; i < 1000; ++i) {
+        cache.put(t * 1000 + i, t * 1000 + i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(4000u - cache.size(), count.load());
+  cache.clear();
+  ASSERT_EQ(4000u, count.load());
+}
+
+TEST(ConcurrentLruCacheTest, getOrComputeSingleFlight) {
+  ConcurrentLruCache<int, std::string, 4> cache(100);
+  std::atomic<int> loads{0};
+  std::atomic<bool> release{false};
+  auto loader = [&](int key) {
+    ++loads;
+    while (!release) {
+      std::this_thread::yield();
+    }
+    return std::to_string(key);
+  };
+
+  std::vector<std::thread> threads;
+  std::vector<std::string> results(8);
+  for (sizex t = 0; t < results.size(); ++t) {
+    threads.emplace_back([&, t]() { results[t] = cache.getOrCompute(7, loader); });
+  }
+
+  // Give every thread time to join the load before letting it finish
+  while (loads == 0) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  release = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(1, loads);
+  for (const auto& result : results) {
+    ASSERT_EQ("7", result);
+  }
+  ASSERT_EQ("7", cache.getOrCompute(7, [](int) -> std::string { throw std::runtime_error("cached"); }));
+  ASSERT_EQ(1, loads);
+}
+
+TEST(ConcurrentLruCacheTest, getOrComputeFailure) {
+  ConcurrentLruCache<int, std::string, 4> cache(100);
+  ASSERT_THROW(cache.getOrCompute(1, [](int) -> std::string { throw std::runtime_error("failed"); }),
+               std::runtime_error);
+  ASSERT_FALSE(cache.contains(1));
+
+  // A failed load isn't remembered
+  ASSERT_EQ("1", cache.getOrCompute(1, [](int key) { return std::to_string(key); }));
+  ASSERT_TRUE(cache.contains(1));
+}
+
+TEST(ConcurrentLruCacheTest, getOrComputeLosesToWrites) {
+  ConcurrentLruCache<int, std::string, 4> cache(100);
+
+  // Runs a load of the key that blocks until `write` has been made
+  auto loadAround = [&cache](int key, const std::function<void()>& write) {
+    std::atomic<bool> loading{false};
+    std::atomic<bool> release{false};
+    std::string result;
+    std::thread thread([&]() {
+      result = cache.getOrCompute(key, [&](int) {
+        loading = true;
+        while (!release) {
+          std::this_thread::yield();
+        }
+        return std::string("loaded");
+      });
+    });
+    while (!loading) {
+      std::this_thread::yield();
+    }
+    write();
+    release = true;
+    thread.join();
+    return result;
+  };
+
+  // The loader's caller gets its value, but the newer put stays
+  ASSERT_EQ("loaded", loadAround(1, [&cache]() { cache.put(1, "newer"); }));
+  std::string value;
+  ASSERT_TRUE(cache.get(1, value));
+  ASSERT_EQ("newer", value);
+
+  // Nor is an erase or a clear undone
+  ASSERT_EQ("loaded", loadAround(2, [&cache]() { cache.erase(2); }));
+  ASSERT_FALSE(cache.contains(2));
+  ASSERT_EQ("loaded", loadAround(3, [&cache]() { cache.clear(); }));
+  ASSERT_FALSE(cache.contains(3));
+
+  // Without a write, the load is cached
+  ASSERT_EQ("loaded", loadAround(4, []() {}));
+  ASSERT_TRUE(cache.contains(4));
+}
+
+struct ThrowingListener {
+  void operator()(const int&, std::string&&, LruEvictionReason) { throw std::runtime_error("listener"); }
+};
+
+TEST(ConcurrentLruCacheTest, getOrComputeListenerThrows) {
+  ConcurrentLruCache<int, std::string, 1, std::mutex, ThrowingListener> cache(1);
+  cache.put(1, "1");
+
+  // The value is published before the listener hears of the eviction, so only the
+  // listener's exception reaches the caller, and the flight is settled
+  ASSERT_THROW(cache.getOrCompute(2, [](int key) { return std::to_string(key); }), std::runtime_error);
+  ASSERT_TRUE(cache.contains(2));
+  ASSERT_EQ("2", cache.getOrCompute(2, [](int) -> std::string { throw std::logic_error("loaded twice"); }));
+}
+
+TEST(ConcurrentLruCacheTest, stats) {
+  ConcurrentLruCache<int, int, 4, std::mutex, NullEvictionListener, true> cache(400);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (int i = 0; i < 1000; ++i) {
+        int value = 0;
+        if (!cache.get(i * 4 + t, value)) {
+          cache.put(i * 4 + t, i);
+        }
+      }
+    });
+  }
+
+  // Snapshots are taken while the shards are busy
+  u64 lastMisses = 0;
+  for (int i = 0; i < 100; ++i) {
+    const auto misses = cache.snapshot().misses;
+    ASSERT_GE(misses, lastMisses);
+    lastMisses = misses;
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(2, cache.getOrCompute(10000, [](int) { return 2; }));
+  const auto stats = cache.snapshot();
+  ASSERT_EQ(0u, stats.hits);
+  ASSERT_EQ(4001u, stats.misses);
+  ASSERT_EQ(4001u, stats.inserts);
+  ASSERT_EQ(1u, stats.loads);
+  ASSERT_EQ(stats.inserts - cache.size(), stats.evicted(LruEvictionReason::Size));
+
+  // A loader that throws still counts as a load
+  ASSERT_THROW(cache.getOrCompute(10001, [](int) -> int { throw std::runtime_error("unavailable"); }),
+               std::runtime_error);
+  ASSERT_EQ(2u, cache.snapshot().loads);
+}
+
+TEST(ConcurrentLruCacheTest, purgeSome) {
+  ConcurrentLruCache<int, int, 4> cache(400);
+  for (int i = 0; i < 400; ++i) {
+    cache.put(i, i);
+  }
+  // Uneven shards may already have purged a few
+  const auto filled = cache.size();
+  cache.setPurgeBudget(5);
+  cache.setMaxSize(40);
+  ASSERT_EQ(filled - 20, cache.size());
+
+  sizex purged = 0;
+  sizex step = 0;
+  while ((step = cache.purgeSome(50)) != 0) {
+    purged += step;
+  }
+  ASSERT_EQ(filled - 60, purged);
+  ASSERT_EQ(40u, cache.size());
+}
+
+TEST(ConcurrentLruCacheTest, lookupsNotifyPurges) {
+  std::atomic<sizex> count{0};
+  ConcurrentLruCache<int, int, 4, std::mutex, CountingListener> cache(400, CountingListener{});
+  cache.evictionListener() = CountingListener{&cache, &count};
+  for (int i = 0; i < 400; ++i) {
+    cache.put(i, i);
+  }
+  cache.setPurgeBudget(2);
+  cache.setMaxSize(40);
+
+  // Lookups purge within the budget, and their evictions are handed over right away
+  int value = 0;
+  sizex loads = 0;
+  for (int i = 0; i < 20; ++i) {
+    cache.get(i, value);
+    cache.find(i, [](int&) {});
+    cache.getOrCompute(i, [&loads](int key) {
+      ++loads;
+      return key;
+    });
+    ASSERT_EQ(400u + loads - cache.size(), count.load());
+  }
+  ASSERT_LT(cache.size(), 360u);
+}
+
+SW_NAMESPACE_END
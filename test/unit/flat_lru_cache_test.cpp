@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/flat_lru_cache.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+
+struct Pod {
+  u32 a;
+  u32 b;
+};
+
+std::vector<u64> orderedKeys(const FlatLruCache<u64, Pod>& cache) {
+  std::vector<u64> result;
+  cache.forEachOrdered([&](const u64& key, const Pod&) { result.push_back(key); });
+  return result;
+}
+
+}  // namespace
+
+TEST(FlatLruCacheTest, putAndGet) {
+  FlatLruCache<u64, Pod> lru(10);
+  lru.put(1, Pod{1, 1});
+  lru.put(2, Pod{2, 2});
+  lru.put(3, Pod{3, 3});
+  ASSERT_EQ(3u, lru.size());
+  ASSERT_EQ(10u, lru.maxSize());
+
+  Pod pod{0, 0};
+  ASSERT_FALSE(lru.get(4, pod));
+  ASSERT_TRUE(lru.get(2, pod));
+  ASSERT_EQ(2u, pod.a);
+
+  lru.put(2, Pod{22, 22});
+  auto found = lru.find(2);
+  ASSERT_NE(nullptr, found);
+  ASSERT_EQ(22u, found->b);
+  ASSERT_EQ(nullptr, lru.find(5));
+  ASSERT_EQ(3u, lru.size());
+}
+
+TEST(FlatLruCacheTest, ordering) {
+  FlatLruCache<u64, Pod> lru(3);
+  lru.put(3, Pod{});
+  lru.put(2, Pod{});
+  lru.put(1, Pod{});
+  ASSERT_EQ((std::vector<u64>{1, 2, 3}), orderedKeys(lru));
+
+  lru.refresh(3);
+  ASSERT_EQ((std::vector<u64>{3, 1, 2}), orderedKeys(lru));
+
+  // Evicts the least recently used
+  lru.put(4, Pod{});
+  ASSERT_EQ((std::vector<u64>{4, 3, 1}), orderedKeys(lru));
+  ASSERT_FALSE(lru.contains(2));
+  ASSERT_EQ(3u, lru.size());
+}
+
+TEST(FlatLruCacheTest, erase) {
+  FlatLruCache<u64, Pod> lru(4);
+  lru.put(1, Pod{});
+  lru.put(2, Pod{});
+  lru.put(3, Pod{});
+  ASSERT_EQ(1u, lru.erase(2));
+  ASSERT_EQ(0u, lru.erase(2));
+  ASSERT_EQ(2u, lru.size());
+  ASSERT_EQ((std::vector<u64>{3, 1}), orderedKeys(lru));
+
+  lru.clear();
+  ASSERT_TRUE(lru.empty());
+  ASSERT_FALSE(lru.contains(1));
+}
+
+TEST(FlatLruCacheTest, matchesReference) {
+  // Hammer the index with colliding keys and compare against a simple reference
+  constexpr sizex kMaxSize = 64;
+  FlatLruCache<u64, Pod> lru(kMaxSize);
+  std::unordered_map<u64, u32> reference;
+  std::vector<u64> order;
+
+  u64 rnd = 88172645463325252_u64;
+  for (u32 i = 0; i < 20000; ++i) {
+    rnd ^= rnd << 13u;
+    rnd ^= rnd >> 7u;
+    rnd ^= rnd << 17u;
+    const u64 key = (rnd % 200) * 1024;
+
+    if (rnd % 5 == 0) {
+      const auto erased = lru.erase(key);
+      ASSERT_EQ(reference.erase(key), erased);
+      order.erase(std::remove(order.begin(), order.end(), key), order.end());
+      continue;
+    }
+
+    lru.put(key, Pod{i, i});
+    reference[key] = i;
+    order.erase(std::remove(order.begin(), order.end(), key), order.end());
+    order.insert(order.begin(), key);
+    if (order.size() > kMaxSize) {
+      reference.erase(order.back());
+      order.pop_back();
+    }
+
+    ASSERT_EQ(reference.size(), lru.size());
+  }
+
+  ASSERT_EQ(order, orderedKeys(lru));
+  for (const auto& kv : reference) {
+    Pod pod{0, 0};
+    ASSERT_TRUE(lru.get(kv.first, pod));
+    ASSERT_EQ(kv.second, pod.a);
+  }
+}
+
+SW_NAMESPACE_END
@@ -0,0 +1,80 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/frequency_sketch.h>
+
+#include <gtest/gtest.h>
+
+SW_NAMESPACE_BEGIN
+
+TEST(FrequencySketchTest, counts) {
+  FrequencySketch sketch(512);
+  const auto hot = FrequencySketch::spread(1);
+  const auto cold = FrequencySketch::spread(2);
+  for (int i = 0; i < 5; ++i) {
+    sketch.increment(hot);
+  }
+  sketch.increment(cold);
+  ASSERT_EQ(5u, sketch.frequency(hot));
+  ASSERT_EQ(1u, sketch.frequency(cold));
+  ASSERT_EQ(0u, sketch.frequency(FrequencySketch::spread(3)));
+
+  // Saturates
+  for (int i = 0; i < 100; ++i) {
+    sketch.increment(hot);
+  }
+  ASSERT_EQ(15u, sketch.frequency(hot));
+
+  sketch.clear();
+  ASSERT_EQ(0u, sketch.frequency(hot));
+}
+
+TEST(FrequencySketchTest, aging) {
+  FrequencySketch sketch(64);
+  const auto hot = FrequencySketch::spread(12345);
+  for (int i = 0; i < 12; ++i) {
+    sketch.increment(hot);
+  }
+  ASSERT_EQ(12u, sketch.frequency(hot));
+
+  // Enough other traffic to complete the sample halves the old counts
+  for (u64 i = 0; i < 1000; ++i) {
+    sketch.increment(FrequencySketch::spread(i + 1000000));
+  }
+  ASSERT_LT(sketch.frequency(hot), 12u);
+}
+
+TEST(FrequencySketchTest, accuracy) {
+  // Collisions only ever over-estimate, and rarely by much at capacity
+  FrequencySketch sketch(1024);
+  for (u64 key = 0; key < 1024; ++key) {
+    for (u64 i = 0; i < key % 4; ++i) {
+      sketch.increment(FrequencySketch::spread(key));
+    }
+  }
+
+  sizex exact = 0;
+  for (u64 key = 0; key < 1024; ++key) {
+    const auto estimate = sketch.frequency(FrequencySketch::spread(key));
+    ASSERT_GE(estimate, key % 4);
+    exact += (estimate == key % 4) ? 1 : 0;
+  }
+  ASSERT_GT(exact, 950u);
+}
+
+SW_NAMESPACE_END
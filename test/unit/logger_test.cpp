@@ -20,6 +20,20 @@
 
 #include <gtest/gtest.h>
 
+////////////////////////////////////////////////////////////////////////////////
+/// Counts how often it's formatted
+struct FormatCounter {
+  int* count;
+};
+
+template <>
+struct fmt::formatter<FormatCounter> : fmt::formatter<int> {
+  template <typename FormatContext>
+  auto format(const FormatCounter& counter, FormatContext& ctx) const {
+    return fmt::formatter<int>::format(++*counter.count, ctx);
+  }
+};
+
 SW_NAMESPACE_BEGIN
 
 struct TestLogEntry {
@@ -35,6 +49,8 @@ struct TestLogHandler : LogHandler {
     entries.emplace_back(TestLogEntry{cat, std::string{msg.data(), msg.size()}, force});
   };
 
+  void enable(LoggerCategory mask) { setEnabledCategories(mask); }
+
   std::vector<TestLogEntry> entries;
 };
 
@@ -56,4 +72,84 @@ TEST(LoggerTest, basic) {
   ASSERT_EQ(false, handler->entries[1].force);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST(LoggerTest, disabledCategoriesSkipFormatting) {
+  auto handler = std::make_shared<TestLogHandler>();
+  Logger logger(handler);
+  ASSERT_TRUE(logger.isEnabled(LoggerCategory::Debug));
+
+  int formatted = 0;
+  handler->enable(LoggerCategory::Info | LoggerCategory::Warn | LoggerCategory::Error);
+  ASSERT_FALSE(logger.isEnabled(LoggerCategory::Debug));
+  ASSERT_TRUE(logger.isEnabled(LoggerCategory::Warn));
+  logger.debugf("count={}", FormatCounter{&formatted});
+  logger.verbosef("count={}", FormatCounter{&formatted});
+  ASSERT_EQ(0, formatted);
+  ASSERT_TRUE(handler->entries.empty());
+
+  logger.infof("count={}", FormatCounter{&formatted});
+  ASSERT_EQ(1, formatted);
+  ASSERT_EQ(1u, handler->entries.size());
+  ASSERT_EQ(std::string{"count=1"}, handler->entries[0].msg);
+
+  // Forcing overrides the mask, unless the handler has disabled everything
+  logger.logForcef(LoggerCategory::Debug, "count={}", FormatCounter{&formatted});
+  ASSERT_EQ(2u, handler->entries.size());
+  ASSERT_TRUE(handler->entries[1].force);
+  handler->enable(LoggerCategory::None);
+  logger.logForcef(LoggerCategory::Debug, "count={}", FormatCounter{&formatted});
+  logger.errorf("count={}", FormatCounter{&formatted});
+  ASSERT_EQ(2, formatted);
+  ASSERT_EQ(2u, handler->entries.size());
+
+  // Rvalue arguments are forwarded
+  handler->enable(LoggerCategory::All);
+  const std::string big(1000, 'x');
+  std::string moved = big;
+  logger.infof("{}", std::move(moved));
+  ASSERT_EQ(big, handler->entries.back().msg);
+
+  // Without a handler nothing is enabled
+  Logger unusable;
+  ASSERT_FALSE(unusable.isEnabled(LoggerCategory::Error));
+  unusable.errorf("count={}", FormatCounter{&formatted});
+  ASSERT_EQ(2, formatted);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(LoggerTest, nullHandlerAndMoves) {
+  Logger null(LogHandlerRef{});
+  ASSERT_FALSE(null.isEnabled(LoggerCategory::Error));
+
+  // The moved-from logger lets go of the handler's categories along with the handler
+  auto handler = std::make_shared<TestLogHandler>();
+  Logger logger(handler);
+  Logger moved(std::move(logger));
+  ASSERT_TRUE(moved.isEnabled(LoggerCategory::Info));
+  ASSERT_FALSE(logger.isEnabled(LoggerCategory::Info));
+
+  null = std::move(moved);
+  handler.reset();
+  ASSERT_TRUE(null.isEnabled(LoggerCategory::Info));
+  ASSERT_FALSE(moved.isEnabled(LoggerCategory::Info));
+  null.info("hello");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(LoggerTest, handlersPublishCategories) {
+  ConsoleFileLogHandler::Config config;
+  config.consoleCategoryMask = LoggerCategory::Warn | LoggerCategory::Error;
+  Logger console(std::make_shared<ConsoleFileLogHandler>(config));
+  ASSERT_TRUE(console.isEnabled(LoggerCategory::Warn));
+  ASSERT_FALSE(console.isEnabled(LoggerCategory::Info));
+
+  config.console_destination = LoggerConsoleDestination::None;
+  Logger nowhere(std::make_shared<ConsoleFileLogHandler>(config));
+  ASSERT_FALSE(nowhere.isEnabled(LoggerCategory::Error));
+
+  Logger simple(std::make_shared<SimpleConsoleLogHandler>());
+  ASSERT_TRUE(simple.isEnabled(LoggerCategory::Info));
+  ASSERT_FALSE(simple.isEnabled(LoggerCategory::Debug));
+}
+
 SW_NAMESPACE_END
@@ -17,12 +17,18 @@
 /// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 ////////////////////////////////////////////////////////////////////////////////
 #include <sw/lru_cache.h>
+#include <sw/path_prefix_index.h>
+#include <sw/posix_path.h>
 
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <list>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 // As usual... minimal testing here... real testing TODO
 
@@ -305,5 +311,1098 @@ TEST(LruCacheTest, copyCacheMoveAndCopy) {
   }
 #endif
 }
+
+struct StringSizeWeigher {
+  sizex operator()(int, const std::string& value) const { return value.size(); }
+};
+
+struct WeighedTraits : LruCacheTraits<int, std::string> {
+  using Weigher = StringSizeWeigher;
+};
+
+TEST(LruCacheTest, weightPurge) {
+  LruCache<int, std::string, true, WeighedTraits> lru(100);
+  lru.setMaxWeight(10);
+  lru.put(1, "aaaa");
+  lru.put(2, "bbbb");
+  ASSERT_EQ(8u, lru.totalWeight());
+  ASSERT_EQ(2u, lru.size());
+
+  // Pushes the total over the limit, so the oldest goes
+  lru.put(3, "cccc");
+  ASSERT_EQ(8u, lru.totalWeight());
+  ASSERT_FALSE(lru.contains(1));
+
+  // Updating a value adjusts the weight, and may purge
+  lru.put(3, "c");
+  ASSERT_EQ(5u, lru.totalWeight());
+  lru.put(2, "bbbbbbbb");
+  ASSERT_EQ(9u, lru.totalWeight());
+  lru.put(3, "ccc");
+  ASSERT_EQ(3u, lru.totalWeight());
+  ASSERT_FALSE(lru.contains(2));
+
+  // An item heavier than the limit is kept on its own
+  lru.put(4, "dddddddddddddddd");
+  ASSERT_EQ(1u, lru.size());
+  ASSERT_EQ(16u, lru.totalWeight());
+
+  lru.erase(4);
+  ASSERT_EQ(0u, lru.totalWeight());
+}
+
+TEST(LruCacheTest, weightManualPurge) {
+  LruCache<int, std::string, false, WeighedTraits> lru(100);
+  lru[1] = "aaaa";
+  lru.reweigh(1);
+  lru.put(2, "bbbb");
+  lru.put(3, "cccc");
+  ASSERT_EQ(12u, lru.totalWeight());
+
+  lru.setMaxWeight(8);
+  ASSERT_EQ(3u, lru.size());
+  lru.purge();
+  ASSERT_EQ(2u, lru.size());
+  ASSERT_EQ(8u, lru.totalWeight());
+  ASSERT_FALSE(lru.contains(1));
+
+  // Copies and moves keep the weights
+  auto lru2 = lru;
+  ASSERT_EQ(8u, lru2.totalWeight());
+  ASSERT_EQ(8u, lru2.maxWeight());
+  auto lru3 = std::move(lru2);
+  ASSERT_EQ(8u, lru3.totalWeight());
+
+  lru3.clear();
+  ASSERT_EQ(0u, lru3.totalWeight());
+}
+
+TEST(LruCacheTest, unitWeight) {
+  LruCache<int, std::string> lru(3);
+  ASSERT_EQ(decltype(lru)::kUnlimitedWeight, lru.maxWeight());
+  lru.put(1, "1");
+  lru.put(2, "2");
+  ASSERT_EQ(2u, lru.totalWeight());
+  lru.setMaxWeight(1);
+  ASSERT_EQ(1u, lru.size());
+  ASSERT_TRUE(lru.contains(2));
+}
+
+namespace {
+
+/// A clock that only moves when told to
+struct FakeClock {
+  using duration = std::chrono::milliseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<FakeClock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() noexcept { return time_point(duration(nowMs)); }
+  static void advance(rep ms) noexcept { nowMs += ms; }
+
+  static rep nowMs;
+};
+
+FakeClock::rep FakeClock::nowMs = 1000;
+
+struct ExpiryTraits : LruCacheTraits<int, std::string> {
+  using ExpiryClock = FakeClock;
+};
+
+using ExpiringCache = LruCache<int, std::string, true, ExpiryTraits>;
+using Ms = std::chrono::milliseconds;
+
+}  // namespace
+
+TEST(LruCacheTest, getManyExpired) {
+  ExpiringCache lru(100);
+  for (int i = 0; i < 40; ++i) {
+    lru.put(i, std::to_string(i), Ms(i % 2 == 0 ? 100 : 1000));
+  }
+  FakeClock::advance(100);
+
+  // Duplicates of an expired key mustn't see it after it's erased
+  std::vector<int> keys;
+  for (int i = 0; i < 40; ++i) {
+    keys.push_back(i);
+    keys.push_back(i);
+  }
+  std::vector<std::string> values(keys.size());
+  std::vector<bool> found(keys.size());
+  ASSERT_EQ(40u, lru.getMany(keys.begin(), keys.end(), values.begin(), found.begin()));
+  for (sizex i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(keys[i] % 2 == 1, found[i]);
+    ASSERT_EQ(found[i] ? std::to_string(keys[i]) : "", values[i]);
+  }
+  ASSERT_EQ(20u, lru.size());
+}
+
+TEST(LruCacheTest, expireAfterWrite) {
+  ExpiringCache lru(10);
+  lru.put(1, "1", Ms(100));
+  lru.put(2, "2", Ms(200));
+  lru.put(3, "3");  // Never expires
+
+  FakeClock::advance(99);
+  std::string str;
+  ASSERT_TRUE(lru.get(1, str));
+  ASSERT_EQ("1", str);
+
+  // Hits don't extend the ttl
+  FakeClock::advance(1);
+  ASSERT_FALSE(lru.contains(1));
+  ASSERT_FALSE(lru.get(1, str));
+  ASSERT_EQ(lru.end(), lru.find(1));
+  ASSERT_EQ(2u, lru.size());
+
+  // A put restarts the ttl
+  lru.put(2, "22", Ms(200));
+  FakeClock::advance(150);
+  ASSERT_TRUE(lru.contains(2));
+  FakeClock::advance(50);
+  ASSERT_EQ("", lru[2]);
+
+  FakeClock::advance(100000);
+  ASSERT_TRUE(lru.contains(3));
+}
+
+TEST(LruCacheTest, expireAfterAccess) {
+  ExpiringCache lru(10);
+  lru.setExpiryMode(LruExpiryMode::AfterAccess);
+  lru.setDefaultTtl(Ms(100));
+  ASSERT_EQ(Ms(100), lru.defaultTtl());
+  lru.put(1, "1");
+  lru.put(2, "2");
+
+  // Every use of 1 restarts its ttl, while 2 is left to expire
+  for (int i = 0; i < 5; ++i) {
+    FakeClock::advance(60);
+    lru.refresh(1);
+  }
+  ASSERT_EQ(1u, lru.size());
+  ASSERT_TRUE(lru.contains(1));
+  ASSERT_FALSE(lru.contains(2));
+
+  FakeClock::advance(100);
+  ASSERT_EQ(1u, lru.expire());
+  ASSERT_TRUE(lru.empty());
+}
+
+TEST(LruCacheTest, expireReclaim) {
+  // Expired entries are reclaimed without being looked up
+  ExpiringCache lru(1000);
+  for (int i = 0; i < 100; ++i) {
+    lru.put(i, "x", Ms(10 + i));
+  }
+  lru.put(1000, "y");
+
+  FakeClock::advance(60);
+  ASSERT_EQ(51u, lru.expire());
+  ASSERT_EQ(50u, lru.size());
+
+  // Each operation does a bit of the work
+  FakeClock::advance(1000);
+  for (int i = 0; i < 100 && lru.size() > 1; ++i) {
+    lru.refresh(1000);
+  }
+  ASSERT_EQ(1u, lru.size());
+  ASSERT_TRUE(lru.contains(1000));
+
+  // Copies keep the deadlines
+  lru.put(1, "1", Ms(50));
+  auto lru2 = lru;
+  auto lru3 = std::move(lru2);
+  FakeClock::advance(50);
+  ASSERT_EQ(1u, lru3.expire());
+  ASSERT_TRUE(lru3.contains(1000));
+  lru.clear();
+  ASSERT_EQ(0u, lru.expire());
+}
+
+namespace {
+
+/// Records every eviction as "key:value:reason"
+struct RecordingListener {
+  void operator()(const int& key, std::string&& value, LruEvictionReason reason) {
+    log->push_back(std::to_string(key) + ":" + value + ":" + std::to_string(static_cast<int>(reason)));
+  }
+  std::vector<std::string>* log = nullptr;
+};
+
+struct ListenerTraits : LruCacheTraits<int, std::string> {
+  using EvictionListener = RecordingListener;
+};
+
+struct BatchListener {
+  void operator()(std::vector<LruEviction<int, std::string>>&& evictions) {
+    batches.push_back(std::move(evictions));
+  }
+  std::vector<std::vector<LruEviction<int, std::string>>> batches;
+};
+
+struct BatchTraits : LruCacheTraits<int, std::string> {
+  using EvictionListener = BatchListener;
+};
+
+}  // namespace
+
+TEST(LruCacheTest, evictionListener) {
+  std::vector<std::string> log;
+  LruCache<int, std::string, true, ListenerTraits> lru(2, RecordingListener{&log});
+  lru.put(1, "a");
+  lru.put(2, "b");
+  lru.put(3, "c");
+  lru.put(2, "bb");
+  lru.erase(3);
+  lru.put(4, "d");
+  lru.clear();
+  ASSERT_EQ((std::vector<std::string>{"1:a:0", "2:b:2", "3:c:1", "2:bb:1", "4:d:1"}), log);
+}
+
+TEST(LruCacheTest, batchEvictionListener) {
+  LruCache<int, std::string, false, BatchTraits> lru(10);
+  for (int i = 0; i < 10; ++i) {
+    lru.put(i, std::to_string(i));
+  }
+
+  // One batch for the whole purge, least recently used first
+  lru.setMaxSize(4);
+  lru.purge();
+  auto& batches = lru.evictionListener().batches;
+  ASSERT_EQ(1u, batches.size());
+  ASSERT_EQ(6u, batches[0].size());
+  ASSERT_EQ(0, batches[0][0].key);
+  ASSERT_EQ("5", batches[0][5].value);
+  ASSERT_EQ(LruEvictionReason::Size, batches[0][5].reason);
+
+  // Nothing removed, no batch
+  lru.put(20, "20");
+  lru.erase(30);
+  ASSERT_EQ(1u, batches.size());
+
+  lru.put(20, "21");
+  ASSERT_EQ(2u, batches.size());
+  ASSERT_EQ("20", batches[1][0].value);
+  ASSERT_EQ(LruEvictionReason::Replace, batches[1][0].reason);
+}
+
+TEST(LruCacheTest, expiryEvictionListener) {
+  struct Traits : ExpiryTraits {
+    using EvictionListener = RecordingListener;
+  };
+
+  std::vector<std::string> log;
+  LruCache<int, std::string, true, Traits> lru(10, RecordingListener{&log});
+  lru.put(1, "a", Ms(10));
+  lru.put(2, "b", Ms(20));
+  FakeClock::advance(10);
+  std::string str;
+  ASSERT_FALSE(lru.get(1, str));
+  FakeClock::advance(10);
+  ASSERT_EQ(1u, lru.expire());
+  ASSERT_EQ((std::vector<std::string>{"1:a:3", "2:b:3"}), log);
+}
+
+namespace {
+
+struct TinyLfuTraits : LruCacheTraits<int, int> {
+  using Admission = TinyLfuAdmission;
+};
+
+template <typename Cache>
+std::vector<int> orderedKeys(const Cache& lru) {
+  std::vector<int> result;
+  for (auto iter = lru.cbeginOrdered(); iter != lru.cendOrdered(); ++iter) {
+    result.push_back(iter.key());
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(LruCacheTest, tinyLfuScan) {
+  LruCache<int, int> lru(100);
+  LruCache<int, int, true, TinyLfuTraits> tinyLfu(100);
+
+  // A small, frequently used hot set, with a scan of keys used once running through it
+  auto use = [&](int key) {
+    int value = 0;
+    if (!lru.get(key, value)) {
+      lru.put(key, key);
+    }
+    if (!tinyLfu.get(key, value)) {
+      tinyLfu.put(key, key);
+    }
+  };
+  for (int i = 0; i < 20000; ++i) {
+    if (i % 5 == 0) {
+      use((i / 5) % 20);
+    }
+    lru.put(1000 + i, i);
+    tinyLfu.put(1000 + i, i);
+  }
+
+  int lruHot = 0;
+  int tinyLfuHot = 0;
+  for (int key = 0; key < 20; ++key) {
+    lruHot += lru.contains(key) ? 1 : 0;
+    tinyLfuHot += tinyLfu.contains(key) ? 1 : 0;
+  }
+  ASSERT_LT(lruHot, 20);
+  ASSERT_EQ(20, tinyLfuHot);
+  ASSERT_EQ(100u, tinyLfu.size());
+}
+
+TEST(LruCacheTest, tinyLfuConsistency) {
+  using Cache = LruCache<int, int, true, TinyLfuTraits>;
+  Cache lru(200);
+
+  u64 rnd = 88172645463325252_u64;
+  for (int i = 0; i < 50000; ++i) {
+    rnd ^= rnd << 13u;
+    rnd ^= rnd >> 7u;
+    rnd ^= rnd << 17u;
+    const auto key = static_cast<int>((rnd >> 8u) % 1000);
+    int value = 0;
+    switch (rnd % 4) {
+      case 0:
+        lru.erase(key);
+        ASSERT_FALSE(lru.contains(key));
+        break;
+      case 1:
+        if (lru.get(key, value)) {
+          ASSERT_EQ(key, value);
+        }
+        break;
+      default:
+        lru.put(key, key);
+        break;
+    }
+    ASSERT_LE(lru.size(), lru.maxSize());
+  }
+
+  const auto keys = orderedKeys(lru);
+  ASSERT_EQ(lru.size(), keys.size());
+
+  // Copies and moves keep the regions, so they evolve the same way
+  Cache copy(lru);
+  ASSERT_EQ(keys, orderedKeys(copy));
+  Cache moved(std::move(copy));
+  ASSERT_EQ(keys, orderedKeys(moved));
+  for (int key = 0; key < 300; ++key) {
+    lru.put(key, key);
+    moved.put(key, key);
+    lru.refresh(key / 2);
+    moved.refresh(key / 2);
+  }
+  ASSERT_EQ(orderedKeys(lru), orderedKeys(moved));
+
+  lru.setMaxSize(10);
+  ASSERT_EQ(10u, lru.size());
+  lru.clear();
+  lru.put(1, 1);
+  ASSERT_EQ((std::vector<int>{1}), orderedKeys(lru));
+}
+
+template <typename PolicyTag, typename AdmissionTag = NoAdmission>
+struct PolicyTraits : LruCacheTraits<int, int> {
+  using Policy = PolicyTag;
+  using Admission = AdmissionTag;
+};
+
+TEST(LruCacheTest, slruPolicy) {
+  LruCache<int, int, true, PolicyTraits<SlruPolicy>> lru(5);
+  for (int key = 1; key <= 5; ++key) {
+    lru.put(key, key);
+  }
+
+  // 1 and 2 are protected, so the probationary LRU goes first
+  lru.refresh(1);
+  lru.refresh(2);
+  ASSERT_EQ((std::vector<int>{2, 1, 5, 4, 3}), orderedKeys(lru));
+  lru.put(6, 6);
+  ASSERT_FALSE(lru.contains(3));
+
+  // A scan of one-time keys only churns probation
+  for (int key = 100; key < 120; ++key) {
+    lru.put(key, key);
+  }
+  ASSERT_TRUE(lru.contains(1));
+  ASSERT_TRUE(lru.contains(2));
+
+  // The protected segment is 4 of 5, so its LRU drops back to probation
+  for (int key = 100; key < 103; ++key) {
+    lru.put(key, key);
+    lru.refresh(key);
+  }
+  ASSERT_EQ((std::vector<int>{102, 101, 100, 2, 1}), orderedKeys(lru));
+  lru.put(200, 200);
+  ASSERT_FALSE(lru.contains(1));
+}
+
+TEST(LruCacheTest, twoQPolicy) {
+  // Kin is 2 and Kout is 4
+  LruCache<int, int, true, PolicyTraits<TwoQPolicy>> lru(8);
+  for (int key = 1; key <= 9; ++key) {
+    lru.put(key, key);
+  }
+  ASSERT_FALSE(lru.contains(1));
+
+  // Hits in A1in don't count, it's only coming back after being purged that does
+  lru.refresh(2);
+  lru.put(10, 10);
+  ASSERT_FALSE(lru.contains(2));
+  lru.put(1, 1);
+  for (int key = 100; key < 120; ++key) {
+    lru.put(key, key);
+  }
+  ASSERT_TRUE(lru.contains(1));
+  ASSERT_FALSE(lru.contains(3));
+}
+
+TEST(LruCacheTest, arcPolicy) {
+  LruCache<int, int, true, PolicyTraits<ArcPolicy>> lru(8);
+  for (int key = 1; key <= 4; ++key) {
+    lru.put(key, key);
+    lru.refresh(key);
+  }
+
+  // A scan stays in T1 and leaves T2 alone
+  for (int key = 100; key < 200; ++key) {
+    lru.put(key, key);
+  }
+  for (int key = 1; key <= 4; ++key) {
+    ASSERT_TRUE(lru.contains(key));
+  }
+
+  // Recently purged scan keys coming back grow T1's target, at T2's expense
+  for (int round = 0; round < 5; ++round) {
+    for (int key = 150; key < 156; ++key) {
+      lru.put(key, key);
+    }
+  }
+  ASSERT_FALSE(lru.contains(1) && lru.contains(2) && lru.contains(3) && lru.contains(4));
+  ASSERT_EQ(8u, lru.size());
+}
+
+TEST(LruCacheTest, lfuPolicy) {
+  LruCache<int, int, true, PolicyTraits<LfuPolicy>> lru(3);
+  lru.put(1, 1);
+  lru.put(2, 2);
+  lru.put(3, 3);
+  for (int i = 0; i < 3; ++i) {
+    lru.refresh(1);
+  }
+  lru.refresh(2);
+
+  lru.put(4, 4);
+  ASSERT_FALSE(lru.contains(3));
+  lru.put(5, 5);
+  ASSERT_FALSE(lru.contains(4));
+  ASSERT_EQ((std::vector<int>{1, 2, 5}), orderedKeys(lru));
+
+  // Ties go to the least recently used
+  lru.refresh(5);
+  ASSERT_EQ((std::vector<int>{1, 5, 2}), orderedKeys(lru));
+  lru.put(6, 6);
+  lru.put(7, 7);
+  ASSERT_EQ((std::vector<int>{1, 5, 7}), orderedKeys(lru));
+}
+
+struct HalfSlruPolicy : SlruPolicy {
+  static constexpr sizex kProtectedPercent = 50;
+};
+
+template <typename Traits>
+void checkPolicyConsistency() {
+  using Cache = LruCache<int, int, true, Traits>;
+  Cache lru(100);
+
+  u64 rnd = 88172645463325252_u64;
+  for (int i = 0; i < 30000; ++i) {
+    rnd ^= rnd << 13u;
+    rnd ^= rnd >> 7u;
+    rnd ^= rnd << 17u;
+    const auto key = static_cast<int>((rnd >> 8u) % 300);
+    int value = 0;
+    switch (rnd % 8) {
+      case 0:
+        lru.erase(key);
+        ASSERT_FALSE(lru.contains(key));
+        break;
+      case 1:
+      case 2:
+        if (lru.get(key, value)) {
+          ASSERT_EQ(key, value);
+        }
+        break;
+      case 3:
+        lru[key] = key;
+        break;
+      default:
+        lru.put(key, key);
+        ASSERT_TRUE(lru.contains(key));
+        break;
+    }
+    ASSERT_LE(lru.size(), lru.maxSize());
+  }
+
+  const auto keys = orderedKeys(lru);
+  ASSERT_EQ(lru.size(), keys.size());
+
+  // Copies and moves keep the policy's state, so they evolve the same way
+  Cache copy(lru);
+  ASSERT_EQ(keys, orderedKeys(copy));
+  Cache moved(std::move(copy));
+  ASSERT_EQ(keys, orderedKeys(moved));
+  ASSERT_TRUE(copy.empty());
+  copy.put(1, 1);
+  ASSERT_EQ((std::vector<int>{1}), orderedKeys(copy));
+  for (int key = 0; key < 400; ++key) {
+    lru.put(key, key);
+    moved.put(key, key);
+    lru.refresh(key / 2);
+    moved.refresh(key / 2);
+  }
+  ASSERT_EQ(orderedKeys(lru), orderedKeys(moved));
+
+  copy = moved;
+  ASSERT_EQ(orderedKeys(moved), orderedKeys(copy));
+  moved = std::move(copy);
+  ASSERT_EQ(orderedKeys(lru), orderedKeys(moved));
+
+  lru.setMaxSize(10);
+  ASSERT_EQ(10u, lru.size());
+  for (int key = 0; key < 50; ++key) {
+    lru.put(key, key);
+    ASSERT_LE(lru.size(), 10u);
+  }
+  lru.clear();
+  lru.put(1, 1);
+  ASSERT_EQ((std::vector<int>{1}), orderedKeys(lru));
+
+  // A loaded snapshot keeps the order, and the policy carries on from it
+  const auto path = ::testing::TempDir() + "lru_policy.snapshot";
+  ASSERT_TRUE(moved.saveSnapshot(path));
+  Cache loaded(100);
+  ASSERT_TRUE(loaded.loadSnapshot(path));
+  ASSERT_EQ(orderedKeys(moved), orderedKeys(loaded));
+  for (int key = 0; key < 400; ++key) {
+    loaded.put(key, key);
+    loaded.refresh(key / 2);
+    ASSERT_LE(loaded.size(), loaded.maxSize());
+    ASSERT_TRUE(loaded.contains(key));
+  }
+  std::remove(path.c_str());
+}
+
+TEST(LruCacheTest, policyConsistency) {
+  checkPolicyConsistency<PolicyTraits<LruPolicy>>();
+  checkPolicyConsistency<PolicyTraits<SlruPolicy>>();
+  checkPolicyConsistency<PolicyTraits<HalfSlruPolicy>>();
+  checkPolicyConsistency<PolicyTraits<TwoQPolicy>>();
+  checkPolicyConsistency<PolicyTraits<ArcPolicy>>();
+  checkPolicyConsistency<PolicyTraits<LfuPolicy>>();
+  checkPolicyConsistency<PolicyTraits<SlruPolicy, TinyLfuAdmission>>();
+  checkPolicyConsistency<PolicyTraits<TwoQPolicy, TinyLfuAdmission>>();
+  checkPolicyConsistency<PolicyTraits<ArcPolicy, TinyLfuAdmission>>();
+  checkPolicyConsistency<PolicyTraits<LfuPolicy, TinyLfuAdmission>>();
+}
+
+struct PairWeigher {
+  sizex operator()(int, int) const { return 2; }
+};
+
+template <typename PolicyTag>
+struct WeighedPolicyTraits : PolicyTraits<PolicyTag> {
+  using Weigher = PairWeigher;
+};
+
+template <typename Traits>
+void checkNewestKept() {
+  LruCache<int, int, true, Traits> lru(100);
+  lru.setMaxWeight(10);
+  for (int key = 1; key <= 5; ++key) {
+    lru.put(key, key);
+    lru.refresh(key);
+    lru.refresh(key);
+  }
+
+  // The older entries are all protected or used more, yet the new one isn't the victim
+  lru[42] = 7;
+  int value = 0;
+  ASSERT_TRUE(lru.get(42, value));
+  ASSERT_EQ(7, value);
+  ASSERT_EQ(5u, lru.size());
+  lru.put(43, 43);
+  ASSERT_TRUE(lru.contains(43));
+  ASSERT_EQ(5u, lru.size());
+  ASSERT_EQ(10u, lru.totalWeight());
+}
+
+TEST(LruCacheTest, policyKeepsNewestForWeight) {
+  checkNewestKept<WeighedPolicyTraits<LruPolicy>>();
+  checkNewestKept<WeighedPolicyTraits<SlruPolicy>>();
+  checkNewestKept<WeighedPolicyTraits<TwoQPolicy>>();
+  checkNewestKept<WeighedPolicyTraits<ArcPolicy>>();
+  checkNewestKept<WeighedPolicyTraits<LfuPolicy>>();
+}
+
+TEST(LruCacheTest, heterogeneousLookup) {
+  LruCache<std::string, int> lru(10);
+  lru.put("one", 1);
+  lru.put("two", 2);
+
+  const std::string buffer = "one,two,three";
+  const StringView one(buffer.data(), 3);
+  const StringView two(buffer.data() + 4, 3);
+  const StringView three(buffer.data() + 8, 5);
+  ASSERT_TRUE(lru.contains(one));
+  ASSERT_FALSE(lru.contains(three));
+  ASSERT_TRUE(lru.contains(StringWrapper("two")));
+  ASSERT_TRUE(lru.contains("one"));
+
+  int value = 0;
+  ASSERT_TRUE(lru.get(two, value));
+  ASSERT_EQ(2, value);
+  ASSERT_EQ(std::string("two"), lru.beginOrdered().key());
+  ASSERT_FALSE(lru.get(three, value));
+
+  auto iter = lru.find(one);
+  ASSERT_NE(lru.end(), iter);
+  ASSERT_EQ(1, iter.value());
+  ASSERT_EQ(lru.cend(), lru.cfind(StringWrapper("three")));
+
+  lru.refresh(two);
+  ASSERT_EQ(std::string("two"), lru.beginOrdered().key());
+  ASSERT_EQ(1u, lru.erase(one));
+  ASSERT_EQ(0u, lru.erase(one));
+  ASSERT_EQ(1u, lru.size());
+
+  // Empty and embedded-null views compare by size too
+  lru.put("", 0);
+  ASSERT_TRUE(lru.contains(StringView()));
+  ASSERT_FALSE(lru.contains(StringView("t\0o", 3)));
+}
+
+TEST(LruCacheTest, heterogeneousPathLookup) {
+  LruCache<PosixPath, int> lru(10);
+  lru.put(PosixPath("/usr/lib"), 1);
+  lru.put(PosixPath("/usr/bin"), 2);
+
+  const std::string line = "/usr/bin/env";
+  int value = 0;
+  ASSERT_TRUE(lru.get(StringView(line.data(), 8), value));
+  ASSERT_EQ(2, value);
+  ASSERT_FALSE(lru.contains(StringView(line.data(), line.size())));
+  ASSERT_TRUE(lru.contains("/usr/lib"));
+  ASSERT_EQ(1u, lru.erase(StringWrapper("/usr/lib")));
+  ASSERT_EQ(1u, lru.size());
+}
+
+TEST(LruCacheTest, getOrCompute) {
+  LruCache<int, std::string> lru(3);
+  int loads = 0;
+  auto loader = [&loads](int key) {
+    ++loads;
+    return std::to_string(key);
+  };
+
+  ASSERT_EQ("1", lru.getOrCompute(1, loader));
+  ASSERT_EQ("2", lru.getOrCompute(2, loader));
+  ASSERT_EQ("1", lru.getOrCompute(1, loader));
+  ASSERT_EQ(2, loads);
+  ASSERT_EQ(1, lru.beginOrdered().key());
+
+  lru.getOrCompute(3, loader);
+  lru.getOrCompute(4, loader);
+  ASSERT_EQ(3u, lru.size());
+  ASSERT_FALSE(lru.contains(2));
+
+  // A throwing loader leaves nothing behind
+  auto failing = [](int) -> std::string { throw std::runtime_error("load failed"); };
+  ASSERT_THROW(lru.getOrCompute(5, failing), std::runtime_error);
+  ASSERT_FALSE(lru.contains(5));
+  ASSERT_EQ(3u, lru.size());
+  ASSERT_EQ((std::vector<int>{4, 3, 1}), orderedKeys(lru));
+}
+
+TEST(LruCacheTest, getOrComputeExpired) {
+  FakeClock::nowMs = 1000;
+  ExpiringCache lru(10);
+  lru.setDefaultTtl(Ms(100));
+  int loads = 0;
+  auto loader = [&loads](int key) {
+    ++loads;
+    return std::to_string(key * 10);
+  };
+
+  ASSERT_EQ("10", lru.getOrCompute(1, loader));
+  FakeClock::nowMs += 50;
+  ASSERT_EQ("10", lru.getOrCompute(1, loader));
+  ASSERT_EQ(1, loads);
+
+  FakeClock::nowMs += 100;
+  ASSERT_EQ("10", lru.getOrCompute(1, loader));
+  ASSERT_EQ(2, loads);
+  ASSERT_EQ(1u, lru.size());
+}
+
+struct StatsTraits : LruCacheTraits<int, int> {
+  using Stats = LocalStats;
+};
+
+TEST(LruCacheTest, stats) {
+  static_assert(std::is_empty<lru_detail::LruStatsRecorder<NoStats>>::value, "Disabled stats must be empty");
+
+  LruCache<int, int, true, StatsTraits> lru(3);
+  int value = 0;
+  lru.put(1, 1);
+  lru.put(2, 2);
+  lru.put(1, 11);
+  ASSERT_TRUE(lru.get(1, value));
+  ASSERT_FALSE(lru.get(3, value));
+  ASSERT_EQ(lru.end(), lru.find(4));
+  lru[5] = 5;
+  lru[5] = 55;
+  lru.put(6, 6);
+  lru.erase(6);
+  ASSERT_EQ(7, lru.getOrCompute(7, [](int key) { return key; }));
+  ASSERT_EQ(7, lru.getOrCompute(7, [](int key) { return key; }));
+
+  auto stats = lru.snapshot();
+  ASSERT_EQ(3u, stats.hits);
+  ASSERT_EQ(4u, stats.misses);
+  ASSERT_EQ(5u, stats.inserts);
+  ASSERT_EQ(1u, stats.updates);
+  ASSERT_EQ(1u, stats.evicted(LruEvictionReason::Size));
+  ASSERT_EQ(1u, stats.evicted(LruEvictionReason::Erase));
+  ASSERT_EQ(1u, stats.evicted(LruEvictionReason::Replace));
+  ASSERT_EQ(0u, stats.evicted(LruEvictionReason::Expired));
+  ASSERT_EQ(1u, stats.loads);
+  ASSERT_DOUBLE_EQ(3.0 / 7.0, stats.hitRatio());
+
+  // A loader that throws still counts as a load
+  ASSERT_THROW(lru.getOrCompute(8, [](int) -> int { throw std::runtime_error("unavailable"); }), std::runtime_error);
+  ASSERT_EQ(2u, lru.snapshot().loads);
+  ASSERT_FALSE(lru.contains(8));
+
+  lru.clear();
+  ASSERT_EQ(4u, lru.snapshot().evicted(LruEvictionReason::Erase));
+  lru.resetStats();
+  ASSERT_EQ(0u, lru.snapshot().misses);
+}
+
+struct PoolTraits : LruCacheTraits<int, std::string> {
+  using Allocator = NodePoolAllocator<std::string>;
+};
+
+TEST(LruCacheTest, nodePool) {
+  LruCache<int, std::string, true, PoolTraits> lru(100);
+  for (int i = 0; i < 150; ++i) {
+    lru.put(i, std::to_string(i));
+  }
+
+  // Full, so every replacement recycles the evicted entry's nodes
+  auto& pool = lru.allocator().pool();
+  const auto upstream = pool.upstreamAllocations();
+  for (int i = 150; i < 10000; ++i) {
+    lru.put(i, std::to_string(i));
+    std::string value;
+    ASSERT_TRUE(lru.get(i - 10, value));
+  }
+  ASSERT_EQ(upstream, pool.upstreamAllocations());
+  ASSERT_EQ(100u, lru.size());
+
+  auto copy = lru;
+  ASSERT_NE(&pool, &copy.allocator().pool());
+  auto copyIter = copy.cbeginOrdered();
+  for (auto iter = lru.cbeginOrdered(); iter != lru.cendOrdered(); ++iter, ++copyIter) {
+    ASSERT_EQ(iter.key(), copyIter.key());
+    ASSERT_EQ(iter.value(), copyIter.value());
+  }
+
+  auto moved = std::move(lru);
+  ASSERT_EQ(&pool, &moved.allocator().pool());
+  moved.clear();
+  for (int i = 0; i < 100; ++i) {
+    moved.put(i, std::to_string(i));
+  }
+  ASSERT_EQ(upstream, pool.upstreamAllocations());
+  std::string value;
+  ASSERT_TRUE(moved.get(99, value));
+  ASSERT_EQ("99", value);
+}
+
+TEST(LruCacheTest, getManyPutMany) {
+  LruCache<int, std::string> lru(40);
+  std::vector<std::pair<int, std::string>> pairs;
+  for (int i = 0; i < 50; ++i) {
+    pairs.emplace_back(i, std::to_string(i));
+  }
+  lru.putMany(pairs.begin(), pairs.end());
+  ASSERT_EQ(40u, lru.size());
+  ASSERT_EQ(49, lru.cbeginOrdered().key());
+
+  std::vector<int> keys{5, 10, 49, 20, 100};
+  std::vector<std::string> values(keys.size());
+  bool found[5] = {};
+  ASSERT_EQ(3u, lru.getMany(keys.begin(), keys.end(), values.begin(), found));
+  ASSERT_EQ((std::vector<std::string>{"", "10", "49", "20", ""}), values);
+  ASSERT_FALSE(found[0]);
+  ASSERT_TRUE(found[1]);
+  ASSERT_TRUE(found[2]);
+  ASSERT_TRUE(found[3]);
+  ASSERT_FALSE(found[4]);
+
+  // Recency follows the order of the keys
+  auto iter = lru.cbeginOrdered();
+  ASSERT_EQ(20, iter.key());
+  ASSERT_EQ(49, (++iter).key());
+  ASSERT_EQ(10, (++iter).key());
+
+  // Updates and moved values
+  std::vector<std::pair<int, std::string>> updates{{10, "ten"}, {60, "sixty"}};
+  lru.putMany(std::make_move_iterator(updates.begin()), std::make_move_iterator(updates.end()));
+  ASSERT_TRUE(updates[1].second.empty());
+  ASSERT_EQ(40u, lru.size());
+  ASSERT_EQ(60, lru.cbeginOrdered().key());
+  ASSERT_EQ("ten", lru[10]);
+  ASSERT_FALSE(lru.contains(11));
+}
+
+TEST(LruCacheTest, snapshot) {
+  const auto path = ::testing::TempDir() + "lru_cache.snapshot";
+  LruCache<int, std::string> lru(10);
+  for (int i = 0; i < 10; ++i) {
+    lru.put(i, std::string(sizex(i) * 10, char('a' + i)));
+  }
+  lru.refresh(3);
+  ASSERT_TRUE(lru.saveSnapshot(path));
+
+  LruCache<int, std::string> loaded(10);
+  loaded.put(5, "newer");
+  ASSERT_TRUE(loaded.loadSnapshot(path));
+  ASSERT_EQ(10u, loaded.size());
+  ASSERT_EQ((std::vector<int>{5, 3, 9, 8, 7, 6, 4, 2, 1, 0}), orderedKeys(loaded));
+  ASSERT_EQ("newer", loaded[5]);
+  ASSERT_EQ(std::string(90, 'j'), loaded[9]);
+
+  // Only the most recent entries fit
+  LruCache<int, std::string> small(3);
+  ASSERT_TRUE(small.loadSnapshot(path));
+  ASSERT_EQ((std::vector<int>{3, 9, 8}), orderedKeys(small));
+
+  // Damaged and missing files
+  std::string bytes;
+  {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    ASSERT_NE(nullptr, file);
+    char chunk[256];
+    sizex count = 0;
+    while ((count = std::fread(chunk, 1, sizeof(chunk), file)) != 0) {
+      bytes.append(chunk, count);
+    }
+    std::fclose(file);
+  }
+  {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fwrite(bytes.data(), 1, bytes.size() - 5, file);
+    std::fclose(file);
+  }
+  LruCache<int, std::string> truncated(10);
+  ASSERT_FALSE(truncated.loadSnapshot(path));
+  ASSERT_EQ(9u, truncated.size());
+
+  std::remove(path.c_str());
+  ASSERT_FALSE(truncated.loadSnapshot(path));
+  ASSERT_FALSE(truncated.saveSnapshot(::testing::TempDir() + "missing/dir/lru.snapshot"));
+}
+
+TEST(LruCacheTest, snapshotExpiry) {
+  const auto path = ::testing::TempDir() + "lru_expiry.snapshot";
+  ExpiringCache lru(10);
+  lru.put(1, "1", Ms(100));
+  lru.put(2, "2", Ms(1000));
+  FakeClock::advance(100);
+  ASSERT_TRUE(lru.saveSnapshot(path));
+
+  ExpiringCache loaded(10);
+  ASSERT_TRUE(loaded.loadSnapshot(path));
+  ASSERT_EQ((std::vector<int>{2}), orderedKeys(loaded));
+  std::remove(path.c_str());
+}
+
+TEST(LruCacheTest, snapshotLfu) {
+  const auto path = ::testing::TempDir() + "lru_lfu.snapshot";
+  using Cache = LruCache<int, int, true, PolicyTraits<LfuPolicy>>;
+  Cache lru(4);
+  for (int key = 1; key <= 4; ++key) {
+    lru.put(key, key);
+  }
+  ASSERT_TRUE(lru.saveSnapshot(path));
+
+  // Loaded entries count as used once, so unused ones age out ahead of newer puts
+  Cache loaded(4);
+  ASSERT_TRUE(loaded.loadSnapshot(path));
+  loaded.refresh(1);
+  for (int key = 100; key < 110; ++key) {
+    loaded.put(key, key);
+  }
+  ASSERT_EQ((std::vector<int>{1, 109, 108, 107}), orderedKeys(loaded));
+  std::remove(path.c_str());
+}
+
+TEST(LruCacheTest, purgeBudget) {
+  LruCache<int, int> lru(1000);
+  for (int i = 0; i < 1000; ++i) {
+    lru.put(i, i);
+  }
+
+  lru.setPurgeBudget(10);
+  lru.setMaxSize(100);
+  ASSERT_EQ(990u, lru.size());
+  ASSERT_TRUE(lru.isOverLimit());
+
+  // Lookups carry on purging, and a put makes progress despite adding one
+  int value = 0;
+  ASSERT_TRUE(lru.get(999, value));
+  ASSERT_EQ(980u, lru.size());
+  lru.put(1000, 1000);
+  ASSERT_EQ(961u, lru.size());
+
+  ASSERT_EQ(500u, lru.purgeSome(500));
+  ASSERT_EQ(461u, lru.size());
+  ASSERT_EQ(361u, lru.purgeFor(std::chrono::seconds(10)));
+  ASSERT_FALSE(lru.isOverLimit());
+  ASSERT_EQ(0u, lru.purgeSome(500));
+
+  // The most recent entries survive
+  const auto keys = orderedKeys(lru);
+  ASSERT_EQ(1000, keys.front());
+  ASSERT_EQ(999, keys[1]);
+  ASSERT_EQ(901, keys.back());
+}
+
+TEST(LruCacheTest, purgeBudgetAdmission) {
+  LruCache<int, int, true, PolicyTraits<SlruPolicy, TinyLfuAdmission>> lru(1000);
+  for (int i = 0; i < 1000; ++i) {
+    lru.put(i, i);
+  }
+
+  lru.setPurgeBudget(2);
+  lru.setMaxSize(10);
+  for (int i = 0; i < 100; ++i) {
+    lru.put(i % 20, i);
+  }
+  while (lru.purgeSome(7) != 0) {
+  }
+  ASSERT_EQ(10u, lru.size());
+  lru.put(5000, 1);
+  ASSERT_EQ(10u, lru.size());
+}
+
+struct MissRatioTraits : LruCacheTraits<int, int> {
+  struct MissRatio : ShardsMissRatio {
+    static constexpr double kSamplingRate = 1.0;
+  };
+};
+
+TEST(LruCacheTest, missRatioCurve) {
+  static_assert(std::is_empty<lru_detail::LruMissRatioTracker<NoMissRatio>>::value, "Disabled must be empty");
+
+  // Cycling through 50 keys misses every time below 50 entries, and only the first time at 50
+  LruCache<int, int, true, MissRatioTraits> lru(25);
+  for (int round = 0; round < 10; ++round) {
+    for (int key = 0; key < 50; ++key) {
+      int value = 0;
+      if (!lru.get(key, value)) {
+        lru.put(key, key);
+      }
+    }
+  }
+
+  const auto& curve = lru.missRatioCurve();
+  ASSERT_EQ(500u, curve.references());
+  ASSERT_DOUBLE_EQ(1.0, curve.missRatio(25));
+  ASSERT_DOUBLE_EQ(1.0, curve.missRatio(48));
+  ASSERT_NEAR(0.1, curve.missRatio(64), 1e-9);
+  lru.resetMissRatioCurve();
+  ASSERT_EQ(0u, lru.missRatioCurve().references());
+}
+
+namespace {
+struct PathIndexTraits : LruCacheTraits<PosixPath, int> {
+  using KeyIndex = PathPrefixIndex;
+};
+}  // namespace
+
+TEST(LruCacheTest, invalidatePrefix) {
+  LruCache<PosixPath, int, true, PathIndexTraits> lru(6);
+  lru.put(PosixPath("/a/b"), 1);
+  lru.put(PosixPath("/a/b/c"), 2);
+  lru.put(PosixPath("/a/b/d/e"), 3);
+  lru.put(PosixPath("/a/bc"), 4);
+  lru.put(PosixPath("/x/y"), 5);
+
+  ASSERT_EQ(3u, lru.invalidate("/a/b/"));
+  ASSERT_EQ(2u, lru.size());
+  ASSERT_TRUE(lru.contains(PosixPath("/a/bc")));
+  ASSERT_EQ(0u, lru.invalidate("/a/b"));
+
+  // Evicted keys leave the index too, so only live keys are matched
+  for (int i = 0; i < 10; ++i) {
+    lru.put(PosixPath("/x/" + std::to_string(i)), i);
+  }
+  ASSERT_EQ(6u, lru.size());
+  ASSERT_EQ(6u, lru.keyIndex().size());
+  ASSERT_EQ(0u, lru.invalidate("/a"));
+  ASSERT_EQ(0u, lru.invalidate("/x/y"));
+  ASSERT_EQ(1u, lru.invalidate("/x/4"));
+  ASSERT_EQ(5u, lru.invalidate("/x"));
+  lru.put(PosixPath("/x/9"), 9);
+  ASSERT_EQ(1u, lru.size());
+
+  // Copies rebuild their index, and moved-from caches are left with an empty one
+  auto copy = lru;
+  ASSERT_EQ(1u, copy.invalidate("/"));
+  ASSERT_TRUE(copy.empty());
+  auto moved = std::move(lru);
+  ASSERT_EQ(0u, lru.keyIndex().size());
+  ASSERT_EQ(1u, moved.keyIndex().size());
+
+  moved.clear();
+  ASSERT_EQ(0u, moved.invalidate(""));
+}
+
+namespace {
+struct ThrowingWeigher {
+  sizex operator()(const std::string&, int value) const {
+    if (value < 0) {
+      throw std::runtime_error("unweighable");
+    }
+    return 1;
+  }
+};
+
+struct ThrowingPathTraits : LruCacheTraits<std::string, int> {
+  using KeyIndex = PathPrefixIndex;
+  using Weigher = ThrowingWeigher;
+};
+}  // namespace
+
+TEST(LruCacheTest, invalidatePrefixAfterThrow) {
+  // An entry that fails to be added never reaches the index
+  LruCache<std::string, int, true, ThrowingPathTraits> lru(6);
+  ASSERT_THROW(lru.put("/a", -1), std::runtime_error);
+  ASSERT_EQ(0u, lru.size());
+  ASSERT_EQ(0u, lru.keyIndex().size());
+
+  lru.put("/a", 1);
+  ASSERT_EQ(1u, lru.keyIndex().size());
+  ASSERT_EQ(1u, lru.invalidate("/"));
+  ASSERT_TRUE(lru.empty());
+}
 }
 ;  // namespace sw
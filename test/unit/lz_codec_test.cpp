@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/lz_codec.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+
+std::string roundTrip(const std::string& raw, sizex* compressedSize = nullptr) {
+  std::string compressed;
+  lzCompress(raw.data(), raw.size(), compressed);
+  EXPECT_LE(compressed.size(), lzMaxCompressedSize(raw.size()));
+  if (compressedSize != nullptr) {
+    *compressedSize = compressed.size();
+  }
+  std::string result = "junk";
+  EXPECT_TRUE(lzDecompress(compressed.data(), compressed.size(), raw.size(), result));
+  return result;
+}
+
+std::string jsonRecords(int count) {
+  std::string json = "[";
+  for (int i = 0; i < count; ++i) {
+    json += R"({"id": )" + std::to_string(i * 7919 % 100003) + R"(, "name": "user)" + std::to_string(i) +
+            R"(", "active": )" + (i % 3 == 0 ? "true" : "false") + R"(, "tags": ["alpha", "beta"]},)";
+  }
+  json += "]";
+  return json;
+}
+
+std::string randomBytes(sizex size) {
+  std::string bytes(size, '\0');
+  u64 rnd = 88172645463325252_u64;
+  for (auto& c : bytes) {
+    rnd ^= rnd << 13u;
+    rnd ^= rnd >> 7u;
+    rnd ^= rnd << 17u;
+    c = static_cast<char>(rnd);
+  }
+  return bytes;
+}
+
+}  // namespace
+
+TEST(LzCodecTest, roundTrip) {
+  ASSERT_EQ("", roundTrip(""));
+  ASSERT_EQ("a", roundTrip("a"));
+  ASSERT_EQ("abcd", roundTrip("abcd"));
+  ASSERT_EQ("abcdabcdabcd", roundTrip("abcdabcdabcd"));
+
+  // Runs overlap the bytes they copy, and need extra length bytes
+  const std::string run(100000, 'x');
+  sizex compressedSize = 0;
+  ASSERT_EQ(run, roundTrip(run, &compressedSize));
+  ASSERT_LT(compressedSize, 500u);
+
+  // Matches further back than the offset limit are just not found
+  const auto random = randomBytes(100000);
+  ASSERT_EQ(random + random, roundTrip(random + random));
+  ASSERT_EQ(random, roundTrip(random, &compressedSize));
+  ASSERT_GE(compressedSize, random.size());
+
+  for (sizex size = 0; size < 300; ++size) {
+    ASSERT_EQ(randomBytes(size), roundTrip(randomBytes(size)));
+    ASSERT_EQ(std::string(size, 'y'), roundTrip(std::string(size, 'y')));
+  }
+}
+
+TEST(LzCodecTest, compressesText) {
+  const auto json = jsonRecords(2000);
+  sizex compressedSize = 0;
+  ASSERT_EQ(json, roundTrip(json, &compressedSize));
+  ASSERT_LT(compressedSize * 3, json.size());
+}
+
+TEST(LzCodecTest, rejectsCorruptInput) {
+  const auto json = jsonRecords(50);
+  std::string compressed;
+  lzCompress(json.data(), json.size(), compressed);
+
+  std::string out;
+  ASSERT_FALSE(lzDecompress(compressed.data(), compressed.size(), json.size() - 1, out));
+  ASSERT_FALSE(lzDecompress(compressed.data(), compressed.size(), json.size() + 1, out));
+  for (sizex size = 0; size < compressed.size(); ++size) {
+    ASSERT_FALSE(lzDecompress(compressed.data(), size, json.size(), out));
+  }
+
+  // Damage may go unnoticed, but must never read or write out of bounds
+  for (sizex i = 0; i < compressed.size(); ++i) {
+    auto damaged = compressed;
+    damaged[i] = static_cast<char>(damaged[i] ^ 0x5a);
+    lzDecompress(damaged.data(), damaged.size(), json.size(), out);
+  }
+}
+
+SW_NAMESPACE_END
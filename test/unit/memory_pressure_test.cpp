@@ -0,0 +1,267 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/concurrent_lru_cache.h>
+#include <sw/lru_cache.h>
+#include <sw/memory_pressure.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#if SW_POSIX
+#  include <sys/stat.h>
+#endif
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+
+MemoryStatus makeStatus(double usage, double pressure = 0) {
+  MemoryStatus status;
+  status.ok = true;
+  status.limit = 1000000;
+  status.current = static_cast<u64>(usage * 1000000);
+  status.pressure = pressure;
+  return status;
+}
+
+void writeFile(const std::string& path, const char* contents) {
+  auto file = std::fopen(path.c_str(), "wb");
+  ASSERT_NE(nullptr, file);
+  std::fputs(contents, file);
+  std::fclose(file);
+}
+
+struct StringSizeWeigher {
+  sizex operator()(int, const std::string& value) const { return value.size(); }
+};
+
+struct WeighedTraits : LruCacheTraits<int, std::string> {
+  using Weigher = StringSizeWeigher;
+};
+
+}  // namespace
+
+#if SW_POSIX
+TEST(MemoryPressureTest, readStatus) {
+  const auto dir = ::testing::TempDir() + "memory_pressure_cgroup";
+  ::mkdir(dir.c_str(), 0755);
+  std::remove((dir + "/memory.stat").c_str());
+  writeFile(dir + "/memory.current", "734003200\n");
+  writeFile(dir + "/memory.max", "1073741824\n");
+  writeFile(dir + "/memory.high", "max\n");
+  writeFile(dir + "/memory.pressure",
+            "some avg10=12.50 avg60=3.10 avg300=0.80 total=123456\n"
+            "full avg10=1.00 avg60=0.50 avg300=0.10 total=2345\n");
+
+  auto status = readMemoryStatus(dir);
+  ASSERT_TRUE(status.ok);
+  ASSERT_EQ(734003200u, status.current);
+  ASSERT_EQ(1073741824u, status.limit);
+  ASSERT_DOUBLE_EQ(12.5, status.pressure);
+  ASSERT_NEAR(0.68, status.usage(), 0.01);
+
+  // The lower of max and high is the limit
+  writeFile(dir + "/memory.high", "805306368\n");
+  ASSERT_EQ(805306368u, readMemoryStatus(dir).limit);
+
+  // No limit at all
+  writeFile(dir + "/memory.max", "max\n");
+  writeFile(dir + "/memory.high", "max\n");
+  status = readMemoryStatus(dir);
+  ASSERT_TRUE(status.ok);
+  ASSERT_TRUE(status.limit == MemoryStatus::kUnlimited);
+  ASSERT_EQ(0.0, status.usage());
+
+  ASSERT_FALSE(readMemoryStatus(dir + "/missing").ok);
+
+  // Reclaimable page cache isn't part of the working set
+  writeFile(dir + "/memory.max", "1073741824\n");
+  writeFile(dir + "/memory.stat",
+            "anon 367001600\n"
+            "file 367001600\n"
+            "active_file 100000000\n"
+            "inactive_file 267001600\n"
+            "slab 1000\n");
+  status = readMemoryStatus(dir);
+  ASSERT_EQ(734003200u, status.current);
+  ASSERT_EQ(267001600u, status.inactiveFile);
+  ASSERT_EQ(467001600u, status.workingSet());
+  ASSERT_NEAR(0.43, status.usage(), 0.01);
+  std::remove((dir + "/memory.stat").c_str());
+}
+
+TEST(MemoryPressureTest, ownCgroupPath) {
+  const auto proc = ::testing::TempDir() + "memory_pressure_proc_cgroup";
+  writeFile(proc, "12:memory:/user.slice\n0::/system.slice/app.service\n");
+  ASSERT_EQ("/sys/fs/cgroup/system.slice/app.service", ownCgroupPath("/sys/fs/cgroup", proc));
+
+  // In its own cgroup namespace, the process is at the root of the mount
+  writeFile(proc, "0::/\n");
+  ASSERT_EQ("/sys/fs/cgroup", ownCgroupPath("/sys/fs/cgroup", proc));
+
+  // Without a cgroup v2 line, or the file, the mount is all there is
+  writeFile(proc, "4:memory:/docker/abc\n");
+  ASSERT_EQ("/sys/fs/cgroup", ownCgroupPath("/sys/fs/cgroup", proc));
+  std::remove(proc.c_str());
+  ASSERT_EQ("/sys/fs/cgroup", ownCgroupPath("/sys/fs/cgroup", proc));
+}
+#endif
+
+TEST(MemoryPressureTest, shrinkAndGrow) {
+  LruCache<int, int> cache(1000);
+  for (int i = 0; i < 1000; ++i) {
+    cache.put(i, i);
+  }
+
+  MemoryPressureMonitor::Options options;
+  options.purgeBudget = 30;
+  MemoryPressureMonitor monitor(options);
+  monitor.addCache(cache);
+  ASSERT_EQ(30u, cache.purgeBudget());
+
+  // Under the watermark, nothing changes
+  ASSERT_DOUBLE_EQ(1.0, monitor.update(makeStatus(0.5)));
+  ASSERT_EQ(1000u, cache.maxSize());
+
+  // Over it, the limit drops at once, but the entries go a budget at a time: once as the
+  // limit is set, and once more per poll
+  ASSERT_DOUBLE_EQ(0.9, monitor.update(makeStatus(0.95)));
+  ASSERT_EQ(900u, cache.maxSize());
+  ASSERT_EQ(940u, cache.size());
+
+  // Between the watermarks, the limit holds while the purging catches up
+  ASSERT_DOUBLE_EQ(0.9, monitor.update(makeStatus(0.85)));
+  ASSERT_EQ(910u, cache.size());
+  monitor.update(makeStatus(0.85));
+  monitor.update(makeStatus(0.85));
+  ASSERT_EQ(900u, cache.size());
+  ASSERT_FALSE(cache.isOverLimit());
+
+  // Stalls shrink the caches even when usage looks fine
+  ASSERT_DOUBLE_EQ(0.81, monitor.update(makeStatus(0.5, 20.0)));
+  ASSERT_EQ(static_cast<sizex>(1000 * monitor.scale()), cache.maxSize());
+
+  // Easing pressure isn't enough until it's under half the threshold
+  ASSERT_DOUBLE_EQ(0.81, monitor.update(makeStatus(0.5, 6.0)));
+  const auto grown = monitor.update(makeStatus(0.5, 1.0));
+  ASSERT_DOUBLE_EQ(0.81 * 1.05, grown);
+  ASSERT_EQ(static_cast<sizex>(1000 * grown), cache.maxSize());
+
+  // Growth stops at the registered limit, and shrinking at the minimum scale
+  for (int i = 0; i < 100; ++i) {
+    monitor.update(makeStatus(0.1));
+  }
+  ASSERT_DOUBLE_EQ(1.0, monitor.scale());
+  ASSERT_EQ(1000u, cache.maxSize());
+  for (int i = 0; i < 100; ++i) {
+    monitor.update(makeStatus(1.0));
+  }
+  ASSERT_DOUBLE_EQ(options.minScale, monitor.scale());
+  ASSERT_EQ(100u, cache.maxSize());
+  ASSERT_EQ(100u, cache.size());
+
+  // An unreadable status changes nothing
+  ASSERT_DOUBLE_EQ(options.minScale, monitor.update(MemoryStatus()));
+}
+
+TEST(MemoryPressureTest, byWeightAndRemove) {
+  LruCache<int, std::string, true, WeighedTraits> weighed(100);
+  weighed.setMaxWeight(1000);
+  LruCache<int, int> sized(100);
+
+  MemoryPressureMonitor monitor;
+  const auto weighedId = monitor.addCacheByWeight(weighed);
+  monitor.update(makeStatus(0.95));
+  ASSERT_EQ(900u, weighed.maxWeight());
+  ASSERT_EQ(100u, weighed.maxSize());
+
+  // A cache added while shrunk starts shrunk
+  const auto sizedId = monitor.addCache(sized);
+  ASSERT_EQ(90u, sized.maxSize());
+
+  ASSERT_TRUE(monitor.removeCache(weighedId));
+  ASSERT_FALSE(monitor.removeCache(weighedId));
+  monitor.update(makeStatus(0.95));
+  ASSERT_EQ(900u, weighed.maxWeight());
+  ASSERT_EQ(81u, sized.maxSize());
+  ASSERT_TRUE(monitor.removeCache(sizedId));
+}
+
+TEST(MemoryPressureTest, unlimitedWeight) {
+  LruCache<int, std::string, true, WeighedTraits> cache(100);
+  ASSERT_EQ(cache.kUnlimitedWeight, cache.maxWeight());
+
+  MemoryPressureMonitor monitor;
+  monitor.addCacheByWeight(cache);
+  monitor.update(makeStatus(0.95));
+  ASSERT_LT(cache.maxWeight(), cache.kUnlimitedWeight);
+
+  // Growing all the way back restores the unlimited weight exactly
+  for (int i = 0; i < 100 && monitor.scale() < 1.0; ++i) {
+    monitor.update(makeStatus(0.1));
+  }
+  ASSERT_EQ(1.0, monitor.scale());
+  ASSERT_EQ(cache.kUnlimitedWeight, cache.maxWeight());
+}
+
+#if SW_POSIX
+TEST(MemoryPressureTest, pollingThread) {
+  const auto dir = ::testing::TempDir() + "memory_pressure_thread";
+  ::mkdir(dir.c_str(), 0755);
+  writeFile(dir + "/memory.current", "990\n");
+  writeFile(dir + "/memory.max", "1000\n");
+
+  ConcurrentLruCache<int, int, 4> cache(400);
+  for (int i = 0; i < 400; ++i) {
+    cache.put(i, i);
+  }
+
+  MemoryPressureMonitor::Options options;
+  options.cgroupPath = dir;
+  MemoryPressureMonitor monitor(options);
+  monitor.addCache(cache);
+  monitor.start(std::chrono::milliseconds(1));
+
+  // Readers carry on while the monitor shrinks the cache underneath them
+  std::thread reader([&cache]() {
+    for (int i = 0; i < 20000; ++i) {
+      int value = -1;
+      if (cache.get(i % 400, value)) {
+        EXPECT_EQ(i % 400, value);
+      }
+    }
+  });
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (cache.maxSize() > 40 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  reader.join();
+  monitor.stop();
+  ASSERT_EQ(40u, cache.maxSize());
+  ASSERT_TRUE(monitor.lastStatus().ok);
+  ASSERT_EQ(990u, monitor.lastStatus().current);
+}
+#endif
+
+SW_NAMESPACE_END
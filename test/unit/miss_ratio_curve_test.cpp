@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/frequency_sketch.h>
+#include <sw/lru_cache.h>
+#include <sw/miss_ratio_curve.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Skewed keys, the smaller of two uniform picks
+std::vector<u64> skewedKeys(sizex count, u64 range) {
+  std::vector<u64> keys;
+  u64 rnd = 88172645463325252_u64;
+  auto next = [&]() {
+    rnd ^= rnd << 13u;
+    rnd ^= rnd >> 7u;
+    rnd ^= rnd << 17u;
+    return rnd;
+  };
+  for (sizex i = 0; i < count; ++i) {
+    keys.push_back(std::min(next() % range, next() % range));
+  }
+  return keys;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The true miss ratio of an LRU cache of the given size
+double simulate(const std::vector<u64>& keys, sizex cacheSize) {
+  LruCache<u64, int> lru(cacheSize);
+  sizex misses = 0;
+  for (auto key : keys) {
+    int value = 0;
+    if (!lru.get(key, value)) {
+      ++misses;
+      lru.put(key, 0);
+    }
+  }
+  return double(misses) / double(keys.size());
+}
+
+}  // namespace
+
+TEST(MissRatioEstimatorTest, exactWithoutSampling) {
+  const auto keys = skewedKeys(20000, 2000);
+  MissRatioEstimator estimator(2000, 2000, 1.0, 100000);
+  for (auto key : keys) {
+    estimator.access(FrequencySketch::spread(key));
+  }
+  ASSERT_EQ(1u, estimator.bucketSize());
+  ASSERT_EQ(20000u, estimator.references());
+  ASSERT_DOUBLE_EQ(1.0, estimator.samplingRate());
+  ASSERT_DOUBLE_EQ(1.0, estimator.missRatio(0));
+
+  for (sizex size : {1, 10, 100, 500, 1000, 1999}) {
+    ASSERT_NEAR(simulate(keys, size), estimator.missRatio(size), 1e-9) << size;
+  }
+  const auto curve = estimator.curve();
+  ASSERT_EQ(2000u, curve.size());
+  ASSERT_EQ(100u, curve[99].cacheSize);
+  ASSERT_NEAR(simulate(keys, 100), curve[99].missRatio, 1e-9);
+}
+
+TEST(MissRatioEstimatorTest, sampled) {
+  const auto keys = skewedKeys(400000, 100000);
+  MissRatioEstimator estimator(100000, 20, 0.05);
+  for (auto key : keys) {
+    estimator.access(FrequencySketch::spread(key));
+  }
+  ASSERT_EQ(5000u, estimator.bucketSize());
+  ASSERT_LE(estimator.samples(), 16384u);
+
+  for (sizex size : {5000, 20000, 50000}) {
+    ASSERT_NEAR(simulate(keys, size), estimator.missRatio(size), 0.03) << size;
+  }
+}
+
+TEST(MissRatioEstimatorTest, boundedSamples) {
+  const auto keys = skewedKeys(200000, 50000);
+  MissRatioEstimator estimator(50000, 10, 1.0, 2000);
+  for (auto key : keys) {
+    estimator.access(FrequencySketch::spread(key));
+  }
+  ASSERT_LE(estimator.samples(), 2000u);
+  ASSERT_LT(estimator.samplingRate(), 0.1);
+  ASSERT_NEAR(simulate(keys, 20000), estimator.missRatio(20000), 0.05);
+
+  estimator.clear();
+  ASSERT_EQ(0u, estimator.references());
+  ASSERT_DOUBLE_EQ(0.0, estimator.missRatio(100));
+}
+
+SW_NAMESPACE_END
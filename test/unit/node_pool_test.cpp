@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/node_pool.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+TEST(NodePoolTest, recyclesBlocks) {
+  NodePool pool;
+  auto a = pool.allocate(24, 8);
+  auto b = pool.allocate(24, 8);
+  ASSERT_NE(a, b);
+  ASSERT_EQ(1u, pool.upstreamAllocations());
+
+  // Most recently freed first
+  pool.deallocate(a, 24, 8);
+  pool.deallocate(b, 24, 8);
+  ASSERT_EQ(b, pool.allocate(24, 8));
+  ASSERT_EQ(a, pool.allocate(24, 8));
+
+  // Another size gets its own slab
+  auto c = pool.allocate(40, 8);
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(c) % 8);
+  ASSERT_EQ(2u, pool.upstreamAllocations());
+  pool.deallocate(c, 40, 8);
+  pool.deallocate(a, 24, 8);
+  pool.deallocate(b, 24, 8);
+}
+
+TEST(NodePoolTest, slabGrowth) {
+  NodePool pool;
+  pool.reserve(100);
+  std::vector<void*> blocks;
+  for (int i = 0; i < 100; ++i) {
+    blocks.push_back(pool.allocate(32, 16));
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(blocks.back()) % 16);
+  }
+
+  // Doubling from 16 to 100 nodes: 16, 16, 32, 36
+  ASSERT_EQ(4u, pool.upstreamAllocations());
+  for (auto block : blocks) {
+    pool.deallocate(block, 32, 16);
+  }
+  for (int i = 0; i < 100; ++i) {
+    blocks[sizex(i)] = pool.allocate(32, 16);
+  }
+  ASSERT_EQ(4u, pool.upstreamAllocations());
+
+  pool.allocate(32, 16);
+  ASSERT_EQ(5u, pool.upstreamAllocations());
+}
+
+TEST(NodePoolTest, containers) {
+  using Map = std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                                 NodePoolAllocator<std::pair<const int, int>>>;
+  Map map;
+  map.get_allocator().reserveNodes(64);
+  for (int i = 0; i < 64; ++i) {
+    map.emplace(i, i);
+  }
+  const auto upstream = map.get_allocator().pool().upstreamAllocations();
+  for (int i = 64; i < 10000; ++i) {
+    map.erase(i - 64);
+    map.emplace(i, i);
+  }
+  ASSERT_EQ(upstream, map.get_allocator().pool().upstreamAllocations());
+  ASSERT_EQ(64u, map.size());
+
+  // Copies get their own pool, moves keep it
+  Map copy(map);
+  ASSERT_TRUE(copy.get_allocator() != map.get_allocator());
+  ASSERT_EQ(map, copy);
+  const auto allocator = map.get_allocator();
+  Map moved(std::move(map));
+  ASSERT_TRUE(moved.get_allocator() == allocator);
+
+  std::list<int, NodePoolAllocator<int>> list(5, 1);
+  std::list<int, NodePoolAllocator<int>> other;
+  other = list;
+  ASSERT_EQ(list, other);
+  ASSERT_TRUE(list.get_allocator() != other.get_allocator());
+}
+
+struct alignas(256) OverAligned {
+  int value = 0;
+};
+
+TEST(NodePoolTest, overAligned) {
+  const auto isAligned = [](const void* addr) { return reinterpret_cast<std::uintptr_t>(addr) % 256 == 0; };
+
+  NodePoolAllocator<OverAligned> allocator;
+  std::vector<OverAligned*> nodes;
+  for (int i = 0; i < 64; ++i) {
+    nodes.push_back(allocator.allocate(1));
+    ASSERT_TRUE(isAligned(nodes.back()));
+  }
+  auto array = allocator.allocate(5);
+  ASSERT_TRUE(isAligned(array));
+  allocator.deallocate(array, 5);
+  for (auto node : nodes) {
+    allocator.deallocate(node, 1);
+  }
+
+  std::list<OverAligned, NodePoolAllocator<OverAligned>> list(16);
+  for (const auto& item : list) {
+    ASSERT_TRUE(isAligned(&item));
+  }
+}
+
+SW_NAMESPACE_END
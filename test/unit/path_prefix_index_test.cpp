@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/path_prefix_index.h>
+#include <sw/posix_path.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+std::vector<std::string> under(const PathPrefixIndex& index, const StringView& prefix) {
+  std::vector<std::string> keys;
+  index.collect(prefix, keys);
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+}  // namespace
+
+TEST(PathPrefixIndexTest, collect) {
+  PathPrefixIndex index;
+  for (const auto* path : {"/a", "/a/b", "/a/b/c", "/a/bc", "/", "rel/x", "/a/b/"}) {
+    index.insert(std::string(path));
+  }
+  index.insert(std::string("/a"));
+  ASSERT_EQ(7u, index.size());
+
+  using Keys = std::vector<std::string>;
+  ASSERT_EQ((Keys{"/a/b", "/a/b/", "/a/b/c"}), under(index, "/a/b"));
+  ASSERT_EQ((Keys{"/a/b", "/a/b/", "/a/b/c"}), under(index, "/a/b/"));
+  ASSERT_EQ((Keys{"/a/bc"}), under(index, "/a/bc"));
+  ASSERT_EQ((Keys{"/", "/a", "/a/b", "/a/b/", "/a/b/c", "/a/bc"}), under(index, "/"));
+  ASSERT_EQ((Keys{"rel/x"}), under(index, "rel"));
+  ASSERT_EQ(7u, under(index, "").size());
+  ASSERT_TRUE(under(index, "/a/q").empty());
+  ASSERT_TRUE(under(index, "/a/b/c/d").empty());
+
+  // PosixPath keys are built from the path strings
+  std::vector<PosixPath> paths;
+  index.collect("/a/bc", paths);
+  ASSERT_EQ(1u, paths.size());
+  ASSERT_EQ("/a/bc", paths[0].u8());
+}
+
+TEST(PathPrefixIndexTest, erasePrunes) {
+  PathPrefixIndex index;
+  index.insert(std::string("/a/b/c/d"));
+  index.insert(std::string("/a/b"));
+  index.erase(std::string("/a/b/c/d"));
+  index.erase(std::string("/a/b/c"));  // Not a key
+  index.erase(std::string("/q"));
+  ASSERT_EQ(1u, index.size());
+  ASSERT_EQ((std::vector<std::string>{"/a/b"}), under(index, "/a"));
+
+  index.erase(std::string("/a/b"));
+  ASSERT_TRUE(index.empty());
+  ASSERT_TRUE(under(index, "").empty());
+
+  // The empty key isn't the root of the absolute paths
+  index.insert(std::string(""));
+  index.insert(std::string("/z"));
+  ASSERT_EQ((std::vector<std::string>{"/z"}), under(index, "/"));
+  ASSERT_EQ((std::vector<std::string>{"", "/z"}), under(index, ""));
+  index.erase(std::string("/z"));
+  ASSERT_EQ(1u, index.size());
+  ASSERT_EQ((std::vector<std::string>{""}), under(index, ""));
+  index.erase(std::string(""));
+  ASSERT_TRUE(index.empty());
+
+  index.insert(std::string("/z"));
+  index.clear();
+  ASSERT_TRUE(index.empty());
+  ASSERT_TRUE(under(index, "/").empty());
+}
+
+SW_NAMESPACE_END
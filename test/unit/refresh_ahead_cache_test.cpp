@@ -0,0 +1,205 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/refresh_ahead_cache.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+
+struct FakeClock {
+  using duration = std::chrono::milliseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<FakeClock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() { return time_point(duration(ticks)); }
+  static rep ticks;
+};
+FakeClock::rep FakeClock::ticks = 0;
+
+using FakeCache = RefreshAheadCache<int, std::string, FakeClock, 4>;
+using std::chrono::milliseconds;
+
+/// Queues tasks until the test runs them
+struct ManualExecutor {
+  void runAll() {
+    auto tasks = std::move(queue);
+    queue.clear();
+    for (auto& task : tasks) {
+      task();
+    }
+  }
+  std::vector<std::function<void()>> queue;
+};
+
+}  // namespace
+
+TEST(RefreshAheadCacheTest, refreshInBackground) {
+  FakeClock::ticks = 0;
+  ManualExecutor executor;
+  int loads = 0;
+  FakeCache cache(
+      10, milliseconds(100), milliseconds(1000),
+      [&](const int& key) { return std::to_string(key) + "." + std::to_string(++loads); },
+      [&](std::function<void()> task) { executor.queue.push_back(std::move(task)); });
+
+  // A miss loads in the foreground
+  ASSERT_EQ("1.1", cache.get(1));
+  ASSERT_EQ("1.1", cache.get(1));
+  ASSERT_EQ(1, loads);
+  ASSERT_TRUE(executor.queue.empty());
+
+  // Stale reads are served straight away, and share one refresh
+  FakeClock::ticks = 150;
+  ASSERT_EQ("1.1", cache.get(1));
+  ASSERT_EQ("1.1", cache.get(1));
+  ASSERT_EQ(1u, executor.queue.size());
+  ASSERT_EQ(1u, cache.pendingRefreshes());
+  ASSERT_EQ(1, loads);
+
+  executor.runAll();
+  ASSERT_EQ(0u, cache.pendingRefreshes());
+  ASSERT_EQ("1.2", cache.get(1));
+  ASSERT_TRUE(executor.queue.empty());
+
+  // Past expiry the value isn't served, it's loaded again in the foreground
+  FakeClock::ticks = 2000;
+  ASSERT_EQ("1.3", cache.get(1));
+  ASSERT_TRUE(executor.queue.empty());
+}
+
+TEST(RefreshAheadCacheTest, failedRefresh) {
+  FakeClock::ticks = 0;
+  ManualExecutor executor;
+  bool fail = false;
+  int loads = 0;
+  FakeCache cache(
+      10, milliseconds(100), milliseconds(1000),
+      [&](const int&) -> std::string {
+        if (fail) {
+          throw std::runtime_error("unavailable");
+        }
+        return std::to_string(++loads);
+      },
+      [&](std::function<void()> task) { executor.queue.push_back(std::move(task)); });
+
+  ASSERT_EQ("1", cache.get(7));
+  FakeClock::ticks = 200;
+  fail = true;
+  ASSERT_EQ("1", cache.get(7));
+  executor.runAll();
+
+  // The stale value survives, and the next read retries
+  ASSERT_EQ("1", cache.get(7));
+  ASSERT_EQ(1u, executor.queue.size());
+  fail = false;
+  executor.runAll();
+  ASSERT_EQ("2", cache.get(7));
+
+  // A foreground load failing throws to the caller and caches nothing
+  fail = true;
+  ASSERT_THROW(cache.get(8), std::runtime_error);
+  ASSERT_FALSE(cache.contains(8));
+
+  // As does an executor refusing the task, which just drops the refresh
+  FakeCache refusing(
+      10, milliseconds(100), milliseconds(1000), [](const int&) { return std::string("x"); },
+      [](std::function<void()>) { throw std::runtime_error("full"); });
+  FakeClock::ticks = 0;
+  ASSERT_EQ("x", refusing.get(1));
+  FakeClock::ticks = 200;
+  ASSERT_EQ("x", refusing.get(1));
+  ASSERT_EQ(0u, refusing.pendingRefreshes());
+}
+
+TEST(RefreshAheadCacheTest, refreshLosesToWrites) {
+  FakeClock::ticks = 0;
+  ManualExecutor executor;
+  int loads = 0;
+  FakeCache cache(
+      10, milliseconds(100), milliseconds(1000),
+      [&](const int& key) { return std::to_string(key) + "." + std::to_string(++loads); },
+      [&](std::function<void()> task) { executor.queue.push_back(std::move(task)); });
+
+  ASSERT_EQ("1.1", cache.get(1));
+  ASSERT_EQ("2.2", cache.get(2));
+  FakeClock::ticks = 150;
+  ASSERT_EQ("1.1", cache.get(1));
+  ASSERT_EQ("2.2", cache.get(2));
+  ASSERT_EQ(2u, executor.queue.size());
+
+  // A put after the refresh was scheduled wins, and an erased key stays erased
+  cache.put(1, "put");
+  cache.erase(2);
+  executor.runAll();
+  ASSERT_EQ(4, loads);
+  ASSERT_EQ("put", cache.get(1));
+  ASSERT_FALSE(cache.contains(2));
+
+  // Refreshing a missing key does nothing
+  cache.refresh(3);
+  ASSERT_TRUE(executor.queue.empty());
+}
+
+TEST(RefreshAheadCacheTest, threaded) {
+  std::atomic<int> loads{0};
+  std::vector<std::thread> workers;
+  std::mutex workersMutex;
+  {
+    RefreshAheadCache<int, int> cache(
+        100, std::chrono::milliseconds(0), std::chrono::hours(1),
+        [&](const int& key) {
+          ++loads;
+          return key;
+        },
+        [&](std::function<void()> task) {
+          std::lock_guard<std::mutex> lock(workersMutex);
+          workers.emplace_back(std::move(task));
+        });
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+      readers.emplace_back([&cache]() {
+        for (int i = 0; i < 200; ++i) {
+          EXPECT_EQ(i % 10, cache.get(i % 10));
+        }
+      });
+    }
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    // The destructor waits for the refreshes still running
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  ASSERT_GE(loads.load(), 10);
+}
+
+SW_NAMESPACE_END
@@ -0,0 +1,197 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/shared_lru_cache.h>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <string>
+
+#if SW_POSIX
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+SW_NAMESPACE_BEGIN
+
+#if SW_POSIX
+
+namespace {
+
+struct Point {
+  int x;
+  int y;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// A region name unique to the test and process, unlinked before and after
+class SharedName {
+public:
+  explicit SharedName(const char* test) :
+      name_(std::string("/sw-shared-lru-") + test + "-" + std::to_string(::getpid())) {
+    SharedLruCache<int, int>::unlink(name_);
+  }
+  ~SharedName() { SharedLruCache<int, int>::unlink(name_); }
+  const std::string& str() const { return name_; }
+
+private:
+  std::string name_;
+};
+
+/// Run `func` in a child process, returning its exit code
+template <typename Func>
+int inChild(Func&& func) {
+  const auto pid = ::fork();
+  if (pid == 0) {
+    func();
+    ::_exit(0);
+  }
+  int status = 0;
+  ::waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+}  // namespace
+
+TEST(SharedLruCacheTest, sharedBetweenMappings) {
+  SharedName name("basic");
+  SharedLruCache<int, Point> first(name.str(), 3);
+  SharedLruCache<int, Point> second(name.str(), 3);
+  ASSERT_TRUE(first.ok());
+  ASSERT_TRUE(second.ok());
+  ASSERT_EQ(3u, second.capacity());
+
+  first.put(1, Point{1, 10});
+  first.put(2, Point{2, 20});
+  ASSERT_EQ(2u, second.size());
+
+  Point point{0, 0};
+  ASSERT_TRUE(second.get(1, point));
+  ASSERT_EQ(10, point.y);
+  ASSERT_FALSE(second.get(3, point));
+
+  // 1 was just used, so 2 is the oldest when 4 arrives
+  second.put(3, Point{3, 30});
+  second.put(4, Point{4, 40});
+  ASSERT_EQ(3u, first.size());
+  ASSERT_TRUE(first.contains(1));
+  ASSERT_FALSE(first.contains(2));
+
+  // Updates are in place, and reads can be too
+  first.put(4, Point{4, 44});
+  ASSERT_TRUE(second.find(4, [](const Point& value) { ASSERT_EQ(44, value.y); }));
+  ASSERT_FALSE(second.find(2, [](const Point&) { FAIL(); }));
+
+  ASSERT_EQ(1u, second.erase(3));
+  ASSERT_EQ(0u, second.erase(3));
+  ASSERT_EQ(2u, first.size());
+  first.put(5, Point{5, 50});
+  first.put(6, Point{6, 60});
+  ASSERT_EQ(3u, second.size());
+  ASSERT_FALSE(second.contains(1));
+
+  second.clear();
+  ASSERT_TRUE(first.empty());
+  first.put(7, Point{7, 70});
+  ASSERT_TRUE(second.contains(7));
+}
+
+TEST(SharedLruCacheTest, arrayKeys) {
+  // No std::hash for arrays, so the key bytes are hashed as they're compared
+  using Key = std::array<u32, 3>;
+  SharedName name("array");
+  SharedLruCache<Key, int> cache(name.str(), 10);
+  ASSERT_TRUE(cache.ok());
+  cache.put(Key{{1, 2, 3}}, 123);
+  cache.put(Key{{3, 2, 1}}, 321);
+
+  int value = 0;
+  ASSERT_TRUE(cache.get(Key{{1, 2, 3}}, value));
+  ASSERT_EQ(123, value);
+  ASSERT_TRUE(cache.get(Key{{3, 2, 1}}, value));
+  ASSERT_EQ(321, value);
+  ASSERT_FALSE(cache.contains(Key{{1, 2, 4}}));
+}
+
+TEST(SharedLruCacheTest, layoutMismatch) {
+  SharedName name("layout");
+  SharedLruCache<int, int> cache(name.str(), 10);
+  ASSERT_TRUE(cache.ok());
+
+  SharedLruCache<int, int> otherCapacity(name.str(), 20);
+  ASSERT_FALSE(otherCapacity.ok());
+  SharedLruCache<int, u64> otherValue(name.str(), 10);
+  ASSERT_FALSE(otherValue.ok());
+
+  // Does nothing rather than failing
+  otherValue.put(1, 1);
+  u64 value = 0;
+  ASSERT_FALSE(otherValue.get(1, value));
+  ASSERT_EQ(0u, otherValue.size());
+  ASSERT_EQ(0u, otherValue.capacity());
+  ASSERT_TRUE(cache.empty());
+}
+
+TEST(SharedLruCacheTest, otherProcess) {
+  SharedName name("process");
+  SharedLruCache<u64, u64> cache(name.str(), 100);
+  ASSERT_TRUE(cache.ok());
+
+  ASSERT_EQ(0, inChild([&name]() {
+              SharedLruCache<u64, u64> child(name.str(), 100);
+              for (u64 i = 0; i < 150; ++i) {
+                child.put(i, i * i);
+              }
+            }));
+
+  ASSERT_EQ(100u, cache.size());
+  for (u64 i = 0; i < 150; ++i) {
+    u64 value = 0;
+    ASSERT_EQ(i >= 50, cache.get(i, value));
+    if (i >= 50) {
+      ASSERT_EQ(i * i, value);
+    }
+  }
+}
+
+#  if SW_LINUX
+TEST(SharedLruCacheTest, ownerDied) {
+  SharedName name("died");
+  SharedLruCache<int, int> cache(name.str(), 10);
+  cache.put(1, 1);
+  cache.put(2, 2);
+
+  // The child dies holding the lock, so the cache is cleared rather than deadlocked
+  ASSERT_EQ(3, inChild([&name]() {
+              SharedLruCache<int, int> child(name.str(), 10);
+              child.find(1, [](const int&) { ::_exit(3); });
+            }));
+
+  int value = 0;
+  ASSERT_FALSE(cache.get(1, value));
+  ASSERT_EQ(0u, cache.size());
+  cache.put(3, 3);
+  ASSERT_TRUE(cache.get(3, value));
+  ASSERT_EQ(3, value);
+}
+#  endif
+
+#endif  // SW_POSIX
+
+SW_NAMESPACE_END
@@ -0,0 +1,119 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/snapshot_io.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+SW_NAMESPACE_BEGIN
+
+TEST(SnapshotIoTest, roundTrip) {
+  const auto path = ::testing::TempDir() + "snapshot_io.bin";
+  const std::string big(100 * 1024, 'x');
+  {
+    SnapshotWriter out(path);
+    ASSERT_TRUE(out.ok());
+    for (u64 value : {0_u64, 127_u64, 128_u64, 300_u64, ~0_u64}) {
+      out.writeSize(value);
+    }
+    SnapshotSerializer<double>::write(out, 2.5);
+    SnapshotSerializer<std::string>::write(out, "hello");
+    SnapshotSerializer<std::string>::write(out, big);
+    SnapshotSerializer<std::string>::write(out, "");
+
+    // Not in place until finished
+    SnapshotReader early(path);
+    ASSERT_FALSE(early.ok());
+    ASSERT_TRUE(out.finish());
+  }
+
+  SnapshotReader in(path);
+  ASSERT_TRUE(in.ok());
+  for (u64 value : {0_u64, 127_u64, 128_u64, 300_u64, ~0_u64}) {
+    ASSERT_EQ(value, in.readSize());
+  }
+  ASSERT_EQ(2.5, SnapshotSerializer<double>::read(in));
+  ASSERT_EQ("hello", SnapshotSerializer<std::string>::read(in));
+  ASSERT_EQ(big, SnapshotSerializer<std::string>::read(in));
+  ASSERT_EQ("", SnapshotSerializer<std::string>::read(in));
+  ASSERT_TRUE(in.ok());
+  ASSERT_TRUE(in.atEnd());
+
+  // Reading past the end fails, and stays failed
+  ASSERT_EQ(0, SnapshotSerializer<int>::read(in));
+  ASSERT_FALSE(in.ok());
+  std::remove(path.c_str());
+}
+
+TEST(SnapshotIoTest, unfinished) {
+  const auto path = ::testing::TempDir() + "snapshot_unfinished.bin";
+  std::string tempPath;
+  {
+    SnapshotWriter out(path);
+    out.writeSize(1);
+    tempPath = out.tempPath();
+    ASSERT_NE(path, tempPath);
+  }
+  SnapshotReader in(path);
+  ASSERT_FALSE(in.ok());
+  ASSERT_EQ(0u, in.readSize());
+  ASSERT_EQ(nullptr, std::fopen(tempPath.c_str(), "rb"));
+}
+
+TEST(SnapshotIoTest, racingWriters) {
+  const auto path = ::testing::TempDir() + "snapshot_racing.bin";
+  {
+    SnapshotWriter first(path);
+    SnapshotWriter second(path);
+    ASSERT_NE(first.tempPath(), second.tempPath());
+    first.writeSize(1);
+    second.writeSize(2);
+    ASSERT_TRUE(second.finish());
+    ASSERT_TRUE(first.finish());
+  }
+
+  // The last to finish wins
+  SnapshotReader in(path);
+  ASSERT_EQ(1u, in.readSize());
+  ASSERT_TRUE(in.atEnd());
+  std::remove(path.c_str());
+}
+
+TEST(SnapshotIoTest, inMemory) {
+  SnapshotWriter out;
+  ASSERT_TRUE(out.ok());
+  const std::string big(100 * 1024, 'y');
+  SnapshotSerializer<std::string>::write(out, big);
+  SnapshotSerializer<int>::write(out, 42);
+  ASSERT_TRUE(out.finish());
+
+  const auto& bytes = out.bytes();
+  SnapshotReader in(bytes.data(), bytes.size());
+  ASSERT_EQ(big, SnapshotSerializer<std::string>::read(in));
+  ASSERT_EQ(42, SnapshotSerializer<int>::read(in));
+  ASSERT_TRUE(in.ok());
+  ASSERT_TRUE(in.atEnd());
+
+  out.clearBytes();
+  ASSERT_TRUE(out.bytes().empty());
+}
+
+SW_NAMESPACE_END
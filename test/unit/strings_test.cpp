@@ -102,4 +102,25 @@ TEST(StringsTest, startsWith) {
   ASSERT_FALSE(sw::startsWith(sv, "foobar.exef"));
 }
 
+TEST(StringsTest, stringHash) {
+  const StringHash hash;
+  const StringEqual equal;
+  const std::string str = "hello world, it's a longer string";
+  const StringView view(str.data(), str.size());
+  ASSERT_EQ(hash(str), hash(view));
+  ASSERT_EQ(hash(str), hash(StringWrapper(str)));
+  ASSERT_EQ(hash(str), hash(str.c_str()));
+  ASSERT_NE(hash(str), hash(StringView(str.data(), 5)));
+  ASSERT_EQ(hash(std::string("hello")), hash(StringView(str.data(), 5)));
+
+  ASSERT_TRUE(equal(str, view));
+  ASSERT_TRUE(equal("hello", StringView(str.data(), 5)));
+  ASSERT_FALSE(equal(str, StringView(str.data(), 5)));
+
+  // Every tail length hashes differently
+  for (sizex len = 0; len < 16; ++len) {
+    ASSERT_NE(hash(StringView(str.data(), len)), hash(StringView(str.data(), len + 1)));
+  }
+}
+
 SW_NAMESPACE_END
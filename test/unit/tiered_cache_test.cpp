@@ -0,0 +1,152 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/tiered_cache.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+#if SW_POSIX
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+SW_NAMESPACE_BEGIN
+
+TEST(TieredCacheTest, spillAndPromote) {
+  const auto path = ::testing::TempDir() + "tiered_spill.bin";
+  {
+    TieredCache<int, std::string> cache(3, path, 1024 * 1024);
+    ASSERT_TRUE(cache.isDiskOk());
+    for (int i = 0; i < 10; ++i) {
+      cache.put(i, std::to_string(i));
+    }
+    ASSERT_EQ(3u, cache.memorySize());
+    ASSERT_EQ(7u, cache.diskSize());
+    ASSERT_EQ(10u, cache.size());
+    ASSERT_TRUE(cache.contains(0));
+    ASSERT_EQ(cache.diskBytes(), cache.fileBytes());
+
+    // A disk hit promotes the entry, spilling memory's least recently used in its place
+    std::string value;
+    ASSERT_TRUE(cache.get(0, value));
+    ASSERT_EQ("0", value);
+    ASSERT_TRUE(cache.memory().contains(0));
+    ASSERT_FALSE(cache.memory().contains(7));
+    ASSERT_EQ(3u, cache.memorySize());
+    ASSERT_EQ(7u, cache.diskSize());
+    for (int i = 0; i < 10; ++i) {
+      ASSERT_TRUE(cache.get(i, value));
+      ASSERT_EQ(std::to_string(i), value);
+    }
+    ASSERT_FALSE(cache.get(10, value));
+
+    // Replacing or erasing a spilled entry leaves no stale copy behind
+    cache.put(100, "100");
+    cache.put(101, "101");
+    cache.put(102, "102");
+    ASSERT_FALSE(cache.memory().contains(9));
+    cache.put(9, "nine");
+    ASSERT_TRUE(cache.get(9, value));
+    ASSERT_EQ("nine", value);
+    ASSERT_EQ(1u, cache.erase(5));
+    ASSERT_FALSE(cache.get(5, value));
+    ASSERT_EQ(12u, cache.size());
+
+    cache.clear();
+    ASSERT_TRUE(cache.empty());
+    ASSERT_EQ(0u, cache.fileBytes());
+    ASSERT_FALSE(cache.get(1, value));
+  }
+  ASSERT_EQ(nullptr, std::fopen(path.c_str(), "rb"));
+}
+
+TEST(TieredCacheTest, diskCapacityAndCompaction) {
+  const auto path = ::testing::TempDir() + "tiered_compact.bin";
+  using Cache = TieredCache<int, std::string>;
+  const std::string big(1000, 'x');
+  Cache cache(10, path, 100 * 1024);
+
+  // Records are ~1KB, so the disk tier keeps about the last 100 spilled
+  for (int i = 0; i < 1000; ++i) {
+    cache.put(i, big + std::to_string(i));
+  }
+  ASSERT_EQ(10u, cache.memorySize());
+  ASSERT_LE(cache.diskBytes(), cache.diskMaxBytes());
+  ASSERT_GT(cache.diskSize(), 90u);
+  ASSERT_LE(cache.fileBytes(), 2 * cache.diskMaxBytes() + 2 * Cache::kCompactMinBytes);
+
+  std::string value;
+  ASSERT_FALSE(cache.get(0, value));
+  ASSERT_TRUE(cache.get(985, value));
+  ASSERT_EQ(big + "985", value);
+
+  // Everything still on disk reads back after an explicit compaction too
+  ASSERT_TRUE(cache.compact());
+  ASSERT_EQ(cache.diskBytes(), cache.fileBytes());
+  for (int i = 989; i > 900; --i) {
+    if (cache.contains(i)) {
+      ASSERT_TRUE(cache.get(i, value));
+      ASSERT_EQ(big + std::to_string(i), value);
+    }
+  }
+}
+
+TEST(TieredCacheTest, noDisk) {
+  TieredCache<int, int> cache(2, ::testing::TempDir() + "no/such/dir/spill.bin", 1024);
+  ASSERT_FALSE(cache.isDiskOk());
+  cache.put(1, 1);
+  cache.put(2, 2);
+  cache.put(3, 3);
+  ASSERT_EQ(2u, cache.size());
+  ASSERT_EQ(1u, cache.spillFailures());
+  int value = 0;
+  ASSERT_FALSE(cache.get(1, value));
+  ASSERT_FALSE(cache.compact());
+}
+
+#if SW_POSIX
+TEST(TieredCacheTest, failedCompactionKeepsMemory) {
+  const auto path = ::testing::TempDir() + "tiered_failed_compact.bin";
+  const auto blocker = path + "/blocker";
+  TieredCache<int, int> cache(2, path, 1024);
+  for (int i = 0; i < 5; ++i) {
+    cache.put(i, i);
+  }
+  ASSERT_EQ(3u, cache.diskSize());
+
+  // A non-empty directory in place of the spill file makes the rename fail
+  std::remove(path.c_str());
+  ASSERT_EQ(0, ::mkdir(path.c_str(), 0700));
+  std::fclose(std::fopen(blocker.c_str(), "wb"));
+  ASSERT_FALSE(cache.compact());
+  ASSERT_EQ(0u, cache.diskSize());
+  ASSERT_EQ(0u, cache.fileBytes());
+  ASSERT_EQ(2u, cache.memorySize());
+  int value = 0;
+  ASSERT_TRUE(cache.get(4, value));
+  ASSERT_EQ(4, value);
+
+  std::remove(blocker.c_str());
+  ::rmdir(path.c_str());
+}
+#endif
+
+SW_NAMESPACE_END
@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/timing_wheel.h>
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+SW_NAMESPACE_BEGIN
+
+namespace {
+constexpr sizex kNoBudget = ~0_z;
+}
+
+TEST(TimingWheelTest, basic) {
+  TimingWheel<int> wheel(100);
+  wheel.schedule(1, 105);
+  wheel.schedule(2, 200);
+  wheel.schedule(3, 50);  // Already passed
+  ASSERT_EQ(3u, wheel.size());
+
+  std::vector<int> fired;
+  auto collect = [&](int&& value, u64) { fired.push_back(value); };
+
+  ASSERT_EQ(1u, wheel.advance(104, kNoBudget, collect));
+  ASSERT_EQ((std::vector<int>{3}), fired);
+  ASSERT_EQ(104u, wheel.currentTick());
+
+  ASSERT_EQ(1u, wheel.advance(150, kNoBudget, collect));
+  ASSERT_EQ((std::vector<int>{3, 1}), fired);
+
+  ASSERT_EQ(1u, wheel.advance(10000, kNoBudget, collect));
+  ASSERT_EQ((std::vector<int>{3, 1, 2}), fired);
+  ASSERT_TRUE(wheel.empty());
+}
+
+TEST(TimingWheelTest, budget) {
+  TimingWheel<int> wheel;
+  for (int i = 0; i < 100; ++i) {
+    wheel.schedule(i, 10);
+  }
+
+  sizex count = 0;
+  auto counter = [&](int&&, u64) { ++count; };
+  ASSERT_EQ(7u, wheel.advance(20, 7, counter));
+  ASSERT_EQ(93u, wheel.size());
+  while (!wheel.empty()) {
+    wheel.advance(20, 7, counter);
+  }
+  ASSERT_EQ(100u, count);
+}
+
+TEST(TimingWheelTest, matchesReference) {
+  // Random schedules across all levels, including past the wheel's span, fired in
+  // random sized steps. Every value must fire once, no earlier than its tick, and no
+  // later than the first advance past it.
+  TimingWheel<u64> wheel(12345);
+  std::map<u64, u64> expected;  // value -> tick
+
+  u64 rnd = 88172645463325252_u64;
+  auto next = [&]() {
+    rnd ^= rnd << 13u;
+    rnd ^= rnd >> 7u;
+    rnd ^= rnd << 17u;
+    return rnd;
+  };
+
+  u64 now = 12345;
+  u64 id = 0;
+  for (int round = 0; round < 2000; ++round) {
+    for (int i = 0; i < 5; ++i) {
+      const auto shift = next() % 40;
+      const auto tick = now + (next() % (2_u64 << shift));
+      wheel.schedule(id, tick);
+      expected[id] = tick;
+      ++id;
+    }
+
+    now += next() % (1_u64 << (next() % 30));
+    wheel.advance(now, kNoBudget, [&](u64&& value, u64 tick) {
+      auto iter = expected.find(value);
+      ASSERT_NE(expected.end(), iter);
+      ASSERT_EQ(iter->second, tick);
+      ASSERT_LE(tick, now);
+      expected.erase(iter);
+    });
+
+    for (const auto& kv : expected) {
+      ASSERT_GT(kv.second, now);
+    }
+    ASSERT_EQ(expected.size(), wheel.size());
+  }
+}
+
+SW_NAMESPACE_END
@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright 2019 Steven C. Wilson
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+/// and associated documentation files (the "Software"), to deal in the Software without
+/// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all copies or
+/// substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+/// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+/// Replays a recorded or generated key trace through the cache eviction policies at
+/// several sizes, reporting the hit ratio, byte hit ratio and throughput of each.
+///
+///    sw-cache-sim --trace prod.txt --sizes 1000,10000,100000 --policies lru,arc,tinylfu
+///    sw-cache-sim --zipf 1000000,100000,0.9 --curve
+////////////////////////////////////////////////////////////////////////////////
+#include <sw/cache_simulator.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+void usage() {
+  std::printf(
+      "usage: sw-cache-sim <trace> [options]\n"
+      "trace, one of:\n"
+      "  --trace FILE                      binary (from --save) or text, 'key [size]' per line\n"
+      "  --zipf N,KEYS,SKEW                N accesses over KEYS keys with Zipf skew\n"
+      "  --scan N,KEYS,SKEW,LENGTH,PERIOD  Zipf, with a LENGTH scan every PERIOD accesses\n"
+      "  --loop N,KEYS                     N accesses cycling through KEYS keys\n"
+      "options:\n"
+      "  --sizes A,B,...                   cache sizes in entries (default 1%%,5%%,10%%,25%% of keys)\n"
+      "  --policies A,B,...                policies to run (default all)\n"
+      "  --curve                           print the exact LRU miss ratio curve, from one pass\n"
+      "  --save FILE                       save the trace in binary form\n"
+      "  --seed N                          seed for generated traces (default 1)\n");
+}
+
+std::vector<std::string> split(const std::string& str) {
+  std::vector<std::string> parts;
+  std::string::size_type start = 0;
+  while (true) {
+    const auto end = str.find(',', start);
+    parts.push_back(str.substr(start, end - start));
+    if (end == std::string::npos) {
+      return parts;
+    }
+    start = end + 1;
+  }
+}
+
+bool parseSize(const std::string& str, sw::sizex& value) {
+  char* end = nullptr;
+  const auto parsed = std::strtoull(str.c_str(), &end, 10);
+  value = static_cast<sw::sizex>(parsed);
+  return !str.empty() && *end == '\0';
+}
+
+bool parseDouble(const std::string& str, double& value) {
+  char* end = nullptr;
+  value = std::strtod(str.c_str(), &end);
+  return !str.empty() && *end == '\0';
+}
+
+/// Parse "N,KEYS,SKEW[,LENGTH,PERIOD]" style arguments, sizes then an optional skew
+bool parseGenerator(const std::string& arg, sw::sizex sizeCount, bool hasSkew, std::vector<sw::sizex>& sizes,
+                    double& skew) {
+  const auto parts = split(arg);
+  if (parts.size() != sizeCount + (hasSkew ? 1 : 0)) {
+    return false;
+  }
+  sizes.resize(sizeCount);
+  sw::sizex part = 0;
+  for (sw::sizex i = 0; i < parts.size(); ++i) {
+    if (hasSkew && i == 2) {
+      if (!parseDouble(parts[i], skew)) {
+        return false;
+      }
+    } else if (!parseSize(parts[i], sizes[part++])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  using namespace sw;
+
+  std::string tracePath;
+  std::string savePath;
+  std::string generator;
+  std::string generatorArg;
+  std::vector<sizex> sizes;
+  std::vector<std::string> policies;
+  bool curve = false;
+  u64 seed = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--curve") {
+      curve = true;
+    } else if (arg == "--help" || arg == "-h") {
+      usage();
+      return 0;
+    } else if (!hasValue) {
+      usage();
+      return 1;
+    } else if (arg == "--trace") {
+      tracePath = argv[++i];
+    } else if (arg == "--zipf" || arg == "--scan" || arg == "--loop") {
+      generator = arg;
+      generatorArg = argv[++i];
+    } else if (arg == "--sizes") {
+      for (const auto& part : split(argv[++i])) {
+        sizex value = 0;
+        if (!parseSize(part, value) || value == 0) {
+          std::fprintf(stderr, "Bad size '%s'\n", part.c_str());
+          return 1;
+        }
+        sizes.push_back(value);
+      }
+    } else if (arg == "--policies") {
+      policies = split(argv[++i]);
+    } else if (arg == "--save") {
+      savePath = argv[++i];
+    } else if (arg == "--seed") {
+      sizex value = 0;
+      if (!parseSize(argv[++i], value)) {
+        usage();
+        return 1;
+      }
+      seed = value;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  // Load or generate the trace
+  CacheTrace trace;
+  std::vector<sizex> counts;
+  double skew = 0;
+  if (!tracePath.empty()) {
+    if (!trace.load(tracePath)) {
+      std::fprintf(stderr, "Can't read trace '%s'\n", tracePath.c_str());
+      return 1;
+    }
+  } else if (generator == "--zipf" && parseGenerator(generatorArg, 2, true, counts, skew)) {
+    trace = CacheTrace::zipf(counts[0], counts[1], skew, seed);
+  } else if (generator == "--scan" && parseGenerator(generatorArg, 4, true, counts, skew)) {
+    trace = CacheTrace::scan(counts[0], counts[1], skew, counts[2], counts[3], seed);
+  } else if (generator == "--loop" && parseGenerator(generatorArg, 2, false, counts, skew)) {
+    trace = CacheTrace::loop(counts[0], counts[1]);
+  } else {
+    usage();
+    return 1;
+  }
+
+  if (!savePath.empty() && !trace.save(savePath)) {
+    std::fprintf(stderr, "Can't write trace '%s'\n", savePath.c_str());
+    return 1;
+  }
+
+  const auto distinct = trace.distinctKeys();
+  std::printf("%zu accesses, %zu distinct keys, %llu bytes\n", trace.size(), distinct,
+              static_cast<unsigned long long>(trace.totalBytes()));
+  if (trace.empty()) {
+    return 0;
+  }
+
+  if (sizes.empty()) {
+    for (const sizex percent : {1, 5, 10, 25}) {
+      sizes.push_back(std::max<sizex>(distinct * percent / 100, 1));
+    }
+  }
+
+  CacheSimulator simulator;
+  if (policies.empty()) {
+    policies = simulator.policies();
+  }
+  for (const auto& policy : policies) {
+    if (!simulator.hasPolicy(policy)) {
+      std::fprintf(stderr, "Unknown policy '%s'\n", policy.c_str());
+      return 1;
+    }
+  }
+
+  std::printf("%-10s %12s %9s %10s %12s\n", "policy", "size", "hit %", "byte hit %", "Mops/s");
+  for (const auto& result : simulator.run(trace, sizes, policies)) {
+    std::printf("%-10s %12zu %9.3f %10.3f %12.2f\n", result.policy.c_str(), result.cacheSize,
+                100.0 * result.hitRatio(), 100.0 * result.byteHitRatio(), result.opsPerSecond() / 1e6);
+  }
+
+  if (curve) {
+    const auto maxSize = *std::max_element(sizes.begin(), sizes.end());
+    std::printf("\nLRU miss ratio curve\n%12s %9s\n", "size", "miss %");
+    for (const auto& point : CacheSimulator::lruCurve(trace, maxSize).curve()) {
+      std::printf("%12zu %9.3f\n", point.cacheSize, 100.0 * point.missRatio);
+    }
+  }
+  return 0;
+}